@@ -1,27 +1,144 @@
+#include <inttypes.h>
 #include <stdio.h>
 #include "stdatomic.h"
 
+#include "sdkconfig.h"
+
 #include "esp_timer.h"
 #include "esp_log.h"
 #include "driver/gpio.h"
+#include "driver/ledc.h"
+
+#ifdef CONFIG_SLOW_PWM_ISR_DISPATCH
+#include "esp_attr.h"
+#include "hal/gpio_ll.h"
+#include "soc/gpio_struct.h"
+#endif
 
 #include "./slow_pwm.h"
 
 
 static const char* TAG = "slow_pwm";
 
+static const char* mode_names[] = {
+  [SLOW_PWM_MODE_TICKS] = "ticks",
+  [SLOW_PWM_MODE_EDGES] = "edges",
+  [SLOW_PWM_MODE_LEDC] = "ledc",
+  [SLOW_PWM_MODE_GROUP] = "group",
+};
+
+// REF_TICK counts us, the timer divides it by 10 integer and 8 fractional bits
+#define LEDC_SPEED LEDC_LOW_SPEED_MODE
+#define LEDC_MAX_BITS LEDC_TIMER_20_BIT
+#define LEDC_DIVIDER_ONE 256
+#define LEDC_DIVIDER_MAX ((1 << 18) - 1)
+
+// the timer is shared by all LEDC outputs, configured by the first
+static uint32_t ledc_users = 0;
+static uint32_t ledc_channels_used = 0;
+static uint64_t ledc_freq = 0;
+static uint32_t ledc_bits = 0;
+static uint32_t ledc_divider = 0;
+
+// everything on the way from the timer to the output runs from IRAM,
+// esp_timer_start_once and esp_timer_stop are IRAM functions that may be
+// called from ISR dispatched callbacks in IDF 4.4
+#ifdef CONFIG_SLOW_PWM_ISR_DISPATCH
+#define PWM_IRAM IRAM_ATTR
+#define PWM_DISPATCH ESP_TIMER_ISR
+#else
+#define PWM_IRAM
+#define PWM_DISPATCH ESP_TIMER_TASK
+#endif
+
+// duties are kept in 1/65536 of a step
+#define FINE_SHIFT 16
+// a full duty of that many steps still fits 32 bits
+#define MAX_RESOLUTION 65535
+
+static slow_pwm_jitter_t jitter = {0};
+static portMUX_TYPE jitter_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// the edges of edges mode outputs, moved by duty changes
+static portMUX_TYPE edges_lock = portMUX_INITIALIZER_UNLOCKED;
+
+
+static void PWM_IRAM set_level(gpio_num_t gpio_num, uint32_t level) {
+#ifdef CONFIG_SLOW_PWM_ISR_DISPATCH
+  // gpio_set_level is in flash, the register write is inlined
+  gpio_ll_set_level(&GPIO, gpio_num, level);
+#else
+  gpio_set_level(gpio_num, level);
+#endif
+}
 
-static void periodic_timer_callback(void * arg) {
+
+// how late the edge due at `due_us` is switched
+static void PWM_IRAM record_jitter(int64_t due_us) {
+  const int64_t late_us = esp_timer_get_time() - due_us;
+  const uint32_t us = (late_us <= 0) ? 0 : (late_us > UINT32_MAX) ? UINT32_MAX : late_us;
+  const uint8_t bucket = (us == 0) ? 0 : 32 - __builtin_clz(us);
+
+  portENTER_CRITICAL_SAFE(&jitter_lock);
+  jitter.edges += 1;
+  jitter.histogram[(bucket < SLOW_PWM_JITTER_BUCKETS) ? bucket : SLOW_PWM_JITTER_BUCKETS - 1] += 1;
+  if (us > jitter.max_us) {
+    jitter.max_us = us;
+  }
+  portEXIT_CRITICAL_SAFE(&jitter_lock);
+}
+
+
+// Steps the cycle starting now is on for. What the whole steps leave of
+// the duty is carried over, a burst cycle is all on once a cycle is owed.
+static uint32_t PWM_IRAM cycle_steps(slow_pwm_t * pwm) {
+  const uint64_t full = (uint64_t) pwm->cycle_ticks << FINE_SHIFT;
+  const uint64_t duty = atomic_load(&(pwm->duty_fine));
+  pwm->carry += (duty < full) ? duty : full;
+
+  if (pwm->modulation == SLOW_PWM_MODULATION_BURST) {
+    if (pwm->carry < full) {
+      return 0;
+    }
+    pwm->carry -= full;
+    return pwm->cycle_ticks;
+  }
+
+  const uint32_t steps = pwm->carry >> FINE_SHIFT;
+  pwm->carry -= (uint64_t) steps << FINE_SHIFT;
+  return steps;
+}
+
+
+// the length of a step, in 1/65536 us, the timers need not divide
+static uint64_t step_length(uint64_t freq, uint32_t resolution) {
+  return (freq << FINE_SHIFT) / resolution;
+}
+
+
+// when `steps` of the cycle starting at `start_us` are over
+static int64_t PWM_IRAM after_steps(const slow_pwm_t * pwm, int64_t start_us, uint32_t steps) {
+  return start_us + (int64_t) ((pwm->step_us_fine * steps) >> FINE_SHIFT);
+}
+
+
+static void PWM_IRAM periodic_timer_callback(void * arg) {
   slow_pwm_t * pmw = (slow_pwm_t *)arg;
 
-  uint32_t duty = atomic_load(&(pmw->duty));
+  record_jitter(pmw->next_edge_us);
+  pmw->next_edge_us = after_steps(pmw, pmw->next_edge_us, 1);
+
+  if (pmw->tick_cntr == 0) {
+    pmw->cycle_duty = cycle_steps(pmw);
+  }
+  uint32_t duty = pmw->cycle_duty;
 
   if (pmw->tick_cntr < duty) {
     // ESP_LOGI(TAG, "tick %u, duty %u: on", pmw->tick_cntr, duty);
-    gpio_set_level(pmw->gpio_num, 1);
+    set_level(pmw->gpio_num, 1);
   } else if (duty < pmw->cycle_ticks) {
     // ESP_LOGI(TAG, "tick %u, duty %u: off", pmw->tick_cntr, duty);
-    gpio_set_level(pmw->gpio_num, 0);
+    set_level(pmw->gpio_num, 0);
   }
 
   pmw->tick_cntr += 1;
@@ -31,10 +148,241 @@ static void periodic_timer_callback(void * arg) {
 }
 
 
+static void PWM_IRAM arm_edge(esp_timer_handle_t timer, int64_t at_us) {
+  const int64_t delay_us = at_us - esp_timer_get_time();
+  esp_timer_start_once(timer, (delay_us > 0) ? delay_us : 0);
+}
+
+
+// Switches the output at its due edge, the start of a cycle or the off
+// edge, and returns the time of the next one.
+static int64_t PWM_IRAM edge_step(slow_pwm_t * pwm) {
+  if (pwm->off_pending) {
+    pwm->off_pending = false;
+    // a duty raised to full since the cycle start keeps it on
+    if (atomic_load(&(pwm->duty_fine)) < ((uint64_t) pwm->cycle_ticks << FINE_SHIFT)) {
+      set_level(pwm->gpio_num, 0);
+    }
+    return pwm->cycle_start_us + pwm->freq;
+  }
+
+  // scheduled from the previous cycle start, a late wakeup does not drift
+  pwm->cycle_start_us += pwm->freq;
+  const int64_t cycle_end_us = pwm->cycle_start_us + pwm->freq;
+  const uint32_t duty = cycle_steps(pwm);
+
+  if (duty == 0) {
+    set_level(pwm->gpio_num, 0);
+    return cycle_end_us;
+  } else if (duty >= pwm->cycle_ticks) {
+    set_level(pwm->gpio_num, 1);
+    return cycle_end_us;
+  }
+  set_level(pwm->gpio_num, 1);
+  pwm->off_pending = true;
+  pwm->cycle_duty = duty;
+  return after_steps(pwm, pwm->cycle_start_us, duty);
+}
+
+
+static void PWM_IRAM next_edge(slow_pwm_t * pwm) {
+  pwm->next_edge_us = edge_step(pwm);
+  // a duty change may have armed the timer again meanwhile
+  esp_timer_stop(pwm->timer);
+  arm_edge(pwm->timer, pwm->next_edge_us);
+}
+
+
+// one-shot, armed for the start of the next cycle or for the off edge
+static void PWM_IRAM edge_timer_callback(void * arg) {
+  slow_pwm_t * pwm = (slow_pwm_t *)arg;
+  portENTER_CRITICAL_SAFE(&edges_lock);
+  record_jitter(pwm->next_edge_us);
+  next_edge(pwm);
+  portEXIT_CRITICAL_SAFE(&edges_lock);
+}
+
+
+// A duty too low for the steps granted to the current cycle moves its
+// pending off edge forward, right to now if it is past already. A fraction
+// may be granted a whole step, so the new duty is rounded up. True if the
+// edge moved.
+static bool advance_off_edge(slow_pwm_t * pwm, uint32_t duty_fine) {
+  const uint32_t steps = (duty_fine + (1 << FINE_SHIFT) - 1) >> FINE_SHIFT;
+  if (!pwm->off_pending || steps >= pwm->cycle_duty) {
+    return false;
+  }
+  const int64_t off_us = after_steps(pwm, pwm->cycle_start_us, steps);
+  const int64_t now_us = esp_timer_get_time();
+  pwm->next_edge_us = (off_us > now_us) ? off_us : now_us;
+  return true;
+}
+
+
+// after the channels with the same edge time, they switch in slot order
+static void PWM_IRAM schedule_channel(slow_pwm_group_t * group, slow_pwm_t * pwm) {
+  uint32_t at = group->scheduled;
+  while (at > 0 && group->schedule[at - 1]->next_edge_us > pwm->next_edge_us) {
+    group->schedule[at] = group->schedule[at - 1];
+    at--;
+  }
+  group->schedule[at] = pwm;
+  group->scheduled += 1;
+}
+
+
+static void PWM_IRAM unschedule_channel(slow_pwm_group_t * group, slow_pwm_t * pwm) {
+  uint32_t at = 0;
+  while (at < group->scheduled && group->schedule[at] != pwm) {
+    at++;
+  }
+  if (at == group->scheduled) {
+    return;
+  }
+  group->scheduled -= 1;
+  for (; at < group->scheduled; at++) {
+    group->schedule[at] = group->schedule[at + 1];
+  }
+}
+
+
+static void PWM_IRAM arm_group(slow_pwm_group_t * group) {
+  esp_timer_stop(group->timer);
+  if (group->scheduled > 0) {
+    arm_edge(group->timer, group->schedule[0]->next_edge_us);
+  }
+}
+
+
+// one-shot, armed for the earliest edge of all channels
+static void PWM_IRAM group_timer_callback(void * arg) {
+  slow_pwm_group_t * group = (slow_pwm_group_t *)arg;
+
+  portENTER_CRITICAL_SAFE(&(group->lock));
+  const int64_t now_us = esp_timer_get_time();
+  // every edge due by now, coinciding edges take a single wakeup
+  while (group->scheduled > 0 && group->schedule[0]->next_edge_us <= now_us) {
+    slow_pwm_t * pwm = group->schedule[0];
+    unschedule_channel(group, pwm);
+    record_jitter(pwm->next_edge_us);
+    pwm->next_edge_us = edge_step(pwm);
+    schedule_channel(group, pwm);
+  }
+  arm_group(group);
+  portEXIT_CRITICAL_SAFE(&(group->lock));
+}
+
+
+// Finest duty resolution with a divider in range, 0 if the cycle is out of reach.
+static uint32_t ledc_bits_for(uint64_t freq, uint32_t resolution, uint32_t * divider) {
+  for (uint32_t bits = LEDC_MAX_BITS; bits > 0 && (1ULL << bits) >= resolution; bits--) {
+    const uint64_t div = ((freq << 8) + (1ULL << (bits - 1))) >> bits;
+    if (div > LEDC_DIVIDER_MAX) {
+      // fewer bits need an even larger divider
+      return 0;
+    }
+    if (div >= LEDC_DIVIDER_ONE) {
+      *divider = div;
+      return bits;
+    }
+  }
+  return 0;
+}
+
+
+static uint32_t ledc_duty(const slow_pwm_t * pwm, uint32_t duty_fine) {
+  const uint64_t full = (uint64_t) pwm->cycle_ticks << FINE_SHIFT;
+  if (duty_fine >= full) {
+    // the full range keeps the output on
+    return 1 << pwm->ledc_bits;
+  }
+  return ((uint64_t) duty_fine << pwm->ledc_bits) / full;
+}
+
+
+static bool start_ledc(slow_pwm_t * pwm) {
+  if (ledc_users > 0 && ledc_freq != pwm->freq) {
+    ESP_LOGW(TAG, "LEDC timer runs a %" PRIu64 " us cycle, not %" PRIu64 " us", ledc_freq, pwm->freq);
+    return false;
+  }
+
+  ledc_channel_t channel = CONFIG_SLOW_PWM_LEDC_FIRST_CHANNEL;
+  while (channel < LEDC_CHANNEL_MAX && (ledc_channels_used & (1 << channel))) {
+    channel++;
+  }
+  if (channel >= LEDC_CHANNEL_MAX) {
+    ESP_LOGW(TAG, "no LEDC channel left");
+    return false;
+  }
+
+  if (ledc_users == 0) {
+    ledc_bits = ledc_bits_for(pwm->freq, pwm->cycle_ticks, &ledc_divider);
+    if (ledc_bits == 0) {
+      ESP_LOGW(TAG, "LEDC timer cannot run a %" PRIu64 " us cycle", pwm->freq);
+      return false;
+    }
+    ledc_timer_set(LEDC_SPEED, CONFIG_SLOW_PWM_LEDC_TIMER, ledc_divider, ledc_bits, LEDC_REF_TICK);
+    ledc_timer_rst(LEDC_SPEED, CONFIG_SLOW_PWM_LEDC_TIMER);
+    ledc_freq = pwm->freq;
+  }
+
+  pwm->ledc_channel = channel;
+  pwm->ledc_bits = ledc_bits;
+  ledc_channel_config_t channel_config = {
+    .gpio_num = pwm->gpio_num,
+    .speed_mode = LEDC_SPEED,
+    .channel = channel,
+    .timer_sel = CONFIG_SLOW_PWM_LEDC_TIMER,
+    .duty = ledc_duty(pwm, atomic_load(&(pwm->duty_fine))),
+    .hpoint = 0,
+  };
+  if (ledc_channel_config(&channel_config) != ESP_OK) {
+    ESP_LOGW(TAG, "LEDC channel %d failed", channel);
+    return false;
+  }
+
+  ledc_channels_used |= 1 << channel;
+  ledc_users += 1;
+  return true;
+}
+
+
+static bool resolution_valid(uint32_t resolution) {
+  if (resolution == 0 || resolution > MAX_RESOLUTION) {
+    ESP_LOGE(TAG, "resolution %u out of range: %s", resolution, esp_err_to_name(ESP_ERR_INVALID_ARG));
+    return false;
+  }
+  return true;
+}
+
+
+static void stop_ledc(slow_pwm_t * pwm) {
+  ledc_stop(LEDC_SPEED, pwm->ledc_channel, 0);
+  ledc_channels_used &= ~(1 << pwm->ledc_channel);
+  ledc_users -= 1;
+}
+
+
 slow_pwm_t * start_pwm(
   uint64_t freq, uint32_t resolution, uint32_t duty, gpio_num_t gpio_num
 ) {
-  ESP_LOGI(TAG, "starting slow-pwm ...");
+#if defined(CONFIG_SLOW_PWM_LEDC)
+  return start_pwm_mode(freq, resolution, duty, gpio_num, SLOW_PWM_MODE_LEDC);
+#elif defined(CONFIG_SLOW_PWM_EDGE_SCHEDULED)
+  return start_pwm_mode(freq, resolution, duty, gpio_num, SLOW_PWM_MODE_EDGES);
+#else
+  return start_pwm_mode(freq, resolution, duty, gpio_num, SLOW_PWM_MODE_TICKS);
+#endif
+}
+
+
+slow_pwm_t * start_pwm_mode(
+  uint64_t freq, uint32_t resolution, uint32_t duty, gpio_num_t gpio_num, slow_pwm_mode_t mode
+) {
+  ESP_LOGI(TAG, "starting slow-pwm in %s mode ...", mode_names[mode]);
+  if (!resolution_valid(resolution)) {
+    return NULL;
+  }
 
   gpio_set_direction(gpio_num, GPIO_MODE_OUTPUT);
   gpio_set_level(gpio_num, 0);
@@ -43,34 +391,268 @@ slow_pwm_t * start_pwm(
   *pwm = (slow_pwm_t) {
     .freq = freq,
     .cycle_ticks = resolution,
-    .duty =  duty,
+    .step_us_fine = step_length(freq, resolution),
+    .duty_fine = ((duty < resolution) ? duty : resolution) << FINE_SHIFT,
     .gpio_num = gpio_num,
     .tick_cntr = 0,
     .timer_args = {
       .callback = &periodic_timer_callback,
-      .arg = pwm
-    }
+      .arg = pwm,
+      .dispatch_method = PWM_DISPATCH,
+    },
+    .mode = mode,
+    // the first cycle starts right away
+    .cycle_start_us = esp_timer_get_time() - freq,
+    .next_edge_us = esp_timer_get_time(),
   };
-  esp_timer_create(&(pwm->timer_args), &(pwm->timer));
-  esp_timer_start_periodic(pwm->timer, freq / resolution);
 
-  ESP_LOGI(TAG, "started slow-pwm");
+  if (mode == SLOW_PWM_MODE_LEDC && !start_ledc(pwm)) {
+    ESP_LOGW(TAG, "falling back to edges mode");
+    pwm->mode = SLOW_PWM_MODE_EDGES;
+  }
+
+  if (pwm->mode == SLOW_PWM_MODE_EDGES) {
+    pwm->timer_args.callback = &edge_timer_callback;
+    esp_timer_create(&(pwm->timer_args), &(pwm->timer));
+    // the first cycle start is switched by the caller, it is never late
+    next_edge(pwm);
+  } else if (pwm->mode == SLOW_PWM_MODE_TICKS) {
+    esp_timer_create(&(pwm->timer_args), &(pwm->timer));
+    pwm->next_edge_us += freq / resolution;
+    esp_timer_start_periodic(pwm->timer, freq / resolution);
+  }
+
+  slow_pwm_info_t info;
+  get_pwm_info(pwm, &info);
+  ESP_LOGI(
+    TAG, "started slow-pwm in %s mode, cycle: %" PRIu64 " us, resolution: %u",
+    mode_names[info.mode], info.period_us, info.resolution
+  );
   return pwm;
 };
 
 
 void stop_pwm(slow_pwm_t * pwm) {
   ESP_LOGI(TAG, "stopping slow-pwm");
-  esp_timer_stop(pwm->timer);
-  esp_timer_delete(pwm->timer);
-  free(&(pwm->timer_args));
+  slow_pwm_group_t * group = pwm->group;
+  if (group != NULL) {
+    portENTER_CRITICAL(&(group->lock));
+    unschedule_channel(group, pwm);
+    group->channels[pwm->slot] = NULL;
+    arm_group(group);
+    portEXIT_CRITICAL(&(group->lock));
+  }
+
+  if (pwm->mode == SLOW_PWM_MODE_LEDC) {
+    stop_ledc(pwm);
+  } else if (pwm->mode == SLOW_PWM_MODE_GROUP) {
+    gpio_set_level(pwm->gpio_num, 0);
+  } else {
+    esp_timer_stop(pwm->timer);
+    esp_timer_delete(pwm->timer);
+  }
   free(pwm);
   ESP_LOGI(TAG, "stopped slow-pwm");
 };
 
 
+static void store_duty(slow_pwm_t * pwm, uint32_t duty_fine) {
+  atomic_store(&(pwm->duty_fine), duty_fine);
+
+  if (pwm->mode == SLOW_PWM_MODE_LEDC) {
+    // latched by the hardware at the end of the cycle
+    ledc_set_duty(LEDC_SPEED, pwm->ledc_channel, ledc_duty(pwm, duty_fine));
+    ledc_update_duty(LEDC_SPEED, pwm->ledc_channel);
+
+  } else if (pwm->mode == SLOW_PWM_MODE_TICKS && pwm->modulation == SLOW_PWM_MODULATION_PWM) {
+    // the ticks switch a new duty within the current cycle, unless it only
+    // differs by the step a fraction may or may not be granted
+    const uint32_t floor_steps = duty_fine >> FINE_SHIFT;
+    const uint32_t ceil_steps = (duty_fine + (1 << FINE_SHIFT) - 1) >> FINE_SHIFT;
+    if (ceil_steps < pwm->cycle_duty) {
+      pwm->cycle_duty = ceil_steps;
+    } else if (floor_steps > pwm->cycle_duty) {
+      pwm->cycle_duty = floor_steps;
+    }
+
+  } else if (pwm->mode == SLOW_PWM_MODE_EDGES) {
+    portENTER_CRITICAL(&edges_lock);
+    if (advance_off_edge(pwm, duty_fine)) {
+      esp_timer_stop(pwm->timer);
+      arm_edge(pwm->timer, pwm->next_edge_us);
+    }
+    portEXIT_CRITICAL(&edges_lock);
+
+  } else if (pwm->mode == SLOW_PWM_MODE_GROUP) {
+    slow_pwm_group_t * group = pwm->group;
+    portENTER_CRITICAL(&(group->lock));
+    if (advance_off_edge(pwm, duty_fine)) {
+      unschedule_channel(group, pwm);
+      schedule_channel(group, pwm);
+      arm_group(group);
+    }
+    portEXIT_CRITICAL(&(group->lock));
+  }
+}
+
+
 void set_pwm_duty(slow_pwm_t * pwm, uint32_t duty) {
   ESP_LOGI(TAG, "update duty cycle: %u", duty);
-  atomic_store(&(pwm->duty), duty);
+  store_duty(pwm, ((duty < pwm->cycle_ticks) ? duty : pwm->cycle_ticks) << FINE_SHIFT);
+};
+
+
+void set_pwm_duty_q16(slow_pwm_t * pwm, uint32_t duty_q16) {
+  ESP_LOGI(TAG, "update duty cycle: %.3f %%", duty_q16 * 100.0 / (1 << FINE_SHIFT));
+  // a share of the cycle is that share of the steps
+  const uint64_t duty_fine = (uint64_t) duty_q16 * pwm->cycle_ticks;
+  const uint64_t full = (uint64_t) pwm->cycle_ticks << FINE_SHIFT;
+  store_duty(pwm, (duty_fine < full) ? duty_fine : full);
+};
+
+
+bool set_pwm_modulation(slow_pwm_t * pwm, slow_pwm_modulation_t modulation) {
+  if (pwm->mode == SLOW_PWM_MODE_LEDC && modulation != SLOW_PWM_MODULATION_PWM) {
+    ESP_LOGW(TAG, "LEDC outputs cannot burst");
+    return false;
+  }
+  pwm->modulation = modulation;
+  return true;
+};
+
+
+void get_pwm_info(const slow_pwm_t * pwm, slow_pwm_info_t * info) {
+  info->mode = pwm->mode;
+  switch (pwm->mode) {
+    case SLOW_PWM_MODE_TICKS:
+      // whole us per tick
+      info->period_us = pwm->freq / pwm->cycle_ticks * pwm->cycle_ticks;
+      info->resolution = pwm->cycle_ticks;
+      break;
+    case SLOW_PWM_MODE_EDGES:
+    case SLOW_PWM_MODE_GROUP:
+      info->period_us = pwm->freq;
+      info->resolution = pwm->cycle_ticks;
+      break;
+    case SLOW_PWM_MODE_LEDC:
+      info->period_us = ((uint64_t) ledc_divider << pwm->ledc_bits) >> 8;
+      info->resolution = 1 << pwm->ledc_bits;
+      break;
+  }
 };
 
+
+slow_pwm_group_t * start_pwm_group(uint64_t freq, uint32_t resolution, uint32_t channels) {
+  ESP_LOGI(TAG, "starting slow-pwm group of %u channels ...", channels);
+  if (!resolution_valid(resolution)) {
+    return NULL;
+  }
+
+  slow_pwm_group_t * group = malloc(sizeof(slow_pwm_group_t));
+  *group = (slow_pwm_group_t) {
+    .freq = freq,
+    .cycle_ticks = resolution,
+    .slots = channels,
+    .start_us = esp_timer_get_time(),
+    .channels = calloc(channels, sizeof(slow_pwm_t *)),
+    .schedule = calloc(channels, sizeof(slow_pwm_t *)),
+    .scheduled = 0,
+    .timer_args = {
+      .callback = &group_timer_callback,
+      .arg = group,
+      .dispatch_method = PWM_DISPATCH,
+    },
+    .lock = portMUX_INITIALIZER_UNLOCKED,
+  };
+  esp_timer_create(&(group->timer_args), &(group->timer));
+
+  ESP_LOGI(TAG, "started slow-pwm group");
+  return group;
+}
+
+
+slow_pwm_t * start_pwm_channel(slow_pwm_group_t * group, uint32_t duty, gpio_num_t gpio_num) {
+  uint32_t slot = 0;
+  while (slot < group->slots && group->channels[slot] != NULL) {
+    slot++;
+  }
+  if (slot == group->slots) {
+    ESP_LOGW(TAG, "no slot left in the group for GPIO %d", gpio_num);
+    return NULL;
+  }
+
+  gpio_set_direction(gpio_num, GPIO_MODE_OUTPUT);
+  gpio_set_level(gpio_num, 0);
+
+  // the next cycle start of the slot, its phase is its share of the cycle
+  const int64_t phase_us = group->start_us + group->freq * slot / group->slots;
+  const int64_t elapsed_us = esp_timer_get_time() - phase_us;
+  const int64_t cycles = (elapsed_us > 0) ? (elapsed_us + group->freq - 1) / group->freq : 0;
+  const int64_t first_us = phase_us + cycles * group->freq;
+
+  slow_pwm_t * pwm = malloc(sizeof(slow_pwm_t));
+  *pwm = (slow_pwm_t) {
+    .freq = group->freq,
+    .cycle_ticks = group->cycle_ticks,
+    .step_us_fine = step_length(group->freq, group->cycle_ticks),
+    .duty_fine = ((duty < group->cycle_ticks) ? duty : group->cycle_ticks) << FINE_SHIFT,
+    .gpio_num = gpio_num,
+    .mode = SLOW_PWM_MODE_GROUP,
+    .cycle_start_us = first_us - group->freq,
+    .group = group,
+    .slot = slot,
+    .next_edge_us = first_us,
+  };
+
+#ifdef CONFIG_SLOW_PWM_LEDC
+  // the hardware needs no shared timer
+  pwm->mode = SLOW_PWM_MODE_LEDC;
+  if (start_ledc(pwm)) {
+    group->channels[slot] = pwm;
+    ESP_LOGI(TAG, "started slow-pwm channel %u on GPIO %d as LEDC output", slot, gpio_num);
+    return pwm;
+  }
+  // keeps the phase of its slot on the group's timer
+  ESP_LOGW(TAG, "falling back to group mode");
+  pwm->mode = SLOW_PWM_MODE_GROUP;
+#endif
+
+  portENTER_CRITICAL(&(group->lock));
+  group->channels[slot] = pwm;
+  schedule_channel(group, pwm);
+  arm_group(group);
+  portEXIT_CRITICAL(&(group->lock));
+
+  ESP_LOGI(TAG, "started slow-pwm channel %u on GPIO %d", slot, gpio_num);
+  return pwm;
+}
+
+
+void stop_pwm_group(slow_pwm_group_t * group) {
+  ESP_LOGI(TAG, "stopping slow-pwm group");
+  for (uint32_t slot = 0; slot < group->slots; slot++) {
+    if (group->channels[slot] != NULL) {
+      stop_pwm(group->channels[slot]);
+    }
+  }
+  esp_timer_stop(group->timer);
+  esp_timer_delete(group->timer);
+  free(group->channels);
+  free(group->schedule);
+  free(group);
+  ESP_LOGI(TAG, "stopped slow-pwm group");
+}
+
+
+void get_pwm_jitter(slow_pwm_jitter_t * out) {
+  portENTER_CRITICAL(&jitter_lock);
+  *out = jitter;
+  portEXIT_CRITICAL(&jitter_lock);
+}
+
+
+void reset_pwm_jitter(void) {
+  portENTER_CRITICAL(&jitter_lock);
+  jitter = (slow_pwm_jitter_t) {0};
+  portEXIT_CRITICAL(&jitter_lock);
+}
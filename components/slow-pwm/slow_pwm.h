@@ -1,7 +1,9 @@
 #pragma once
 
 #include "driver/gpio.h"
+#include "driver/ledc.h"
 #include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
 #include "stdatomic.h"
 
 
@@ -10,23 +12,147 @@ extern "C" {
 #endif
 
 
+typedef enum {
+    // wakes every tick, 1/resolution of a cycle
+    SLOW_PWM_MODE_TICKS,
+    // wakes at most twice a cycle, at its start and at the off edge
+    SLOW_PWM_MODE_EDGES,
+    // a LEDC channel generates the output, no wakeups at all
+    SLOW_PWM_MODE_LEDC,
+    // edges mode on the timer of a group, woken for every edge of the group
+    SLOW_PWM_MODE_GROUP,
+} slow_pwm_mode_t;
+
+
+typedef enum {
+    // on for the duty share of every cycle in whole steps of 1/resolution,
+    // the fraction of a step is carried over to the next cycles
+    SLOW_PWM_MODULATION_PWM,
+    // whole cycles on or off, as many on as the duty share
+    SLOW_PWM_MODULATION_BURST,
+} slow_pwm_modulation_t;
+
+
+// What the backend achieved for the requested cycle and resolution.
+typedef struct {
+    slow_pwm_mode_t mode;
+    uint64_t period_us;
+    // duty steps of the output, a duty is scaled to them
+    uint32_t resolution;
+} slow_pwm_info_t;
+
+
+// bucket 0 counts edges switched on time, bucket n edges 2^(n-1) to
+// 2^n - 1 us late, the last bucket everything later
+#define SLOW_PWM_JITTER_BUCKETS 20
+
 typedef struct {
+    uint32_t edges;
+    uint32_t max_us;
+    uint32_t histogram[SLOW_PWM_JITTER_BUCKETS];
+} slow_pwm_jitter_t;
+
+
+// Outputs sharing one timer and the cycle length. Their cycles start at
+// evenly spread phases, a slot each, so they do not switch on together.
+typedef struct slow_pwm_group {
+    uint64_t freq;
+    uint32_t cycle_ticks;
+    uint32_t slots;
+    int64_t start_us;
+    // by slot, NULL while free
+    struct slow_pwm ** channels;
+    // scheduled channels by their next edge, earliest first
+    struct slow_pwm ** schedule;
+    uint32_t scheduled;
+    esp_timer_handle_t timer;
+    esp_timer_create_args_t timer_args;
+    portMUX_TYPE lock;
+} slow_pwm_group_t;
+
+
+typedef struct slow_pwm {
     uint64_t freq;
     uint32_t cycle_ticks;
-    atomic_uint_fast32_t duty;
+    // the length of a step in 1/65536 us, the timers multiply by it
+    uint64_t step_us_fine;
+    // in 1/65536 of a step
+    atomic_uint_fast32_t duty_fine;
     uint32_t tick_cntr;
+    // timer modes, the steps the current cycle is on for
+    uint32_t cycle_duty;
+
+    slow_pwm_modulation_t modulation;
+    // the duty owed by the cycles so far, in 1/65536 of a step
+    uint64_t carry;
     gpio_num_t gpio_num;
     esp_timer_handle_t timer;
     esp_timer_create_args_t timer_args;
+
+    slow_pwm_mode_t mode;
+    // edges mode, start of the current cycle
+    int64_t cycle_start_us;
+    // edges mode, the next wakeup switches the output off
+    bool off_pending;
+
+    // LEDC mode, the channel and the duty resolution of the shared timer
+    ledc_channel_t ledc_channel;
+    uint32_t ledc_bits;
+
+    // group mode, the slot of the channel
+    slow_pwm_group_t * group;
+    uint32_t slot;
+    // timer modes, when the next edge or tick is due
+    int64_t next_edge_us;
 } slow_pwm_t;
 
 
+// `freq` is the cycle length in us, `resolution` up to 65535 steps. Starts with the backend chosen by
+// CONFIG_SLOW_PWM_BACKEND, NULL for a resolution out of range.
 slow_pwm_t * start_pwm(uint64_t freq, uint32_t resolution, uint32_t duty, gpio_num_t gpio_num);
 
+// The LEDC mode falls back to the edges mode when it cannot reach the
+// cycle length, get_pwm_info tells the mode that started.
+slow_pwm_t * start_pwm_mode(
+    uint64_t freq, uint32_t resolution, uint32_t duty, gpio_num_t gpio_num, slow_pwm_mode_t mode
+);
+
 void stop_pwm(slow_pwm_t * foo);
 
+// A group of `channels` slots with a cycle of `freq` us. Its channels share
+// the timer and run in group mode, with the LEDC backend chosen by
+// CONFIG_SLOW_PWM_BACKEND they start as LEDC outputs of their own instead,
+// in group mode once no LEDC channel is left.
+// NULL for a resolution out of range, like start_pwm.
+slow_pwm_group_t * start_pwm_group(uint64_t freq, uint32_t resolution, uint32_t channels);
+
+// Takes the first free slot, NULL if there is none. The output stays off
+// until the next cycle start of the slot. stop_pwm frees the slot.
+slow_pwm_t * start_pwm_channel(slow_pwm_group_t * group, uint32_t duty, gpio_num_t gpio_num);
+
+// Stops the channels left in the group too.
+void stop_pwm_group(slow_pwm_group_t * group);
+
+// A new duty is applied from the next cycle. In edges and group mode a
+// lower duty moves the off edge of the current cycle forward, a duty
+// raised to full keeps the output on at the off edge.
 void set_pwm_duty(slow_pwm_t * foo, uint32_t duty);
 
+// Duty as a share of the cycle, 65536 is always on. Timer driven outputs
+// switch whole steps and deliver the fraction over the next cycles, LEDC
+// outputs to the resolution of the hardware.
+void set_pwm_duty_q16(slow_pwm_t * pwm, uint32_t duty_q16);
+
+// Applies from the next cycle, false for LEDC outputs, they cannot burst.
+bool set_pwm_modulation(slow_pwm_t * pwm, slow_pwm_modulation_t modulation);
+
+void get_pwm_info(const slow_pwm_t * pwm, slow_pwm_info_t * info);
+
+// Lateness of the edges and ticks of all timer driven outputs since start
+// or the last reset, LEDC outputs are switched by the hardware.
+void get_pwm_jitter(slow_pwm_jitter_t * jitter);
+void reset_pwm_jitter(void);
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "esp_log.h"
+#include "mqtt_client.h"
+#include "host_fakes.h"
+
+#include "app_events.h"
+#include "app_mqtt.h"
+#include "app_state.h"
+#include "app_stats.h"
+#include "app_thermostat.h"
+
+
+// Hot path benchmarks on the host. The numbers compare changes of the app
+// code against each other, they say little about the timing on target.
+
+
+#define PREFIX "/thermostat"
+
+
+typedef void (*bench_fn_t)(uint32_t i);
+
+
+static uint32_t no_data_calls = 0;
+
+
+
+static void count_no_data(void * arg, app_event_t evt_id, const app_no_data_t * data) {
+  no_data_calls += 1;
+}
+
+
+
+static void post_block_event(uint32_t i) {
+  app_post_time_updated(NULL);
+  fake_event_loops_run();
+}
+
+
+
+static void post_block_burst(uint32_t i) {
+  for (int n = 0; n < 16; n++) {
+    app_post_time_updated(NULL);
+  }
+  fake_event_loops_run();
+}
+
+
+
+static void post_coalesced_burst(uint32_t i) {
+  for (int n = 0; n < 16; n++) {
+    const app_zone_value_t humid = { .value = 40 + (i + n) % 20 };
+    app_post_current_humid_changed(&humid);
+  }
+  fake_event_loops_run();
+}
+
+
+
+static void publish_state(uint32_t i) {
+  app_state_t state;
+  app_state_get(0, &state);
+  state.current_humid = 40 + i % 20;
+  app_state_publish(&state);
+  fake_event_loops_run();
+}
+
+
+
+static void thermostat_decision(uint32_t i) {
+  // alternates between max and normal heat, every input changes the duty
+  app_traced_temp_t temp = { .temp = (i & 1) ? 19.0 : 20.5 };
+  app_post_current_temp_changed(&temp);
+  fake_event_loops_run();
+}
+
+
+
+static void stats_report(uint32_t i) {
+  fake_mqtt_deliver(PREFIX "/stats/get", "{}");
+  fake_event_loops_run();
+}
+
+
+
+static void metrics_report(uint32_t i) {
+  fake_mqtt_deliver(PREFIX "/events/metrics/get", "{}");
+  fake_event_loops_run();
+}
+
+
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+
+
+static void run(const char * name, bench_fn_t fn, uint32_t iterations) {
+  // warm up
+  for (uint32_t i = 0; i < iterations / 10; i++) {
+    fn(i);
+  }
+
+  const double start = now_ns();
+  for (uint32_t i = 0; i < iterations; i++) {
+    fn(i);
+  }
+  const double elapsed = now_ns() - start;
+
+  printf("%-24s %10u iterations %12.1f ns/iteration\n", name, iterations, elapsed / iterations);
+}
+
+
+
+int main(void) {
+  esp_log_level_set("*", ESP_LOG_NONE);
+  app_start_event_loops();
+
+  esp_mqtt_client_config_t config = { .uri = "mqtts://localhost" };
+  app_start_mqtt(&config, PREFIX);
+  app_start_stats_handler(2);
+  const app_thermostat_zone_t zones[] = {
+    { .gpio_pwm = 25, .target_temp = 21 },
+    { .gpio_pwm = 26, .target_temp = 21 },
+  };
+  app_start_thermostat(zones, APP_ZONES, 10, 50, 100, 60);
+  app_subscribe(APP_EVENT_LOOP_CONTROL, time_updated, count_no_data, NULL);
+  fake_event_loops_run();
+
+  run("post block event", post_block_event, 1000000);
+  run("post block burst x16", post_block_burst, 100000);
+  run("post coalesced x16", post_coalesced_burst, 100000);
+  run("publish state", publish_state, 1000000);
+  run("thermostat decision", thermostat_decision, 1000000);
+  run("stats report json", stats_report, 100000);
+  run("metrics report json", metrics_report, 10000);
+
+  return 0;
+}
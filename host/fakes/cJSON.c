@@ -0,0 +1,453 @@
+#include <ctype.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cJSON.h"
+
+
+// A small stand in for the cJSON shipped with ESP-IDF, enough for the
+// messages the app parses and the reports it prints.
+
+
+typedef struct {
+  char * buf;
+  size_t len;
+  size_t cap;
+} printer_t;
+
+
+
+static cJSON * create(int type) {
+  cJSON * item = calloc(1, sizeof(cJSON));
+  item->type = type;
+  return item;
+}
+
+
+
+void cJSON_Delete(cJSON * item) {
+  while (item != NULL) {
+    cJSON * next = item->next;
+    cJSON_Delete(item->child);
+    free(item->valuestring);
+    free(item->string);
+    free(item);
+    item = next;
+  }
+}
+
+
+
+cJSON * cJSON_CreateNull(void) {
+  return create(cJSON_NULL);
+}
+
+
+
+cJSON * cJSON_CreateBool(cJSON_bool boolean) {
+  return create(boolean ? cJSON_True : cJSON_False);
+}
+
+
+
+cJSON * cJSON_CreateNumber(double num) {
+  cJSON * item = create(cJSON_Number);
+  item->valuedouble = num;
+  item->valueint = (int) num;
+  return item;
+}
+
+
+
+cJSON * cJSON_CreateString(const char * string) {
+  cJSON * item = create(cJSON_String);
+  item->valuestring = strdup(string);
+  return item;
+}
+
+
+
+cJSON * cJSON_CreateArray(void) {
+  return create(cJSON_Array);
+}
+
+
+
+cJSON * cJSON_CreateObject(void) {
+  return create(cJSON_Object);
+}
+
+
+
+cJSON_bool cJSON_AddItemToArray(cJSON * array, cJSON * item) {
+  if (array == NULL || item == NULL) {
+    return 0;
+  }
+
+  if (array->child == NULL) {
+    array->child = item;
+    item->prev = item;
+    return 1;
+  }
+
+  // like cJSON, the first child's prev points to the last one
+  cJSON * last = array->child->prev;
+  last->next = item;
+  item->prev = last;
+  array->child->prev = item;
+  return 1;
+}
+
+
+
+cJSON_bool cJSON_AddItemToObject(cJSON * object, const char * string, cJSON * item) {
+  if (item == NULL) {
+    return 0;
+  }
+  free(item->string);
+  item->string = strdup(string);
+  return cJSON_AddItemToArray(object, item);
+}
+
+
+
+static cJSON * add(cJSON * object, const char * name, cJSON * item) {
+  if (!cJSON_AddItemToObject(object, name, item)) {
+    cJSON_Delete(item);
+    return NULL;
+  }
+  return item;
+}
+
+
+
+cJSON * cJSON_AddNullToObject(cJSON * object, const char * name) {
+  return add(object, name, cJSON_CreateNull());
+}
+
+
+
+cJSON * cJSON_AddBoolToObject(cJSON * object, const char * name, cJSON_bool boolean) {
+  return add(object, name, cJSON_CreateBool(boolean));
+}
+
+
+
+cJSON * cJSON_AddNumberToObject(cJSON * object, const char * name, double number) {
+  return add(object, name, cJSON_CreateNumber(number));
+}
+
+
+
+cJSON * cJSON_AddStringToObject(cJSON * object, const char * name, const char * string) {
+  return add(object, name, cJSON_CreateString(string));
+}
+
+
+
+cJSON * cJSON_AddArrayToObject(cJSON * object, const char * name) {
+  return add(object, name, cJSON_CreateArray());
+}
+
+
+
+cJSON * cJSON_AddObjectToObject(cJSON * object, const char * name) {
+  return add(object, name, cJSON_CreateObject());
+}
+
+
+
+int cJSON_GetArraySize(const cJSON * array) {
+  int size = 0;
+  for (cJSON * c = array ? array->child : NULL; c != NULL; c = c->next) {
+    size += 1;
+  }
+  return size;
+}
+
+
+
+cJSON * cJSON_GetArrayItem(const cJSON * array, int index) {
+  cJSON * c = array ? array->child : NULL;
+  while (c != NULL && index > 0) {
+    c = c->next;
+    index -= 1;
+  }
+  return c;
+}
+
+
+
+cJSON * cJSON_GetObjectItem(const cJSON * object, const char * string) {
+  for (cJSON * c = object ? object->child : NULL; c != NULL; c = c->next) {
+    if (c->string != NULL && strcasecmp(c->string, string) == 0) {
+      return c;
+    }
+  }
+  return NULL;
+}
+
+
+
+// parsing
+
+static const char * skip(const char * in) {
+  while (in != NULL && *in != 0 && isspace((unsigned char) *in)) {
+    in += 1;
+  }
+  return in;
+}
+
+
+
+static const char * parse_value(cJSON * item, const char * in);
+
+
+
+static const char * parse_string(char ** out, const char * in) {
+  if (*in != '"') {
+    return NULL;
+  }
+  in += 1;
+
+  const size_t max_len = strlen(in);
+  char * str = malloc(max_len + 1);
+  size_t len = 0;
+
+  while (*in != '"') {
+    if (*in == 0) {
+      free(str);
+      return NULL;
+    }
+    if (*in == '\\') {
+      in += 1;
+      switch (*in) {
+        case 'n': str[len++] = '\n'; break;
+        case 't': str[len++] = '\t'; break;
+        case 'r': str[len++] = '\r'; break;
+        case 'b': str[len++] = '\b'; break;
+        case 'f': str[len++] = '\f'; break;
+        case 0: free(str); return NULL;
+        // \u escapes are kept as is, the app never receives them
+        case 'u': str[len++] = '\\'; str[len++] = 'u'; break;
+        default: str[len++] = *in; break;
+      }
+      in += 1;
+      continue;
+    }
+    str[len++] = *in++;
+  }
+  str[len] = 0;
+  *out = str;
+  return in + 1;
+}
+
+
+
+static const char * parse_children(cJSON * item, const char * in, char close, bool named) {
+  in = skip(in + 1);
+  if (*in == close) {
+    return in + 1;
+  }
+
+  while (true) {
+    cJSON * child = create(cJSON_Invalid);
+    cJSON_AddItemToArray(item, child);
+
+    if (named) {
+      in = parse_string(&(child->string), skip(in));
+      in = skip(in);
+      if (in == NULL || *in != ':') {
+        return NULL;
+      }
+      in += 1;
+    }
+
+    in = skip(parse_value(child, skip(in)));
+    if (in == NULL) {
+      return NULL;
+    }
+    if (*in == close) {
+      return in + 1;
+    }
+    if (*in != ',') {
+      return NULL;
+    }
+    in += 1;
+  }
+}
+
+
+
+static const char * parse_value(cJSON * item, const char * in) {
+  if (in == NULL) {
+    return NULL;
+  }
+
+  if (strncmp(in, "null", 4) == 0) {
+    item->type = cJSON_NULL;
+    return in + 4;
+  }
+  if (strncmp(in, "false", 5) == 0) {
+    item->type = cJSON_False;
+    return in + 5;
+  }
+  if (strncmp(in, "true", 4) == 0) {
+    item->type = cJSON_True;
+    item->valueint = 1;
+    return in + 4;
+  }
+  if (*in == '"') {
+    item->type = cJSON_String;
+    return parse_string(&(item->valuestring), in);
+  }
+  if (*in == '-' || isdigit((unsigned char) *in)) {
+    char * end;
+    item->type = cJSON_Number;
+    item->valuedouble = strtod(in, &end);
+    item->valueint = (int) item->valuedouble;
+    return end;
+  }
+  if (*in == '[') {
+    item->type = cJSON_Array;
+    return parse_children(item, in, ']', false);
+  }
+  if (*in == '{') {
+    item->type = cJSON_Object;
+    return parse_children(item, in, '}', true);
+  }
+  return NULL;
+}
+
+
+
+cJSON * cJSON_Parse(const char * value) {
+  if (value == NULL) {
+    return NULL;
+  }
+
+  cJSON * item = create(cJSON_Invalid);
+  if (parse_value(item, skip(value)) == NULL) {
+    cJSON_Delete(item);
+    return NULL;
+  }
+  return item;
+}
+
+
+
+// printing
+
+static void append(printer_t * p, const char * format, ...) {
+  va_list args;
+
+  va_start(args, format);
+  const int needed = vsnprintf(NULL, 0, format, args);
+  va_end(args);
+
+  if (p->len + needed + 1 > p->cap) {
+    p->cap = (p->len + needed + 1) * 2;
+    p->buf = realloc(p->buf, p->cap);
+  }
+
+  va_start(args, format);
+  vsnprintf(p->buf + p->len, p->cap - p->len, format, args);
+  va_end(args);
+  p->len += needed;
+}
+
+
+
+static void print_string(printer_t * p, const char * str) {
+  append(p, "\"");
+  for (; *str != 0; str++) {
+    switch (*str) {
+      case '"': append(p, "\\\""); break;
+      case '\\': append(p, "\\\\"); break;
+      case '\n': append(p, "\\n"); break;
+      case '\t': append(p, "\\t"); break;
+      default: append(p, "%c", *str); break;
+    }
+  }
+  append(p, "\"");
+}
+
+
+
+static void print_value(printer_t * p, const cJSON * item, int depth, bool fmt) {
+  switch (item->type & 0xff) {
+    case cJSON_NULL: append(p, "null"); break;
+    case cJSON_False: append(p, "false"); break;
+    case cJSON_True: append(p, "true"); break;
+    case cJSON_String: print_string(p, item->valuestring); break;
+
+    case cJSON_Number: {
+      const double d = item->valuedouble;
+      if (isnan(d) || isinf(d)) {
+        append(p, "null");
+      } else if (d == (double) (long long) d && fabs(d) < 1e15) {
+        append(p, "%lld", (long long) d);
+      } else {
+        append(p, "%.17g", d);
+      }
+      break;
+    }
+
+    case cJSON_Array:
+    case cJSON_Object: {
+      const bool object = (item->type & 0xff) == cJSON_Object;
+      append(p, object ? "{" : "[");
+      for (const cJSON * c = item->child; c != NULL; c = c->next) {
+        if (fmt && object) {
+          append(p, "\n%*s", (depth + 1), "");
+          memset(p->buf + p->len - (depth + 1), '\t', depth + 1);
+        }
+        if (object) {
+          print_string(p, c->string);
+          append(p, fmt ? ":\t" : ":");
+        }
+        print_value(p, c, depth + 1, fmt);
+        if (c->next != NULL) {
+          append(p, fmt && !object ? ", " : ",");
+        }
+      }
+      if (fmt && object && item->child != NULL) {
+        append(p, "\n%*s", depth, "");
+        memset(p->buf + p->len - depth, '\t', depth);
+      }
+      append(p, object ? "}" : "]");
+      break;
+    }
+
+    default:
+      break;
+  }
+}
+
+
+
+static char * print(const cJSON * item, bool fmt) {
+  if (item == NULL) {
+    return NULL;
+  }
+
+  printer_t p = {0};
+  print_value(&p, item, 0, fmt);
+  return p.buf;
+}
+
+
+
+char * cJSON_Print(const cJSON * item) {
+  return print(item, true);
+}
+
+
+
+char * cJSON_PrintUnformatted(const cJSON * item) {
+  return print(item, false);
+}
@@ -0,0 +1,234 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_event.h"
+#include "host_fakes.h"
+
+
+#define MAX_LOOPS 8
+#define MAX_HANDLERS 16
+
+
+typedef struct {
+  uint64_t seq;
+  esp_event_base_t base;
+  int32_t id;
+  void * data;
+} queued_event_t;
+
+
+typedef struct {
+  esp_event_base_t base;
+  int32_t id;
+  esp_event_handler_t handler;
+  void * arg;
+} registration_t;
+
+
+struct fake_event_loop {
+  queued_event_t * queue;
+  int32_t queue_size;
+  int32_t head;
+  int32_t count;
+  registration_t handlers[MAX_HANDLERS];
+  size_t handler_count;
+};
+
+
+static struct fake_event_loop * loops[MAX_LOOPS] = {0};
+static size_t loop_count = 0;
+
+static struct fake_event_loop default_loop = {0};
+
+// global post order, events are dispatched oldest first over all loops
+static uint64_t next_seq = 0;
+
+
+
+esp_err_t esp_event_loop_create(const esp_event_loop_args_t * args, esp_event_loop_handle_t * out) {
+  if (loop_count >= MAX_LOOPS || args->queue_size <= 0) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  struct fake_event_loop * loop = calloc(1, sizeof(struct fake_event_loop));
+  loop->queue = calloc(args->queue_size, sizeof(queued_event_t));
+  loop->queue_size = args->queue_size;
+
+  loops[loop_count] = loop;
+  loop_count += 1;
+
+  *out = loop;
+  return ESP_OK;
+}
+
+
+
+esp_err_t esp_event_loop_delete(esp_event_loop_handle_t loop) {
+  for (size_t i = 0; i < loop_count; i++) {
+    if (loops[i] == loop) {
+      loops[i] = loops[loop_count - 1];
+      loop_count -= 1;
+      break;
+    }
+  }
+
+  while (loop->count > 0) {
+    free(loop->queue[loop->head].data);
+    loop->head = (loop->head + 1) % loop->queue_size;
+    loop->count -= 1;
+  }
+  free(loop->queue);
+  free(loop);
+  return ESP_OK;
+}
+
+
+
+esp_err_t esp_event_loop_create_default(void) {
+  return ESP_OK;
+}
+
+
+
+esp_err_t esp_event_post_to(
+  esp_event_loop_handle_t loop, esp_event_base_t base, int32_t id,
+  const void * data, size_t size, TickType_t ticks_to_wait
+) {
+  if (loop->count >= loop->queue_size) {
+    return ESP_ERR_TIMEOUT;
+  }
+
+  void * copy = NULL;
+  if (data != NULL && size > 0) {
+    copy = malloc(size);
+    memcpy(copy, data, size);
+  }
+
+  const int32_t tail = (loop->head + loop->count) % loop->queue_size;
+  loop->queue[tail] = (queued_event_t) {
+    .seq = next_seq++,
+    .base = base,
+    .id = id,
+    .data = copy
+  };
+  loop->count += 1;
+  return ESP_OK;
+}
+
+
+
+esp_err_t esp_event_isr_post_to(
+  esp_event_loop_handle_t loop, esp_event_base_t base, int32_t id,
+  const void * data, size_t size, BaseType_t * task_woken
+) {
+  if (task_woken != NULL) {
+    *task_woken = pdFALSE;
+  }
+  return esp_event_post_to(loop, base, id, data, size, 0);
+}
+
+
+
+static esp_err_t register_handler(
+  struct fake_event_loop * loop, esp_event_base_t base, int32_t id, esp_event_handler_t handler, void * arg
+) {
+  if (loop->handler_count >= MAX_HANDLERS) {
+    return ESP_ERR_NO_MEM;
+  }
+
+  loop->handlers[loop->handler_count] = (registration_t) {
+    .base = base,
+    .id = id,
+    .handler = handler,
+    .arg = arg
+  };
+  loop->handler_count += 1;
+  return ESP_OK;
+}
+
+
+
+esp_err_t esp_event_handler_register_with(
+  esp_event_loop_handle_t loop, esp_event_base_t base, int32_t id, esp_event_handler_t handler, void * arg
+) {
+  return register_handler(loop, base, id, handler, arg);
+}
+
+
+
+esp_err_t esp_event_handler_register(esp_event_base_t base, int32_t id, esp_event_handler_t handler, void * arg) {
+  return register_handler(&default_loop, base, id, handler, arg);
+}
+
+
+
+static void call_handlers(struct fake_event_loop * loop, esp_event_base_t base, int32_t id, void * data) {
+  for (size_t i = 0; i < loop->handler_count; i++) {
+    registration_t * reg = &(loop->handlers[i]);
+
+    const bool base_matches = reg->base == ESP_EVENT_ANY_BASE || reg->base == base;
+    const bool id_matches = reg->id == ESP_EVENT_ANY_ID || reg->id == id;
+    if (base_matches && id_matches) {
+      reg->handler(reg->arg, base, id, data);
+    }
+  }
+}
+
+
+
+esp_err_t esp_event_post(esp_event_base_t base, int32_t id, const void * data, size_t size, TickType_t ticks_to_wait) {
+  // the default loop has no queue, its handlers are called right away
+  call_handlers(&default_loop, base, id, (void *) data);
+  return ESP_OK;
+}
+
+
+
+void fake_event_send_default(esp_event_base_t base, int32_t id, void * data) {
+  call_handlers(&default_loop, base, id, data);
+}
+
+
+
+static struct fake_event_loop * oldest_loop(void) {
+  struct fake_event_loop * oldest = NULL;
+
+  for (size_t i = 0; i < loop_count; i++) {
+    struct fake_event_loop * loop = loops[i];
+    if (loop->count == 0) {
+      continue;
+    }
+    if (oldest == NULL || loop->queue[loop->head].seq < oldest->queue[oldest->head].seq) {
+      oldest = loop;
+    }
+  }
+  return oldest;
+}
+
+
+
+size_t fake_event_loops_run(void) {
+  size_t dispatched = 0;
+  struct fake_event_loop * loop;
+
+  while ((loop = oldest_loop()) != NULL) {
+    queued_event_t evt = loop->queue[loop->head];
+    loop->head = (loop->head + 1) % loop->queue_size;
+    loop->count -= 1;
+
+    call_handlers(loop, evt.base, evt.id, evt.data);
+    free(evt.data);
+    dispatched += 1;
+  }
+  return dispatched;
+}
+
+
+
+size_t fake_event_loops_pending(void) {
+  size_t pending = 0;
+  for (size_t i = 0; i < loop_count; i++) {
+    pending += loops[i]->count;
+  }
+  return pending;
+}
@@ -0,0 +1,142 @@
+#include "esp_timer.h"
+#include "driver/gpio.h"
+#include "driver/ledc.h"
+#include "host_fakes.h"
+
+
+typedef struct {
+  bool used;
+  uint32_t level;
+  uint32_t edges;
+  int64_t high_us;
+  int64_t changed_at;
+} pin_t;
+
+
+static pin_t pins[GPIO_NUM_MAX] = {0};
+
+static uint32_t ledc_duty[LEDC_SPEED_MODE_MAX][LEDC_CHANNEL_MAX] = {0};
+static double ledc_period_us[LEDC_SPEED_MODE_MAX][LEDC_TIMER_MAX] = {0};
+
+
+
+esp_err_t gpio_set_direction(gpio_num_t gpio_num, gpio_mode_t mode) {
+  return (gpio_num >= 0 && gpio_num < GPIO_NUM_MAX) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level) {
+  if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  pin_t * pin = &(pins[gpio_num]);
+  const int64_t now = esp_timer_get_time();
+  level = level ? 1 : 0;
+
+  if (!pin->used) {
+    pin->used = true;
+    pin->level = level;
+    pin->changed_at = now;
+    return ESP_OK;
+  }
+
+  if (pin->level == level) {
+    return ESP_OK;
+  }
+
+  if (pin->level == 1) {
+    pin->high_us += now - pin->changed_at;
+  }
+  pin->level = level;
+  pin->changed_at = now;
+  pin->edges += 1;
+  return ESP_OK;
+}
+
+
+
+int gpio_get_level(gpio_num_t gpio_num) {
+  return (gpio_num >= 0 && gpio_num < GPIO_NUM_MAX) ? pins[gpio_num].level : 0;
+}
+
+
+
+int64_t fake_gpio_high_us(gpio_num_t gpio_num) {
+  pin_t * pin = &(pins[gpio_num]);
+  const int64_t current = (pin->used && pin->level == 1) ? esp_timer_get_time() - pin->changed_at : 0;
+  return pin->high_us + current;
+}
+
+
+
+uint32_t fake_gpio_edges(gpio_num_t gpio_num) {
+  return pins[gpio_num].edges;
+}
+
+
+
+esp_err_t ledc_timer_config(const ledc_timer_config_t * timer_conf) {
+  return ESP_OK;
+}
+
+
+
+esp_err_t ledc_timer_set(
+  ledc_mode_t speed_mode, ledc_timer_t timer_sel, uint32_t clock_divider, uint32_t duty_resolution,
+  ledc_clk_src_t clk_src
+) {
+  // the divider has 8 fractional bits and must be at least 1
+  if (clock_divider < 256 || clock_divider >= (1 << 18) || duty_resolution > LEDC_TIMER_20_BIT) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  const double clock_hz = (clk_src == LEDC_REF_TICK) ? 1e6 : 80e6;
+  ledc_period_us[speed_mode][timer_sel] = 1e6 * clock_divider / 256 * (1 << duty_resolution) / clock_hz;
+  return ESP_OK;
+}
+
+
+
+esp_err_t ledc_timer_rst(ledc_mode_t speed_mode, ledc_timer_t timer_sel) {
+  return ESP_OK;
+}
+
+
+
+double fake_ledc_period_us(ledc_mode_t speed_mode, ledc_timer_t timer_sel) {
+  return ledc_period_us[speed_mode][timer_sel];
+}
+
+
+
+esp_err_t ledc_channel_config(const ledc_channel_config_t * channel_conf) {
+  ledc_duty[channel_conf->speed_mode][channel_conf->channel] = channel_conf->duty;
+  return ESP_OK;
+}
+
+
+
+esp_err_t ledc_set_duty(ledc_mode_t speed_mode, ledc_channel_t channel, uint32_t duty) {
+  ledc_duty[speed_mode][channel] = duty;
+  return ESP_OK;
+}
+
+
+
+esp_err_t ledc_update_duty(ledc_mode_t speed_mode, ledc_channel_t channel) {
+  return ESP_OK;
+}
+
+
+
+uint32_t ledc_get_duty(ledc_mode_t speed_mode, ledc_channel_t channel) {
+  return ledc_duty[speed_mode][channel];
+}
+
+
+
+esp_err_t ledc_stop(ledc_mode_t speed_mode, ledc_channel_t channel, uint32_t idle_level) {
+  ledc_duty[speed_mode][channel] = 0;
+  return ESP_OK;
+}
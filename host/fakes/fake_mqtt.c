@@ -0,0 +1,187 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "mqtt_client.h"
+#include "esp_wifi.h"
+#include "host_fakes.h"
+
+
+#define MAX_TOPICS 32
+#define MAX_HANDLERS 8
+
+
+ESP_EVENT_DEFINE_BASE(IP_EVENT);
+
+static const char * MQTT_EVENTS = "MQTT_EVENTS";
+
+
+typedef struct {
+  char * topic;
+  char * data;
+} message_t;
+
+
+typedef struct {
+  esp_mqtt_event_id_t event;
+  esp_event_handler_t handler;
+  void * arg;
+} registration_t;
+
+
+struct esp_mqtt_client {
+  bool started;
+  registration_t handlers[MAX_HANDLERS];
+  size_t handler_count;
+  char * subscriptions[MAX_TOPICS];
+  size_t subscription_count;
+  // last payload per topic
+  message_t published[MAX_TOPICS];
+  size_t published_count;
+  uint32_t publish_count;
+};
+
+
+// the app only ever creates a single client
+static struct esp_mqtt_client * client = NULL;
+
+
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t * config) {
+  client = calloc(1, sizeof(struct esp_mqtt_client));
+  return client;
+}
+
+
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t c) {
+  c->started = true;
+  return ESP_OK;
+}
+
+
+
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t c, const char * topic, int qos) {
+  if (c->subscription_count >= MAX_TOPICS) {
+    return -1;
+  }
+  c->subscriptions[c->subscription_count] = strdup(topic);
+  c->subscription_count += 1;
+  return c->subscription_count;
+}
+
+
+
+int esp_mqtt_client_publish(
+  esp_mqtt_client_handle_t c, const char * topic, const char * data, int len, int qos, int retain
+) {
+  if (len == 0) {
+    len = strlen(data);
+  }
+
+  message_t * msg = NULL;
+  for (size_t i = 0; i < c->published_count; i++) {
+    if (strcmp(c->published[i].topic, topic) == 0) {
+      msg = &(c->published[i]);
+    }
+  }
+  if (msg == NULL) {
+    if (c->published_count >= MAX_TOPICS) {
+      return -1;
+    }
+    msg = &(c->published[c->published_count]);
+    msg->topic = strdup(topic);
+    c->published_count += 1;
+  }
+
+  free(msg->data);
+  msg->data = strndup(data, len);
+  c->publish_count += 1;
+  return c->publish_count;
+}
+
+
+
+esp_err_t esp_mqtt_client_register_event(
+  esp_mqtt_client_handle_t c, esp_mqtt_event_id_t event, esp_event_handler_t event_handler, void * event_handler_arg
+) {
+  if (c->handler_count >= MAX_HANDLERS) {
+    return ESP_ERR_NO_MEM;
+  }
+  c->handlers[c->handler_count] = (registration_t) {
+    .event = event,
+    .handler = event_handler,
+    .arg = event_handler_arg
+  };
+  c->handler_count += 1;
+  return ESP_OK;
+}
+
+
+
+static void send_event(esp_mqtt_event_t * event) {
+  for (size_t i = 0; i < client->handler_count; i++) {
+    registration_t * reg = &(client->handlers[i]);
+    if (reg->event == MQTT_EVENT_ANY || reg->event == event->event_id) {
+      reg->handler(reg->arg, MQTT_EVENTS, event->event_id, event);
+    }
+  }
+}
+
+
+
+void fake_mqtt_connect(void) {
+  esp_mqtt_event_t event = {
+    .event_id = MQTT_EVENT_CONNECTED,
+    .client = client
+  };
+  send_event(&event);
+}
+
+
+
+void fake_mqtt_deliver(const char * topic, const char * data) {
+  char * topic_copy = strdup(topic);
+  char * data_copy = strdup(data);
+
+  esp_mqtt_event_t event = {
+    .event_id = MQTT_EVENT_DATA,
+    .client = client,
+    .topic = topic_copy,
+    .topic_len = strlen(topic),
+    .data = data_copy,
+    .data_len = strlen(data),
+    .total_data_len = strlen(data),
+  };
+  send_event(&event);
+
+  free(topic_copy);
+  free(data_copy);
+}
+
+
+
+const char * fake_mqtt_published(const char * topic) {
+  for (size_t i = 0; i < client->published_count; i++) {
+    if (strcmp(client->published[i].topic, topic) == 0) {
+      return client->published[i].data;
+    }
+  }
+  return NULL;
+}
+
+
+
+uint32_t fake_mqtt_publish_count(void) {
+  return client->publish_count;
+}
+
+
+
+bool fake_mqtt_subscribed(const char * topic) {
+  for (size_t i = 0; i < client->subscription_count; i++) {
+    if (strcmp(client->subscriptions[i], topic) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
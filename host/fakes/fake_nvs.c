@@ -0,0 +1,176 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nvs_flash.h"
+
+
+#define MAX_ENTRIES 64
+#define MAX_NAME 16
+
+
+typedef struct {
+  char ns[MAX_NAME];
+  char key[MAX_NAME];
+  void * value;
+  size_t length;
+} entry_t;
+
+
+static entry_t entries[MAX_ENTRIES] = {0};
+
+static char namespaces[MAX_ENTRIES][MAX_NAME] = {0};
+
+
+
+esp_err_t nvs_open(const char * name, nvs_open_mode_t open_mode, nvs_handle_t * handle) {
+  for (size_t i = 0; i < MAX_ENTRIES; i++) {
+    if (namespaces[i][0] == 0) {
+      strncpy(namespaces[i], name, MAX_NAME - 1);
+    }
+    if (strncmp(namespaces[i], name, MAX_NAME - 1) == 0) {
+      // handles are namespace index + 1, zero stays invalid
+      *handle = i + 1;
+      return ESP_OK;
+    }
+  }
+  return ESP_ERR_NO_MEM;
+}
+
+
+
+void nvs_close(nvs_handle_t handle) {
+}
+
+
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+  return ESP_OK;
+}
+
+
+
+static entry_t * find(nvs_handle_t handle, const char * key, bool create) {
+  const char * ns = namespaces[handle - 1];
+  entry_t * free_entry = NULL;
+
+  for (size_t i = 0; i < MAX_ENTRIES; i++) {
+    entry_t * e = &(entries[i]);
+    if (e->value == NULL) {
+      free_entry = free_entry ? free_entry : e;
+      continue;
+    }
+    if (strcmp(e->ns, ns) == 0 && strncmp(e->key, key, MAX_NAME - 1) == 0) {
+      return e;
+    }
+  }
+
+  if (!create || free_entry == NULL) {
+    return NULL;
+  }
+  strncpy(free_entry->ns, ns, MAX_NAME - 1);
+  strncpy(free_entry->key, key, MAX_NAME - 1);
+  return free_entry;
+}
+
+
+
+static esp_err_t set(nvs_handle_t handle, const char * key, const void * value, size_t length) {
+  entry_t * e = find(handle, key, true);
+  if (e == NULL) {
+    return ESP_ERR_NO_MEM;
+  }
+
+  free(e->value);
+  e->value = malloc(length > 0 ? length : 1);
+  memcpy(e->value, value, length);
+  e->length = length;
+  return ESP_OK;
+}
+
+
+
+static esp_err_t get(nvs_handle_t handle, const char * key, void * value, size_t length) {
+  entry_t * e = find(handle, key, false);
+  if (e == NULL) {
+    return ESP_ERR_NVS_NOT_FOUND;
+  }
+  if (e->length != length) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  memcpy(value, e->value, length);
+  return ESP_OK;
+}
+
+
+
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char * key, uint8_t value) {
+  return set(handle, key, &value, sizeof(value));
+}
+
+
+
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char * key, uint8_t * value) {
+  return get(handle, key, value, sizeof(*value));
+}
+
+
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char * key, uint32_t value) {
+  return set(handle, key, &value, sizeof(value));
+}
+
+
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char * key, uint32_t * value) {
+  return get(handle, key, value, sizeof(*value));
+}
+
+
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char * key, const void * value, size_t length) {
+  return set(handle, key, value, length);
+}
+
+
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char * key, void * value, size_t * length) {
+  entry_t * e = find(handle, key, false);
+  if (e == NULL) {
+    return ESP_ERR_NVS_NOT_FOUND;
+  }
+
+  // like on target a NULL value only asks for the length
+  if (value == NULL) {
+    *length = e->length;
+    return ESP_OK;
+  }
+  if (*length < e->length) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  memcpy(value, e->value, e->length);
+  *length = e->length;
+  return ESP_OK;
+}
+
+
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char * key) {
+  entry_t * e = find(handle, key, false);
+  if (e == NULL) {
+    return ESP_ERR_NVS_NOT_FOUND;
+  }
+  free(e->value);
+  *e = (entry_t) {0};
+  return ESP_OK;
+}
+
+
+
+esp_err_t nvs_flash_erase(void) {
+  for (size_t i = 0; i < MAX_ENTRIES; i++) {
+    free(entries[i].value);
+    entries[i] = (entry_t) {0};
+  }
+  return ESP_OK;
+}
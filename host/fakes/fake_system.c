@@ -0,0 +1,95 @@
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_ota_ops.h"
+#include "nvs_flash.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+
+static esp_log_level_t log_level = ESP_LOG_INFO;
+
+static const esp_app_desc_t app_desc = {
+  .version = "host",
+  .project_name = "thermostat",
+};
+
+
+
+const char * esp_err_to_name(esp_err_t code) {
+  switch (code) {
+    case ESP_OK: return "ESP_OK";
+    case ESP_FAIL: return "ESP_FAIL";
+    case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_NVS_NOT_FOUND: return "ESP_ERR_NVS_NOT_FOUND";
+    default: return "UNKNOWN ERROR";
+  }
+}
+
+
+
+void esp_log_level_set(const char * tag, esp_log_level_t level) {
+  log_level = level;
+}
+
+
+
+void esp_log_write(esp_log_level_t level, const char * tag, const char * format, ...) {
+  if (level > log_level) {
+    return;
+  }
+
+  va_list args;
+  va_start(args, format);
+  vprintf(format, args);
+  va_end(args);
+}
+
+
+
+BaseType_t xPortInIsrContext(void) {
+  return pdFALSE;
+}
+
+
+
+BaseType_t xTaskCreate(
+  TaskFunction_t fn, const char * name, uint32_t stack_size, void * arg, UBaseType_t priority, TaskHandle_t * handle
+) {
+  if (handle != NULL) {
+    *handle = (TaskHandle_t) fn;
+  }
+  return pdPASS;
+}
+
+
+
+void vTaskDelay(TickType_t ticks) {
+}
+
+
+
+TickType_t xTaskGetTickCount(void) {
+  return (TickType_t) (esp_timer_get_time() / 1000 / portTICK_PERIOD_MS);
+}
+
+
+
+const esp_app_desc_t * esp_ota_get_app_description(void) {
+  return &app_desc;
+}
+
+
+
+esp_err_t nvs_flash_init(void) {
+  return ESP_OK;
+}
@@ -0,0 +1,161 @@
+#include <stdlib.h>
+
+#include "esp_timer.h"
+#include "host_fakes.h"
+
+
+#define MAX_TIMERS 64
+
+
+struct esp_timer {
+  esp_timer_create_args_t args;
+  int64_t due;
+  uint64_t period;
+  bool active;
+  // creation order, breaks ties between timers due at the same time
+  uint32_t order;
+};
+
+
+static struct esp_timer * timers[MAX_TIMERS] = {0};
+static uint32_t next_order = 0;
+static uint32_t callbacks = 0;
+static int64_t latency = 0;
+
+static int64_t now = 0;
+
+
+
+int64_t esp_timer_get_time(void) {
+  return now;
+}
+
+
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t * args, esp_timer_handle_t * out) {
+  for (size_t i = 0; i < MAX_TIMERS; i++) {
+    if (timers[i] == NULL) {
+      struct esp_timer * timer = calloc(1, sizeof(struct esp_timer));
+      timer->args = *args;
+      timer->order = next_order++;
+      timers[i] = timer;
+      *out = timer;
+      return ESP_OK;
+    }
+  }
+  return ESP_ERR_NO_MEM;
+}
+
+
+
+static esp_err_t start(esp_timer_handle_t timer, uint64_t timeout_us, uint64_t period_us) {
+  if (timer->active) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  timer->due = now + timeout_us;
+  timer->period = period_us;
+  timer->active = true;
+  return ESP_OK;
+}
+
+
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us) {
+  return start(timer, period_us, period_us);
+}
+
+
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+  return start(timer, timeout_us, 0);
+}
+
+
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+  if (!timer->active) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  timer->active = false;
+  return ESP_OK;
+}
+
+
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+  if (timer->active) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  for (size_t i = 0; i < MAX_TIMERS; i++) {
+    if (timers[i] == timer) {
+      timers[i] = NULL;
+    }
+  }
+  free(timer);
+  return ESP_OK;
+}
+
+
+
+bool esp_timer_is_active(esp_timer_handle_t timer) {
+  return timer->active;
+}
+
+
+
+static struct esp_timer * next_due(int64_t until) {
+  struct esp_timer * next = NULL;
+
+  for (size_t i = 0; i < MAX_TIMERS; i++) {
+    struct esp_timer * timer = timers[i];
+    if (timer == NULL || !timer->active || timer->due > until) {
+      continue;
+    }
+    if (next == NULL || timer->due < next->due || (timer->due == next->due && timer->order < next->order)) {
+      next = timer;
+    }
+  }
+  return next;
+}
+
+
+
+void fake_advance(int64_t us) {
+  const int64_t until = now + us;
+  struct esp_timer * timer;
+
+  fake_event_loops_run();
+
+  while ((timer = next_due(until)) != NULL) {
+    // late callbacks run back to back, the clock never goes back
+    if (timer->due + latency > now) {
+      now = timer->due + latency;
+    }
+
+    if (timer->period > 0) {
+      timer->due += timer->period;
+    } else {
+      timer->active = false;
+    }
+
+    callbacks += 1;
+    timer->args.callback(timer->args.arg);
+    fake_event_loops_run();
+  }
+
+  if (until > now) {
+    now = until;
+  }
+}
+
+
+
+void fake_timer_latency(int64_t us) {
+  latency = us;
+}
+
+
+
+uint32_t fake_timer_callbacks(void) {
+  return callbacks;
+}
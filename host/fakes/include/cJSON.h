@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stddef.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// The subset of the cJSON API used by the app, same names and semantics.
+
+#define cJSON_Invalid (0)
+#define cJSON_False   (1 << 0)
+#define cJSON_True    (1 << 1)
+#define cJSON_NULL    (1 << 2)
+#define cJSON_Number  (1 << 3)
+#define cJSON_String  (1 << 4)
+#define cJSON_Array   (1 << 5)
+#define cJSON_Object  (1 << 6)
+
+typedef struct cJSON {
+  struct cJSON * next;
+  struct cJSON * prev;
+  struct cJSON * child;
+  int type;
+  char * valuestring;
+  int valueint;
+  double valuedouble;
+  char * string;
+} cJSON;
+
+typedef int cJSON_bool;
+
+
+cJSON * cJSON_Parse(const char * value);
+char * cJSON_Print(const cJSON * item);
+char * cJSON_PrintUnformatted(const cJSON * item);
+void cJSON_Delete(cJSON * item);
+
+int cJSON_GetArraySize(const cJSON * array);
+cJSON * cJSON_GetArrayItem(const cJSON * array, int index);
+cJSON * cJSON_GetObjectItem(const cJSON * object, const char * string);
+
+cJSON * cJSON_CreateNull(void);
+cJSON * cJSON_CreateBool(cJSON_bool boolean);
+cJSON * cJSON_CreateNumber(double num);
+cJSON * cJSON_CreateString(const char * string);
+cJSON * cJSON_CreateArray(void);
+cJSON * cJSON_CreateObject(void);
+
+cJSON_bool cJSON_AddItemToArray(cJSON * array, cJSON * item);
+cJSON_bool cJSON_AddItemToObject(cJSON * object, const char * string, cJSON * item);
+
+cJSON * cJSON_AddNullToObject(cJSON * object, const char * name);
+cJSON * cJSON_AddBoolToObject(cJSON * object, const char * name, cJSON_bool boolean);
+cJSON * cJSON_AddNumberToObject(cJSON * object, const char * name, double number);
+cJSON * cJSON_AddStringToObject(cJSON * object, const char * name, const char * string);
+cJSON * cJSON_AddArrayToObject(cJSON * object, const char * name);
+cJSON * cJSON_AddObjectToObject(cJSON * object, const char * name);
+
+#define cJSON_IsNumber(item) ((item) != NULL && ((item)->type & cJSON_Number))
+#define cJSON_IsString(item) ((item) != NULL && ((item)->type & cJSON_String))
+#define cJSON_IsBool(item) ((item) != NULL && ((item)->type & (cJSON_True | cJSON_False)))
+#define cJSON_IsTrue(item) ((item) != NULL && ((item)->type & cJSON_True))
+#define cJSON_IsArray(item) ((item) != NULL && ((item)->type & cJSON_Array))
+#define cJSON_IsObject(item) ((item) != NULL && ((item)->type & cJSON_Object))
+
+
+#ifdef __cplusplus
+}
+#endif
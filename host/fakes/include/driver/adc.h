@@ -0,0 +1,3 @@
+#pragma once
+
+// included by app_thermostat.c, nothing of it is used
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+typedef const char * esp_event_base_t;
+typedef struct fake_event_loop * esp_event_loop_handle_t;
+typedef void (*esp_event_handler_t)(void * arg, esp_event_base_t base, int32_t id, void * data);
+
+typedef struct {
+  int32_t queue_size;
+  const char * task_name;
+  UBaseType_t task_priority;
+  uint32_t task_stack_size;
+  BaseType_t task_core_id;
+} esp_event_loop_args_t;
+
+#define ESP_EVENT_DECLARE_BASE(id) extern esp_event_base_t const id
+#define ESP_EVENT_DEFINE_BASE(id) esp_event_base_t const id = #id
+
+#define ESP_EVENT_ANY_BASE NULL
+#define ESP_EVENT_ANY_ID -1
+
+
+// Loops never run on their own, see fake_event_loops_run in host_fakes.h.
+// A post to a full queue fails with ESP_ERR_TIMEOUT right away whatever the
+// wait, blocking would dead lock the single host thread.
+
+esp_err_t esp_event_loop_create(const esp_event_loop_args_t * args, esp_event_loop_handle_t * loop);
+esp_err_t esp_event_loop_delete(esp_event_loop_handle_t loop);
+esp_err_t esp_event_loop_create_default(void);
+
+esp_err_t esp_event_post_to(
+  esp_event_loop_handle_t loop, esp_event_base_t base, int32_t id,
+  const void * data, size_t size, TickType_t ticks_to_wait
+);
+esp_err_t esp_event_isr_post_to(
+  esp_event_loop_handle_t loop, esp_event_base_t base, int32_t id,
+  const void * data, size_t size, BaseType_t * task_woken
+);
+esp_err_t esp_event_post(esp_event_base_t base, int32_t id, const void * data, size_t size, TickType_t ticks_to_wait);
+
+esp_err_t esp_event_handler_register_with(
+  esp_event_loop_handle_t loop, esp_event_base_t base, int32_t id, esp_event_handler_t handler, void * arg
+);
+esp_err_t esp_event_handler_register(esp_event_base_t base, int32_t id, esp_event_handler_t handler, void * arg);
+
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+typedef enum {
+  ESP_LOG_NONE,
+  ESP_LOG_ERROR,
+  ESP_LOG_WARN,
+  ESP_LOG_INFO,
+  ESP_LOG_DEBUG,
+  ESP_LOG_VERBOSE
+} esp_log_level_t;
+
+
+// only the "*" tag is supported, the level applies to all tags
+void esp_log_level_set(const char * tag, esp_log_level_t level);
+
+void esp_log_write(esp_log_level_t level, const char * tag, const char * format, ...)
+  __attribute__((format(printf, 3, 4)));
+
+
+#define ESP_LOG_LEVEL_(level, letter, tag, format, ...) \
+  esp_log_write(level, tag, letter " %s: " format "\n", tag, ##__VA_ARGS__)
+
+#define ESP_LOGE(tag, format, ...) ESP_LOG_LEVEL_(ESP_LOG_ERROR, "E", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) ESP_LOG_LEVEL_(ESP_LOG_WARN, "W", tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) ESP_LOG_LEVEL_(ESP_LOG_INFO, "I", tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) ESP_LOG_LEVEL_(ESP_LOG_DEBUG, "D", tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) ESP_LOG_LEVEL_(ESP_LOG_VERBOSE, "V", tag, format, ##__VA_ARGS__)
+
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdint.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+typedef struct {
+  uint32_t magic_word;
+  uint32_t secure_version;
+  char version[32];
+  char project_name[32];
+  char time[16];
+  char date[16];
+  char idf_ver[32];
+} esp_app_desc_t;
+
+
+const esp_app_desc_t * esp_ota_get_app_description(void);
+
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "esp_err.h"
+#include "esp_event.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// only the IP events used by app_mqtt.c
+
+ESP_EVENT_DECLARE_BASE(IP_EVENT);
+
+typedef enum {
+  IP_EVENT_STA_GOT_IP,
+  IP_EVENT_STA_LOST_IP,
+} ip_event_t;
+
+
+#ifdef __cplusplus
+}
+#endif
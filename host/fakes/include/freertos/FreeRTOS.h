@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// The host build is single threaded, critical sections are no-ops and
+// nothing ever runs in an ISR.
+
+typedef uint32_t TickType_t;
+typedef unsigned int UBaseType_t;
+typedef int BaseType_t;
+
+#define portMAX_DELAY ((TickType_t) 0xffffffffUL)
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t) (ms))
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define pdFAIL 0
+
+#define tskNO_AFFINITY 0x7fffffff
+
+#define IRAM_ATTR
+
+
+typedef struct {
+  int owner;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED { 0 }
+
+#define portENTER_CRITICAL(mux) ((void) (mux))
+#define portEXIT_CRITICAL(mux) ((void) (mux))
+#define portENTER_CRITICAL_ISR(mux) ((void) (mux))
+#define portEXIT_CRITICAL_ISR(mux) ((void) (mux))
+#define portENTER_CRITICAL_SAFE(mux) ((void) (mux))
+#define portEXIT_CRITICAL_SAFE(mux) ((void) (mux))
+#define portYIELD_FROM_ISR() do {} while (0)
+
+
+BaseType_t xPortInIsrContext(void);
+
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+typedef void * TaskHandle_t;
+typedef void (*TaskFunction_t)(void * arg);
+
+
+// tasks are never run on the host, creation only hands out a handle
+BaseType_t xTaskCreate(
+  TaskFunction_t fn, const char * name, uint32_t stack_size, void * arg, UBaseType_t priority, TaskHandle_t * handle
+);
+
+void vTaskDelay(TickType_t ticks);
+
+TickType_t xTaskGetTickCount(void);
+
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_event.h"
+#include "driver/gpio.h"
+#include "driver/ledc.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// Control of the fake ESP-IDF layer of the host build.
+// Everything runs on the calling thread: event loops are only dispatched
+// and timers only fire from the functions below, in a deterministic order.
+
+
+// Dispatches queued events of all loops, oldest post first, until every
+// queue is empty, including the events posted by the handlers themselves.
+// Returns the number of dispatched events.
+size_t fake_event_loops_run(void);
+
+// Events posted and not yet dispatched, over all loops.
+size_t fake_event_loops_pending(void);
+
+// Sends an event to the handlers of the default loop right away.
+void fake_event_send_default(esp_event_base_t base, int32_t id, void * data);
+
+
+// Advances the virtual clock by `us`. Due timers fire in the order of
+// their due time, creation order on ties, and the event loops are run
+// after every timer callback.
+void fake_advance(int64_t us);
+
+// Timer callbacks run since start, of all timers.
+uint32_t fake_timer_callbacks(void);
+
+// Runs timer callbacks `us` after they are due, 0 by default, like a busy
+// timer task or a flash write with the cache disabled. fake_advance can
+// then end up to `us` later than asked.
+void fake_timer_latency(int64_t us);
+
+
+// Time the GPIO spent at level 1 since it was first set.
+int64_t fake_gpio_high_us(gpio_num_t gpio_num);
+
+// Level changes of the GPIO since it was first set.
+uint32_t fake_gpio_edges(gpio_num_t gpio_num);
+
+// Cycle of the LEDC timer from its last ledc_timer_set, 0 before.
+double fake_ledc_period_us(ledc_mode_t speed_mode, ledc_timer_t timer_sel);
+
+
+// Sends MQTT_EVENT_CONNECTED to the client's handlers.
+void fake_mqtt_connect(void);
+
+// Sends a MQTT_EVENT_DATA message to the client's handlers.
+void fake_mqtt_deliver(const char * topic, const char * data);
+
+// Payload of the last publish to the topic or NULL,
+// valid until the next publish to it.
+const char * fake_mqtt_published(const char * topic);
+
+// Publishes since start, to any topic.
+uint32_t fake_mqtt_publish_count(void);
+
+// Whether the client subscribed to the topic.
+bool fake_mqtt_subscribed(const char * topic);
+
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_event.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// A client that never connects, see fake_mqtt_* in host_fakes.h.
+
+typedef struct esp_mqtt_client * esp_mqtt_client_handle_t;
+
+typedef enum {
+  MQTT_EVENT_ANY = -1,
+  MQTT_EVENT_ERROR = 0,
+  MQTT_EVENT_CONNECTED,
+  MQTT_EVENT_DISCONNECTED,
+  MQTT_EVENT_SUBSCRIBED,
+  MQTT_EVENT_UNSUBSCRIBED,
+  MQTT_EVENT_PUBLISHED,
+  MQTT_EVENT_DATA,
+  MQTT_EVENT_BEFORE_CONNECT,
+  MQTT_EVENT_MAX
+} esp_mqtt_event_id_t;
+
+typedef struct {
+  esp_mqtt_event_id_t event_id;
+  esp_mqtt_client_handle_t client;
+  void * user_context;
+  char * data;
+  int data_len;
+  int total_data_len;
+  int current_data_offset;
+  char * topic;
+  int topic_len;
+  int msg_id;
+} esp_mqtt_event_t;
+
+typedef esp_mqtt_event_t * esp_mqtt_event_handle_t;
+
+typedef struct {
+  const char * uri;
+  const char * client_id;
+  const char * cert_pem;
+  const char * client_cert_pem;
+  const char * client_key_pem;
+  int keepalive;
+} esp_mqtt_client_config_t;
+
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t * config);
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client);
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char * topic, int qos);
+int esp_mqtt_client_publish(
+  esp_mqtt_client_handle_t client, const char * topic, const char * data, int len, int qos, int retain
+);
+esp_err_t esp_mqtt_client_register_event(
+  esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event, esp_event_handler_t event_handler, void * event_handler_arg
+);
+
+
+#ifdef __cplusplus
+}
+#endif
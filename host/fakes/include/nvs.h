@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// An in memory store, values only live as long as the process.
+
+typedef uint32_t nvs_handle_t;
+
+typedef enum {
+  NVS_READONLY,
+  NVS_READWRITE
+} nvs_open_mode_t;
+
+
+esp_err_t nvs_open(const char * name, nvs_open_mode_t open_mode, nvs_handle_t * handle);
+void nvs_close(nvs_handle_t handle);
+esp_err_t nvs_commit(nvs_handle_t handle);
+
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char * key, uint8_t value);
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char * key, uint8_t * value);
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char * key, uint32_t value);
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char * key, uint32_t * value);
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char * key, const void * value, size_t length);
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char * key, void * value, size_t * length);
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char * key);
+
+
+#ifdef __cplusplus
+}
+#endif
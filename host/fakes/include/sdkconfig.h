@@ -0,0 +1,50 @@
+#pragma once
+
+// Kconfig defaults of main/Kconfig.projbuild and the components for the host build
+
+#define CONFIG_APP_EVENT_CONTROL_QUEUE_SIZE 32
+#define CONFIG_APP_EVENT_CONTROL_TASK_PRIORITY 15
+#define CONFIG_APP_EVENT_CONTROL_TASK_STACK_SIZE 4096
+#define CONFIG_APP_EVENT_TELEMETRY_QUEUE_SIZE 16
+#define CONFIG_APP_EVENT_TELEMETRY_TASK_PRIORITY 3
+#define CONFIG_APP_EVENT_TELEMETRY_TASK_STACK_SIZE 6144
+#define CONFIG_APP_EVENT_MAILBOX_DEPTH 4
+
+#define CONFIG_APP_RECORDER_BUFFER_SIZE 128
+#define CONFIG_APP_RECORDER_FLUSH_INTERVAL_SEC 30
+
+#define CONFIG_APP_TRACE_REPORT_INTERVAL_SEC 300
+
+#define CONFIG_APP_THERMOMETER_MIN_INTERVAL_MS 5000
+#define CONFIG_APP_THERMOMETER_TEMP_DEADBAND 5
+#define CONFIG_APP_THERMOMETER_HUMID_DEADBAND 50
+
+#define CONFIG_APP_CONTROLLER_LEVELS 1
+#define CONFIG_APP_PID_INTERVAL_SEC 30
+#define CONFIG_APP_PID_KP 4000
+#define CONFIG_APP_PID_KI 2000
+#define CONFIG_APP_PID_KD 0
+#define CONFIG_APP_MODEL_HORIZON_MIN 30
+#define CONFIG_APP_MODEL_PERSIST_INTERVAL_MIN 60
+#define CONFIG_APP_AUTOTUNE_HYSTERESIS_CDEG 20
+#define CONFIG_APP_AUTOTUNE_MAX_HOURS 24
+#define CONFIG_APP_WINDOW_DETECTION 1
+#define CONFIG_APP_WINDOW_DROP_RATE 20
+#define CONFIG_APP_WINDOW_DETECT_SEC 180
+#define CONFIG_APP_WINDOW_SUSPEND_MIN 15
+#define CONFIG_APP_HEAT_CURVE 1
+#define CONFIG_APP_HEAT_CURVE_DESIGN_TEMP -12
+#define CONFIG_APP_HEAT_CURVE_DESIGN_DUTY 80
+#define CONFIG_APP_HEAT_CURVE_LIMIT_TEMP 16
+#define CONFIG_APP_HEAT_CURVE_EXPONENT 100
+#define CONFIG_APP_HEAT_CURVE_OUTDOOR_TIMEOUT_MIN 30
+
+#define CONFIG_APP_ZONE_COUNT 2
+
+#define CONFIG_SLOW_PWM_EDGE_SCHEDULED 1
+#define CONFIG_SLOW_PWM_LEDC_TIMER 2
+#define CONFIG_SLOW_PWM_LEDC_FIRST_CHANNEL 3
+
+#define CONFIG_APP_TIMEZONE "CET-1CEST,M3.5.0,M10.5.0/3"
+#define CONFIG_APP_SCHEDULE_HEATUP_RATE 10
+#define CONFIG_APP_SCHEDULE_MAX_PREHEAT_MIN 180
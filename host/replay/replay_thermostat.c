@@ -0,0 +1,430 @@
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "host_fakes.h"
+
+#include "app_events.h"
+#include "app_state.h"
+#include "app_thermostat.h"
+
+
+// Replays a recorded trace through the thermostat and prints its heat
+// decisions, or diffs them against a baseline of an earlier replay.
+// The events are posted to the app's loops like the sensors and MQTT do,
+// the handlers are the ones app_start_thermostat registers. Time is
+// virtual, every replay of a trace decides the same.
+//
+// A trace has one input per line, tools/trace_capture.py writes them:
+//
+//   # comment
+//   <ms> temp <°C> [zone]
+//   <ms> humid <%> [zone]
+//   <ms> target <°C> [zone]
+//   <ms> sensor ok|error [zone]
+//   <ms> outdoor <°C>
+//   <ms> mode levels|pid|predictive
+//   <ms> end
+//
+// The decisions are lines of `<ms> <zone> heat <duty>` and
+// `<ms> <zone> window 0|1`.
+
+
+#define GPIO_PWM_BASE 25
+#define DEFAULT_TARGET 21
+#define MAX_LINE 128
+#define MAX_SHOWN_DIFFS 10
+
+
+typedef enum {
+  INPUT_TEMP,
+  INPUT_HUMID,
+  INPUT_TARGET,
+  INPUT_SENSOR,
+  INPUT_OUTDOOR,
+  INPUT_MODE,
+  INPUT_END,
+} input_kind_t;
+
+
+typedef struct {
+  int64_t at_ms;
+  input_kind_t kind;
+  float value;
+  uint8_t zone;
+} input_t;
+
+
+typedef struct {
+  int64_t at_ms;
+  uint8_t zone;
+  char kind[8];
+  int value;
+} decision_t;
+
+
+typedef struct {
+  size_t count;
+  size_t capacity;
+  void * items;
+} list_t;
+
+
+static list_t decisions = {0};
+
+
+
+static void * list_add(list_t * list, size_t item_size) {
+  if (list->count == list->capacity) {
+    list->capacity = list->capacity ? 2 * list->capacity : 256;
+    list->items = realloc(list->items, list->capacity * item_size);
+  }
+  return (char *) list->items + item_size * list->count++;
+}
+
+
+
+static bool parse_input(const char * line, input_t * input) {
+  char kind[16], value[16];
+  unsigned zone = 0;
+  const int fields = sscanf(line, "%" SCNd64 " %15s %15s %u", &(input->at_ms), kind, value, &zone);
+  if (fields < 2 || zone >= APP_ZONES) {
+    return false;
+  }
+  input->zone = zone;
+
+  if (strcmp(kind, "end") == 0) {
+    input->kind = INPUT_END;
+    return true;
+  }
+  if (fields < 3) {
+    return false;
+  }
+
+  if (strcmp(kind, "sensor") == 0) {
+    input->kind = INPUT_SENSOR;
+    input->value = strcmp(value, "error") == 0;
+    return input->value || strcmp(value, "ok") == 0;
+  }
+  if (strcmp(kind, "mode") == 0) {
+    const char * modes[APP_THERMOSTAT_MODE_MAX] = {
+      [APP_THERMOSTAT_MODE_LEVELS] = "levels",
+      [APP_THERMOSTAT_MODE_PID] = "pid",
+      [APP_THERMOSTAT_MODE_PREDICTIVE] = "predictive",
+    };
+    input->kind = INPUT_MODE;
+    for (int mode = 0; mode < APP_THERMOSTAT_MODE_MAX; mode++) {
+      if (strcmp(value, modes[mode]) == 0) {
+        input->value = mode;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  const char * kinds[] = {
+    [INPUT_TEMP] = "temp",
+    [INPUT_HUMID] = "humid",
+    [INPUT_TARGET] = "target",
+    [INPUT_OUTDOOR] = "outdoor",
+  };
+  for (int k = INPUT_TEMP; k <= INPUT_OUTDOOR; k++) {
+    if (kinds[k] != NULL && strcmp(kind, kinds[k]) == 0) {
+      input->kind = k;
+      input->value = atof(value);
+      return true;
+    }
+  }
+  return false;
+}
+
+
+
+static bool load_trace(const char * path, list_t * inputs) {
+  FILE * f = fopen(path, "r");
+  if (f == NULL) {
+    perror(path);
+    return false;
+  }
+
+  char line[MAX_LINE];
+  int line_no = 0;
+  int64_t last_ms = 0;
+  while (fgets(line, sizeof(line), f) != NULL) {
+    line_no += 1;
+    const char * start = line + strspn(line, " \t");
+    if (*start == '#' || *start == '\n' || *start == '\0') {
+      continue;
+    }
+
+    input_t input;
+    if (!parse_input(start, &input) || input.at_ms < last_ms) {
+      fprintf(stderr, "%s:%d: invalid input: %s", path, line_no, line);
+      fclose(f);
+      return false;
+    }
+    last_ms = input.at_ms;
+    *(input_t *) list_add(inputs, sizeof(input_t)) = input;
+  }
+  fclose(f);
+  return true;
+}
+
+
+
+static void post_input(const input_t * input) {
+  switch (input->kind) {
+    case INPUT_TEMP: {
+      app_traced_temp_t data = { .temp = input->value, .zone = input->zone };
+      app_post_current_temp_changed(&data);
+      break;
+    }
+    case INPUT_HUMID: {
+      app_zone_value_t data = { .value = input->value, .zone = input->zone };
+      app_post_current_humid_changed(&data);
+      break;
+    }
+    case INPUT_TARGET: {
+      app_traced_temp_t data = { .temp = input->value, .zone = input->zone };
+      app_post_target_temp_changed(&data);
+      break;
+    }
+    case INPUT_SENSOR: {
+      app_zone_flag_t data = { .value = input->value != 0, .zone = input->zone };
+      app_post_temp_read_state(&data);
+      break;
+    }
+    case INPUT_OUTDOOR: {
+      float outdoor = input->value;
+      app_post_outdoor_temp_changed(&outdoor);
+      break;
+    }
+    case INPUT_MODE: {
+      uint8_t mode = input->value;
+      app_post_controller_mode_set(&mode);
+      break;
+    }
+    case INPUT_END:
+      break;
+  }
+}
+
+
+
+static void add_decision(const app_state_t * state, const char * kind, int value) {
+  decision_t * decision = list_add(&decisions, sizeof(decision_t));
+  *decision = (decision_t) {
+    .at_ms = esp_timer_get_time() / 1000,
+    .zone = state->zone,
+    .value = value,
+  };
+  snprintf(decision->kind, sizeof(decision->kind), "%s", kind);
+}
+
+
+
+static void record_decision(void * arg, uint32_t changed, const app_state_t * state) {
+  if (changed & APP_STATE_FIELD_HEAT) {
+    add_decision(state, "heat", state->heat);
+  }
+  if (changed & APP_STATE_FIELD_WINDOW_OPEN) {
+    add_decision(state, "window", state->window_open);
+  }
+}
+
+
+
+static void replay(const list_t * inputs, const uint8_t heat[3], uint8_t cycle_sec) {
+  const input_t * items = inputs->items;
+
+  // the thermostats start with the targets of the trace's first moment
+  uint8_t zone_count = 1;
+  app_thermostat_zone_t zones[APP_ZONES];
+  for (uint8_t zone = 0; zone < APP_ZONES; zone++) {
+    zones[zone] = (app_thermostat_zone_t) { .gpio_pwm = GPIO_PWM_BASE + zone, .target_temp = DEFAULT_TARGET };
+  }
+  for (size_t i = 0; i < inputs->count; i++) {
+    if (items[i].zone >= zone_count) {
+      zone_count = items[i].zone + 1;
+    }
+    if (items[i].kind == INPUT_TARGET && items[i].at_ms == 0) {
+      zones[items[i].zone].target_temp = items[i].value;
+    }
+  }
+
+  app_start_event_loops();
+  app_state_subscribe(APP_EVENT_LOOP_CONTROL, APP_STATE_FIELD_HEAT | APP_STATE_FIELD_WINDOW_OPEN, record_decision, NULL);
+  app_start_thermostat(zones, zone_count, heat[0], heat[1], heat[2], cycle_sec);
+  fake_event_loops_run();
+
+  int64_t now_ms = 0;
+  for (size_t i = 0; i < inputs->count; i++) {
+    fake_advance((items[i].at_ms - now_ms) * 1000);
+    now_ms = items[i].at_ms;
+
+    post_input(&(items[i]));
+    fake_event_loops_run();
+  }
+}
+
+
+
+static bool load_baseline(const char * path, list_t * baseline) {
+  FILE * f = fopen(path, "r");
+  if (f == NULL) {
+    perror(path);
+    return false;
+  }
+
+  char line[MAX_LINE];
+  while (fgets(line, sizeof(line), f) != NULL) {
+    decision_t decision;
+    unsigned zone;
+    if (line[0] == '#' || line[0] == '\n') {
+      continue;
+    }
+    if (sscanf(line, "%" SCNd64 " %u %7s %d", &(decision.at_ms), &zone, decision.kind, &(decision.value)) != 4) {
+      fprintf(stderr, "%s: invalid decision: %s", path, line);
+      fclose(f);
+      return false;
+    }
+    decision.zone = zone;
+    *(decision_t *) list_add(baseline, sizeof(decision_t)) = decision;
+  }
+  fclose(f);
+  return true;
+}
+
+
+
+static void print_decision(FILE * f, const char * prefix, const decision_t * decision) {
+  fprintf(f, "%s%" PRId64 " %u %s %d\n", prefix, decision->at_ms, decision->zone, decision->kind, decision->value);
+}
+
+
+
+// Compares the decisions in order, a decision matches if it is the same
+// and at most `tolerance_ms` off. Returns the number of mismatches.
+static size_t diff(const list_t * baseline, const list_t * replayed, int64_t tolerance_ms) {
+  const decision_t * expected = baseline->items;
+  const decision_t * actual = replayed->items;
+  const size_t count = (baseline->count > replayed->count) ? baseline->count : replayed->count;
+
+  size_t mismatches = 0;
+  int64_t max_shift_ms = 0;
+  for (size_t i = 0; i < count; i++) {
+    const decision_t * e = (i < baseline->count) ? &(expected[i]) : NULL;
+    const decision_t * a = (i < replayed->count) ? &(actual[i]) : NULL;
+
+    bool same = e != NULL && a != NULL
+      && e->zone == a->zone && e->value == a->value && strcmp(e->kind, a->kind) == 0;
+    if (same) {
+      const int64_t shift_ms = llabs(a->at_ms - e->at_ms);
+      max_shift_ms = (shift_ms > max_shift_ms) ? shift_ms : max_shift_ms;
+      same = shift_ms <= tolerance_ms;
+    }
+    if (same) {
+      continue;
+    }
+
+    if (mismatches < MAX_SHOWN_DIFFS) {
+      if (e != NULL) {
+        print_decision(stdout, "- ", e);
+      }
+      if (a != NULL) {
+        print_decision(stdout, "+ ", a);
+      }
+    }
+    mismatches += 1;
+  }
+
+  printf(
+    "%zu baseline decisions, %zu replayed, %zu differ, max shift of equal decisions %" PRId64 " ms\n",
+    baseline->count, replayed->count, mismatches, max_shift_ms
+  );
+  return mismatches;
+}
+
+
+
+static void usage(const char * name) {
+  fprintf(stderr,
+    "usage: %s [options] TRACE\n"
+    "  --baseline FILE     diff the decisions against an earlier replay\n"
+    "  --tolerance MS      timing difference still matching the baseline (0)\n"
+    "  --heat MIN,NORMAL,MAX  heat levels %% (15,50,70)\n"
+    "  --cycle S           PWM cycle s (60)\n",
+    name
+  );
+}
+
+
+
+int main(int argc, char ** argv) {
+  static const struct option options[] = {
+    {"baseline",  required_argument, NULL, 'b'},
+    {"tolerance", required_argument, NULL, 't'},
+    {"heat",      required_argument, NULL, 'H'},
+    {"cycle",     required_argument, NULL, 'c'},
+    {0},
+  };
+
+  const char * baseline_path = NULL;
+  int64_t tolerance_ms = 0;
+  uint8_t heat[3] = {15, 50, 70};
+  int cycle_sec = 60;
+
+  int opt;
+  while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+    unsigned levels[3];
+    switch (opt) {
+      case 'b': baseline_path = optarg; break;
+      case 't': tolerance_ms = atoll(optarg); break;
+      case 'c': cycle_sec = atoi(optarg); break;
+      case 'H':
+        if (sscanf(optarg, "%u,%u,%u", &levels[0], &levels[1], &levels[2]) != 3 || levels[2] > 100) {
+          usage(argv[0]);
+          return 2;
+        }
+        for (int i = 0; i < 3; i++) {
+          heat[i] = levels[i];
+        }
+        break;
+      default:
+        usage(argv[0]);
+        return 2;
+    }
+  }
+  if (optind != argc - 1 || cycle_sec <= 0 || cycle_sec > UINT8_MAX) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  list_t inputs = {0};
+  if (!load_trace(argv[optind], &inputs)) {
+    return 2;
+  }
+
+  esp_log_level_set("*", ESP_LOG_NONE);
+  replay(&inputs, heat, cycle_sec);
+  free(inputs.items);
+
+  if (baseline_path == NULL) {
+    for (size_t i = 0; i < decisions.count; i++) {
+      print_decision(stdout, "", &(((decision_t *) decisions.items)[i]));
+    }
+    return 0;
+  }
+
+  list_t baseline = {0};
+  if (!load_baseline(baseline_path, &baseline)) {
+    return 2;
+  }
+  const size_t mismatches = diff(&baseline, &decisions, tolerance_ms);
+  free(baseline.items);
+  return mismatches == 0 ? 0 : 1;
+}
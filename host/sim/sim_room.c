@@ -0,0 +1,93 @@
+#include <math.h>
+
+#include "./sim_room.h"
+
+
+#define SEC_PER_DAY (24 * 3600)
+#define COLDEST_SEC (3 * 3600)
+
+
+
+// xorshift64*, the same seed gives the same run on every host
+static double uniform(sim_room_t * room) {
+  room->rng ^= room->rng >> 12;
+  room->rng ^= room->rng << 25;
+  room->rng ^= room->rng >> 27;
+  return ((room->rng * 2685821657736338717ULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+
+
+static float gaussian(sim_room_t * room) {
+  const double u = 1 - uniform(room);
+  const double v = uniform(room);
+  return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+
+
+static void schedule_advert(sim_room_t * room, double after_sec) {
+  const sim_room_config_t * config = &(room->config);
+  const double jitter = (2 * uniform(room) - 1) * config->advert_jitter_sec;
+  room->next_advert_sec = after_sec + fmax(config->advert_interval_sec + jitter, 1);
+}
+
+
+
+void sim_room_init(sim_room_t * room, const sim_room_config_t * config) {
+  *room = (sim_room_t) {
+    .config = *config,
+    .temp = config->start_temp,
+    .sensor_temp = config->start_temp,
+    .rng = 0x9e3779b97f4a7c15ULL ^ config->seed,
+  };
+  // the first advert comes anywhere within the first interval
+  room->next_advert_sec = uniform(room) * config->advert_interval_sec;
+}
+
+
+
+float sim_room_outdoor(const sim_room_t * room, double at_sec) {
+  const double phase = fmod(at_sec - COLDEST_SEC, SEC_PER_DAY) / SEC_PER_DAY;
+  return room->config.outdoor_mean - room->config.outdoor_swing * cos(2 * M_PI * phase);
+}
+
+
+
+// first order response to a constant input, exact for any step
+static float settle(float value, float target, float dt_sec, float tau_sec) {
+  if (tau_sec <= 0) {
+    return target;
+  }
+  return target + (value - target) * expf(-dt_sec / tau_sec);
+}
+
+
+
+void sim_room_step(sim_room_t * room, double at_sec, float dt_sec, float heat_share) {
+  const sim_room_config_t * config = &(room->config);
+  const float outdoor = sim_room_outdoor(room, at_sec + dt_sec / 2);
+
+  // the room heads for where the losses match the heater's mean power
+  const float balance = outdoor + config->heater_power * heat_share / config->loss;
+  const float tau_sec = config->heat_capacity * 1000 / config->loss;
+  room->temp = settle(room->temp, balance, dt_sec, tau_sec);
+  room->sensor_temp = settle(room->sensor_temp, room->temp, dt_sec, config->sensor_lag_sec);
+}
+
+
+
+bool sim_room_advert(sim_room_t * room, double at_sec, float * reading) {
+  if (at_sec < room->next_advert_sec) {
+    return false;
+  }
+  schedule_advert(room, room->next_advert_sec);
+
+  const sim_room_config_t * config = &(room->config);
+  float temp = room->sensor_temp + config->sensor_noise * gaussian(room);
+  if (config->sensor_step > 0) {
+    temp = roundf(temp / config->sensor_step) * config->sensor_step;
+  }
+  *reading = temp;
+  return true;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// Single node thermal model of a room with an on/off heater, and a BLE
+// thermometer that reads it through a first order lag with noise.
+// Every step is solved exactly for its constant inputs, so large steps
+// stay stable.
+
+typedef struct {
+  // kJ/K, air, furniture and walls that follow the room temperature
+  float heat_capacity;
+  // W/K, conduction and ventilation to the outdoors
+  float loss;
+  // W, while the heater is on
+  float heater_power;
+
+  // °C, daily mean and half of the day/night difference, coldest at 3:00
+  float outdoor_mean;
+  float outdoor_swing;
+  float start_temp;
+
+  // s, time constant of the sensor
+  float sensor_lag_sec;
+  // °C, standard deviation of the reading
+  float sensor_noise;
+  // °C, resolution of the advertised reading
+  float sensor_step;
+  // s, adverts are spread uniformly by +/- the jitter around the interval
+  float advert_interval_sec;
+  float advert_jitter_sec;
+
+  uint32_t seed;
+} sim_room_config_t;
+
+
+typedef struct {
+  sim_room_config_t config;
+  float temp;
+  float sensor_temp;
+  double next_advert_sec;
+  uint64_t rng;
+} sim_room_t;
+
+
+void sim_room_init(sim_room_t * room, const sim_room_config_t * config);
+
+// outdoor temperature at `at_sec` from midnight of the first day
+float sim_room_outdoor(const sim_room_t * room, double at_sec);
+
+// Advances the room by `dt_sec` from `at_sec`, with the heater on for
+// `heat_share` (0 to 1) of the step.
+void sim_room_step(sim_room_t * room, double at_sec, float dt_sec, float heat_share);
+
+// Returns true and sets `reading` when the next advert was due by `at_sec`.
+bool sim_room_advert(sim_room_t * room, double at_sec, float * reading);
+
+
+#ifdef __cplusplus
+}
+#endif
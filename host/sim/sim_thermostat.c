@@ -0,0 +1,337 @@
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_log.h"
+#include "host_fakes.h"
+
+#include "app_events.h"
+#include "app_pid.h"
+#include "app_state.h"
+#include "app_thermostat.h"
+
+#include "./sim_room.h"
+
+
+// Runs the thermostat against a simulated room, days of virtual time in
+// seconds. The control code is the app's, driven through the fakes like
+// in the tests, only the room and its thermometer are simulated.
+
+
+#define GPIO_PWM 25
+#define STEP_SEC 1
+#define OUTDOOR_INTERVAL_SEC (10 * 60)
+
+// setback hours of the night target
+#define NIGHT_FROM_HOUR 22
+#define NIGHT_UNTIL_HOUR 6
+
+
+typedef struct {
+  float days;
+  float warmup_hours;
+  const char * mode;
+  float target;
+  float night_target;
+  bool outdoor_sensor;
+
+  uint8_t heat_min;
+  uint8_t heat_normal;
+  uint8_t heat_max;
+  uint8_t cycle_sec;
+
+  bool set_gains;
+  float kp, ki, kd;
+} sim_config_t;
+
+
+typedef struct {
+  uint32_t samples;
+  double abs_error;
+  double square_error;
+  float overshoot;
+  float undershoot;
+  uint32_t adverts;
+  // the room crossed the target since it last changed
+  bool reached;
+  float last_error;
+} sim_metrics_t;
+
+
+
+static const struct option options[] = {
+  {"days",         required_argument, NULL, 'd'},
+  {"warmup",       required_argument, NULL, 'w'},
+  {"mode",         required_argument, NULL, 'm'},
+  {"target",       required_argument, NULL, 't'},
+  {"night-target", required_argument, NULL, 'n'},
+  {"no-outdoor",   no_argument,       NULL, 'O'},
+  {"heat",         required_argument, NULL, 'H'},
+  {"cycle",        required_argument, NULL, 'c'},
+  {"gains",        required_argument, NULL, 'g'},
+  {"capacity",     required_argument, NULL, 'C'},
+  {"loss",         required_argument, NULL, 'L'},
+  {"power",        required_argument, NULL, 'P'},
+  {"outdoor",      required_argument, NULL, 'o'},
+  {"swing",        required_argument, NULL, 's'},
+  {"lag",          required_argument, NULL, 'l'},
+  {"noise",        required_argument, NULL, 'N'},
+  {"advert",       required_argument, NULL, 'a'},
+  {"jitter",       required_argument, NULL, 'j'},
+  {"seed",         required_argument, NULL, 'S'},
+  {"help",         no_argument,       NULL, 'h'},
+  {0},
+};
+
+
+
+static void usage(const char * name) {
+  fprintf(stderr,
+    "usage: %s [options]\n"
+    "  --days N            simulated days (7)\n"
+    "  --warmup H          hours left out of the comfort metrics (6)\n"
+    "  --mode M            levels, pid or predictive (levels)\n"
+    "  --target T          day target °C (21)\n"
+    "  --night-target T    target from %d:00 to %d:00 °C (day target)\n"
+    "  --no-outdoor        no outdoor thermometer, no heat curve\n"
+    "  --heat MIN,NORMAL,MAX  heat levels %% (15,50,70)\n"
+    "  --cycle S           PWM cycle s (60)\n"
+    "  --gains KP,KI,KD    PID gains in %% per °C, per °C h and per °C/h\n"
+    "  --capacity KJ_K     heat capacity of the room kJ/K (2000)\n"
+    "  --loss W_K          losses W/K (60)\n"
+    "  --power W           heater power W (3000)\n"
+    "  --outdoor T         daily mean outdoor °C (0)\n"
+    "  --swing T           half the day/night outdoor difference °C (4)\n"
+    "  --lag S             sensor time constant s (120)\n"
+    "  --noise T           sensor noise °C (0.05)\n"
+    "  --advert S          advert interval s (10)\n"
+    "  --jitter S          advert jitter s (5)\n"
+    "  --seed N            random seed (1)\n",
+    name, NIGHT_FROM_HOUR, NIGHT_UNTIL_HOUR
+  );
+}
+
+
+
+static bool parse_args(int argc, char ** argv, sim_config_t * sim, sim_room_config_t * room) {
+  int opt;
+  while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+    unsigned heat[3];
+    switch (opt) {
+      case 'd': sim->days = atof(optarg); break;
+      case 'w': sim->warmup_hours = atof(optarg); break;
+      case 'm': sim->mode = optarg; break;
+      case 't': sim->target = sim->night_target = atof(optarg); break;
+      case 'n': sim->night_target = atof(optarg); break;
+      case 'O': sim->outdoor_sensor = false; break;
+      case 'c': sim->cycle_sec = atoi(optarg); break;
+      case 'C': room->heat_capacity = atof(optarg); break;
+      case 'L': room->loss = atof(optarg); break;
+      case 'P': room->heater_power = atof(optarg); break;
+      case 'o': room->outdoor_mean = atof(optarg); break;
+      case 's': room->outdoor_swing = atof(optarg); break;
+      case 'l': room->sensor_lag_sec = atof(optarg); break;
+      case 'N': room->sensor_noise = atof(optarg); break;
+      case 'a': room->advert_interval_sec = atof(optarg); break;
+      case 'j': room->advert_jitter_sec = atof(optarg); break;
+      case 'S': room->seed = strtoul(optarg, NULL, 0); break;
+
+      case 'H':
+        if (sscanf(optarg, "%u,%u,%u", &heat[0], &heat[1], &heat[2]) != 3 || heat[2] > 100) {
+          return false;
+        }
+        sim->heat_min = heat[0];
+        sim->heat_normal = heat[1];
+        sim->heat_max = heat[2];
+        break;
+
+      case 'g':
+        if (sscanf(optarg, "%f,%f,%f", &sim->kp, &sim->ki, &sim->kd) != 3) {
+          return false;
+        }
+        sim->set_gains = true;
+        break;
+
+      default:
+        return false;
+    }
+  }
+  return optind == argc && sim->days > 0 && sim->cycle_sec > 0 && room->loss > 0 && room->heat_capacity > 0;
+}
+
+
+
+static bool post_mode(const char * name) {
+  const char * names[APP_THERMOSTAT_MODE_MAX] = {
+    [APP_THERMOSTAT_MODE_LEVELS] = "levels",
+    [APP_THERMOSTAT_MODE_PID] = "pid",
+    [APP_THERMOSTAT_MODE_PREDICTIVE] = "predictive",
+  };
+  for (uint8_t mode = 0; mode < APP_THERMOSTAT_MODE_MAX; mode++) {
+    if (strcmp(name, names[mode]) == 0) {
+      app_post_controller_mode_set(&mode);
+      return true;
+    }
+  }
+  return false;
+}
+
+
+
+static float target_at(const sim_config_t * sim, double at_sec) {
+  const int hour = (int) (at_sec / 3600) % 24;
+  const bool night = hour >= NIGHT_FROM_HOUR || hour < NIGHT_UNTIL_HOUR;
+  return night ? sim->night_target : sim->target;
+}
+
+
+
+static void track(sim_metrics_t * metrics, float temp, float target) {
+  const float error = temp - target;
+  metrics->samples += 1;
+  metrics->abs_error += fabsf(error);
+  metrics->square_error += error * error;
+
+  // the way to a new target is neither an over- nor an undershoot
+  if ((error >= 0) != (metrics->last_error >= 0)) {
+    metrics->reached = true;
+  }
+  metrics->last_error = error;
+  if (metrics->reached) {
+    metrics->overshoot = fmaxf(metrics->overshoot, error);
+    metrics->undershoot = fmaxf(metrics->undershoot, -error);
+  }
+}
+
+
+
+static double now_sec(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+
+int main(int argc, char ** argv) {
+  sim_config_t sim = {
+    .days = 7,
+    .warmup_hours = 6,
+    .mode = "levels",
+    .target = 21,
+    .night_target = 21,
+    .outdoor_sensor = true,
+    .heat_min = 15,
+    .heat_normal = 50,
+    .heat_max = 70,
+    .cycle_sec = 60,
+  };
+  sim_room_config_t room_config = {
+    .heat_capacity = 2000,
+    .loss = 60,
+    .heater_power = 3000,
+    .outdoor_mean = 0,
+    .outdoor_swing = 4,
+    .start_temp = 18,
+    .sensor_lag_sec = 120,
+    .sensor_noise = 0.05,
+    .sensor_step = 0.0625,
+    .advert_interval_sec = 10,
+    .advert_jitter_sec = 5,
+    .seed = 1,
+  };
+  if (!parse_args(argc, argv, &sim, &room_config)) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  esp_log_level_set("*", ESP_LOG_NONE);
+  app_start_event_loops();
+
+  const app_thermostat_zone_t zone = { .gpio_pwm = GPIO_PWM, .target_temp = target_at(&sim, 0) };
+  app_start_thermostat(&zone, 1, sim.heat_min, sim.heat_normal, sim.heat_max, sim.cycle_sec);
+  if (!post_mode(sim.mode)) {
+    usage(argv[0]);
+    return 2;
+  }
+  if (sim.set_gains) {
+    app_pid_gains_t gains = {
+      .kp_q16 = APP_PID_Q16(sim.kp),
+      .ki_q16 = APP_PID_Q16(sim.ki),
+      .kd_q16 = APP_PID_Q16(sim.kd),
+    };
+    app_post_pid_gains_set(&gains);
+  }
+  fake_event_loops_run();
+
+  sim_room_t room;
+  sim_room_init(&room, &room_config);
+
+  sim_metrics_t metrics = {0};
+  const double end_sec = sim.days * 24 * 3600;
+  const double warmup_sec = sim.warmup_hours * 3600;
+  float target = zone.target_temp;
+  metrics.last_error = room.temp - target;
+  double next_outdoor_sec = 0;
+  int64_t high_us = fake_gpio_high_us(GPIO_PWM);
+  const double started = now_sec();
+
+  for (double at_sec = 0; at_sec < end_sec; at_sec += STEP_SEC) {
+    const float scheduled = target_at(&sim, at_sec);
+    if (scheduled != target) {
+      target = scheduled;
+      metrics.reached = false;
+      metrics.last_error = room.temp - target;
+      app_traced_temp_t data = { .temp = target };
+      app_post_target_temp_changed(&data);
+    }
+
+    float reading;
+    if (sim_room_advert(&room, at_sec, &reading)) {
+      app_traced_temp_t data = { .temp = reading };
+      app_post_current_temp_changed(&data);
+      metrics.adverts += 1;
+    }
+
+    if (sim.outdoor_sensor && at_sec >= next_outdoor_sec) {
+      float outdoor = sim_room_outdoor(&room, at_sec);
+      app_post_outdoor_temp_changed(&outdoor);
+      next_outdoor_sec += OUTDOOR_INTERVAL_SEC;
+    }
+
+    fake_event_loops_run();
+    fake_advance(STEP_SEC * 1000 * 1000LL);
+
+    // the heater follows the PWM output within the step
+    const int64_t high = fake_gpio_high_us(GPIO_PWM);
+    sim_room_step(&room, at_sec, STEP_SEC, (high - high_us) / (STEP_SEC * 1e6f));
+    high_us = high;
+
+    if (at_sec >= warmup_sec) {
+      track(&metrics, room.temp, target);
+    }
+  }
+  const double elapsed = now_sec() - started;
+
+  const double on_hours = high_us / 3.6e9;
+  app_state_t state;
+  app_state_get(0, &state);
+
+  printf("%-24s %12.1f days in %.2f s, %.0fx real time\n", "simulated", sim.days, elapsed, end_sec / elapsed);
+  printf("%-24s %12s\n", "mode", sim.mode);
+  printf("%-24s %12.3f °C\n", "mean abs error", metrics.abs_error / fmax(metrics.samples, 1));
+  printf("%-24s %12.3f °C\n", "rms error", sqrt(metrics.square_error / fmax(metrics.samples, 1)));
+  printf("%-24s %12.3f °C\n", "max overshoot", metrics.overshoot);
+  printf("%-24s %12.3f °C\n", "max undershoot", metrics.undershoot);
+  printf("%-24s %12u\n", "heater switch-ons", (fake_gpio_edges(GPIO_PWM) + 1) / 2);
+  printf("%-24s %12.1f %%\n", "heater on", 100 * on_hours / (end_sec / 3600));
+  printf("%-24s %12.2f kWh\n", "energy", on_hours * room_config.heater_power / 1000);
+  printf("%-24s %12u\n", "adverts", metrics.adverts);
+  printf("%-24s %12.3f °C\n", "final room temp", room.temp);
+  printf("%-24s %12.3f °C\n", "final reading", state.current_temp);
+
+  return 0;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// A minimal subset of the Unity assertions ESP-IDF tests use.
+// A failed assertion ends the test function, RUN_TEST reports it.
+
+static int test_failures = 0;
+static const char * test_name = NULL;
+
+
+#define TEST_FAIL_MESSAGE_(format, ...) do { \
+    printf("%s:%d: %s: " format "\n", __FILE__, __LINE__, test_name, ##__VA_ARGS__); \
+    test_failures += 1; \
+    return; \
+  } while (0)
+
+#define TEST_ASSERT_MESSAGE(condition, message) do { \
+    if (!(condition)) { \
+      TEST_FAIL_MESSAGE_("%s", message); \
+    } \
+  } while (0)
+
+#define TEST_ASSERT(condition) TEST_ASSERT_MESSAGE(condition, #condition)
+#define TEST_ASSERT_TRUE(condition) TEST_ASSERT_MESSAGE(condition, #condition " is false")
+#define TEST_ASSERT_FALSE(condition) TEST_ASSERT_MESSAGE(!(condition), #condition " is true")
+#define TEST_ASSERT_NULL(pointer) TEST_ASSERT_MESSAGE((pointer) == NULL, #pointer " is not NULL")
+#define TEST_ASSERT_NOT_NULL(pointer) TEST_ASSERT_MESSAGE((pointer) != NULL, #pointer " is NULL")
+
+#define TEST_ASSERT_EQUAL_INT(expected, actual) do { \
+    const long long e_ = (long long) (expected); \
+    const long long a_ = (long long) (actual); \
+    if (e_ != a_) { \
+      TEST_FAIL_MESSAGE_("expected %s == %lld, was %lld", #actual, e_, a_); \
+    } \
+  } while (0)
+
+#define TEST_ASSERT_INT_WITHIN(delta, expected, actual) do { \
+    const long long e_ = (long long) (expected); \
+    const long long a_ = (long long) (actual); \
+    if (llabs(e_ - a_) > (long long) (delta)) { \
+      TEST_FAIL_MESSAGE_("expected %s == %lld +/- %lld, was %lld", #actual, e_, (long long) (delta), a_); \
+    } \
+  } while (0)
+
+#define TEST_ASSERT_FLOAT_WITHIN(delta, expected, actual) do { \
+    const double e_ = (double) (expected); \
+    const double a_ = (double) (actual); \
+    if (!(fabs(e_ - a_) <= (double) (delta))) { \
+      TEST_FAIL_MESSAGE_("expected %s == %f +/- %f, was %f", #actual, e_, (double) (delta), a_); \
+    } \
+  } while (0)
+
+#define TEST_ASSERT_EQUAL_STRING(expected, actual) do { \
+    const char * e_ = (expected); \
+    const char * a_ = (actual); \
+    if (a_ == NULL || strcmp(e_, a_) != 0) { \
+      TEST_FAIL_MESSAGE_("expected %s == \"%s\", was \"%s\"", #actual, e_, a_ ? a_ : "(null)"); \
+    } \
+  } while (0)
+
+
+#define RUN_TEST(fn) do { \
+    const int failures_ = test_failures; \
+    test_name = #fn; \
+    fn(); \
+    printf("%s %s\n", failures_ == test_failures ? "PASS" : "FAIL", #fn); \
+  } while (0)
+
+#define TEST_EXIT() (test_failures == 0 ? 0 : 1)
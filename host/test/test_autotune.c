@@ -0,0 +1,144 @@
+#include <math.h>
+
+#include "app_autotune.h"
+
+#include "./test.h"
+
+
+#define DT_MS (30 * 1000)
+#define MAX_MS (24 * 3600 * 1000)
+
+// the simulated room, per tick
+#define GAIN 0.0004f
+#define LOSS 0.0005f
+#define AMBIENT 10.0f
+#define DEAD_TIME 10
+
+
+typedef struct {
+  float temp;
+  uint8_t pipe[DEAD_TIME + 1];
+} room_t;
+
+
+
+static float step_room(room_t * room, uint8_t duty) {
+  for (int i = DEAD_TIME; i > 0; i--) {
+    room->pipe[i] = room->pipe[i - 1];
+  }
+  room->pipe[0] = duty;
+
+  room->temp += GAIN * room->pipe[DEAD_TIME] - LOSS * (room->temp - AMBIENT);
+  return roundf(room->temp * 100) / 100;
+}
+
+
+
+static app_autotune_status_t run(app_autotune_t * autotune, room_t * room, int max_ticks) {
+  uint8_t duty;
+  app_autotune_status_t status = app_autotune_update(autotune, room->temp, 0, &duty);
+  for (int k = 0; k < max_ticks && status == APP_AUTOTUNE_RUNNING; k++) {
+    status = app_autotune_update(autotune, step_room(room, duty), DT_MS, &duty);
+  }
+  return status;
+}
+
+
+
+static void test_tunes_the_room(void) {
+  app_autotune_t autotune;
+  room_t room = { .temp = 20 };
+  app_autotune_start(&autotune, 21, 0.2, 10, 100, MAX_MS);
+
+  TEST_ASSERT_EQUAL_INT(APP_AUTOTUNE_DONE, run(&autotune, &room, MAX_MS / DT_MS));
+
+  app_autotune_result_t result;
+  app_autotune_get_result(&autotune, &result);
+  TEST_ASSERT_EQUAL_INT(APP_AUTOTUNE_DONE, result.status);
+  TEST_ASSERT_EQUAL_INT(APP_AUTOTUNE_CYCLES, result.cycles);
+
+  // the dead time delays both switches, the slow cooling dominates
+  TEST_ASSERT(result.tu_sec > 2 * DEAD_TIME * DT_MS / 1000);
+  TEST_ASSERT(result.amplitude > 0.2);
+  TEST_ASSERT(result.ku > 0);
+
+  const float kp = result.gains.kp_q16 / 65536.0;
+  const float ti_h = result.tu_sec / 2 / 3600;
+  const float td_h = result.tu_sec / 3 / 3600;
+  TEST_ASSERT_FLOAT_WITHIN(0.01, result.ku / 3, kp);
+  TEST_ASSERT_FLOAT_WITHIN(0.01, kp / ti_h, result.gains.ki_q16 / 65536.0);
+  TEST_ASSERT_FLOAT_WITHIN(0.01, kp * td_h, result.gains.kd_q16 / 65536.0);
+  TEST_ASSERT_INT_WITHIN(1, fminf(255, fmaxf(10, result.tu_sec / 40)), result.heat_cycle_sec);
+}
+
+
+
+static void test_relay_follows_the_band(void) {
+  app_autotune_t autotune;
+  app_autotune_start(&autotune, 21, 0.2, 10, 100, MAX_MS);
+
+  uint8_t duty;
+  app_autotune_update(&autotune, 20, 0, &duty);
+  TEST_ASSERT_EQUAL_INT(100, duty);
+
+  // within the band the relay holds
+  app_autotune_update(&autotune, 21.1, DT_MS, &duty);
+  TEST_ASSERT_EQUAL_INT(100, duty);
+
+  app_autotune_update(&autotune, 21.3, DT_MS, &duty);
+  TEST_ASSERT_EQUAL_INT(10, duty);
+
+  app_autotune_update(&autotune, 20.9, DT_MS, &duty);
+  TEST_ASSERT_EQUAL_INT(10, duty);
+
+  app_autotune_update(&autotune, 20.7, DT_MS, &duty);
+  TEST_ASSERT_EQUAL_INT(100, duty);
+}
+
+
+
+static void test_times_out(void) {
+  app_autotune_t autotune;
+  // the room never gets this warm
+  room_t room = { .temp = 20 };
+  app_autotune_start(&autotune, 40, 0.2, 10, 100, 3600 * 1000);
+
+  TEST_ASSERT_EQUAL_INT(APP_AUTOTUNE_TIMEOUT, run(&autotune, &room, MAX_MS / DT_MS));
+
+  uint8_t duty;
+  app_autotune_update(&autotune, 20, DT_MS, &duty);
+  TEST_ASSERT_EQUAL_INT(10, duty);
+}
+
+
+
+static void test_abort_keeps_gains_unset(void) {
+  app_autotune_t autotune;
+  room_t room = { .temp = 20 };
+  app_autotune_start(&autotune, 21, 0.2, 10, 100, MAX_MS);
+  run(&autotune, &room, 200);
+
+  app_autotune_abort(&autotune);
+
+  uint8_t duty;
+  TEST_ASSERT_EQUAL_INT(APP_AUTOTUNE_ABORTED, app_autotune_update(&autotune, 20, DT_MS, &duty));
+  TEST_ASSERT_EQUAL_INT(10, duty);
+
+  app_autotune_result_t result;
+  app_autotune_get_result(&autotune, &result);
+  TEST_ASSERT_EQUAL_INT(APP_AUTOTUNE_ABORTED, result.status);
+  TEST_ASSERT_EQUAL_INT(0, result.gains.kp_q16);
+  TEST_ASSERT_EQUAL_INT(0, result.heat_cycle_sec);
+  TEST_ASSERT_EQUAL_STRING("aborted", app_autotune_status_name(result.status));
+}
+
+
+
+int main(void) {
+  RUN_TEST(test_tunes_the_room);
+  RUN_TEST(test_relay_follows_the_band);
+  RUN_TEST(test_times_out);
+  RUN_TEST(test_abort_keeps_gains_unset);
+
+  return TEST_EXIT();
+}
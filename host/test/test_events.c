@@ -0,0 +1,281 @@
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "host_fakes.h"
+
+#include "app_events.h"
+
+#include "./test.h"
+
+
+#define MAX_LOG 32
+
+static app_event_t dispatch_log[MAX_LOG];
+static size_t dispatch_log_len = 0;
+
+static uint32_t humid_calls = 0;
+static float last_humid[APP_ZONES] = {0};
+
+static uint32_t temp_calls = 0;
+static float last_temp = 0;
+
+static uint32_t trace_report_calls = 0;
+
+static uint32_t tapped = 0;
+
+
+
+static void log_no_data(void * arg, app_event_t evt_id, const app_no_data_t * data) {
+  if (dispatch_log_len < MAX_LOG) {
+    dispatch_log[dispatch_log_len++] = evt_id;
+  }
+}
+
+
+
+static void record_humid(void * arg, app_event_t evt_id, const app_zone_value_t * humid) {
+  humid_calls += 1;
+  last_humid[humid->zone] = humid->value;
+}
+
+
+
+static void record_temp(void * arg, app_event_t evt_id, const app_traced_temp_t * data) {
+  temp_calls += 1;
+  last_temp = data->temp;
+}
+
+
+
+static void count_trace_reports(void * arg, app_event_t evt_id, const app_no_data_t * data) {
+  trace_report_calls += 1;
+}
+
+
+
+static void count_posts(app_event_t evt_id, const void * data, size_t size) {
+  tapped += 1;
+}
+
+
+
+static void post_temp(float temp) {
+  app_traced_temp_t data = { .temp = temp };
+  app_post_current_temp_changed(&data);
+}
+
+
+
+static esp_err_t post_humid(uint8_t zone, float humid) {
+  app_zone_value_t data = { .value = humid, .zone = zone };
+  return app_post_current_humid_changed(&data);
+}
+
+
+
+static void test_events_are_dispatched_in_post_order(void) {
+  dispatch_log_len = 0;
+
+  // the handlers live on different loops
+  app_post_time_updated(NULL);
+  app_post_restart(NULL);
+  app_post_time_updated(NULL);
+
+  TEST_ASSERT_EQUAL_INT(3, fake_event_loops_run());
+  TEST_ASSERT_EQUAL_INT(3, dispatch_log_len);
+  TEST_ASSERT_EQUAL_INT(APP_EVENT_TIME_UPDATED, dispatch_log[0]);
+  TEST_ASSERT_EQUAL_INT(APP_EVENT_RESTART, dispatch_log[1]);
+  TEST_ASSERT_EQUAL_INT(APP_EVENT_TIME_UPDATED, dispatch_log[2]);
+}
+
+
+
+static void test_coalesce_delivers_latest_value_once(void) {
+  app_event_counters_t before, after;
+  app_get_event_counters(APP_EVENT_CURRENT_HUMID_CHANGED, &before);
+  const uint32_t calls = humid_calls;
+
+  const float values[] = {40, 41, 42};
+  for (int i = 0; i < 3; i++) {
+    TEST_ASSERT_EQUAL_INT(ESP_OK, post_humid(0, values[i]));
+  }
+  TEST_ASSERT_EQUAL_INT(1, fake_event_loops_pending());
+
+  fake_event_loops_run();
+  app_get_event_counters(APP_EVENT_CURRENT_HUMID_CHANGED, &after);
+
+  TEST_ASSERT_EQUAL_INT(calls + 1, humid_calls);
+  TEST_ASSERT_FLOAT_WITHIN(0, 42, last_humid[0]);
+  TEST_ASSERT_EQUAL_INT(3, after.posted - before.posted);
+  TEST_ASSERT_EQUAL_INT(2, after.coalesced - before.coalesced);
+  TEST_ASSERT_EQUAL_INT(0, after.dropped - before.dropped);
+}
+
+
+
+static void test_zones_coalesce_separately(void) {
+  const uint32_t calls = humid_calls;
+
+  post_humid(0, 50);
+  post_humid(1, 60);
+  post_humid(0, 51);
+  post_humid(1, 61);
+  TEST_ASSERT_EQUAL_INT(2, fake_event_loops_pending());
+
+  fake_event_loops_run();
+  TEST_ASSERT_EQUAL_INT(calls + 2, humid_calls);
+  TEST_ASSERT_FLOAT_WITHIN(0, 51, last_humid[0]);
+  TEST_ASSERT_FLOAT_WITHIN(0, 61, last_humid[1]);
+}
+
+
+
+static void test_unknown_zone_is_rejected(void) {
+  TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_ARG, post_humid(APP_ZONES, 50));
+  TEST_ASSERT_EQUAL_INT(0, fake_event_loops_pending());
+}
+
+
+
+static void test_drop_newest_when_queue_is_full(void) {
+  app_event_counters_t before, after;
+  app_get_event_counters(APP_EVENT_TRACE_REPORT, &before);
+  const uint32_t calls = trace_report_calls;
+
+  int failed = 0;
+  for (int i = 0; i < CONFIG_APP_EVENT_TELEMETRY_QUEUE_SIZE + 4; i++) {
+    if (app_post_trace_report(NULL) != ESP_OK) {
+      failed += 1;
+    }
+  }
+  app_get_event_counters(APP_EVENT_TRACE_REPORT, &after);
+
+  TEST_ASSERT_EQUAL_INT(4, failed);
+  TEST_ASSERT_EQUAL_INT(4, after.dropped - before.dropped);
+  TEST_ASSERT_EQUAL_INT(CONFIG_APP_EVENT_TELEMETRY_QUEUE_SIZE, after.queue_hwm);
+
+  fake_event_loops_run();
+  TEST_ASSERT_EQUAL_INT(calls + CONFIG_APP_EVENT_TELEMETRY_QUEUE_SIZE, trace_report_calls);
+}
+
+
+
+static void test_mailbox_without_token_counts_a_drop(void) {
+  // a full control queue takes no token for the mailbox
+  while (app_post_time_updated(NULL) == ESP_OK) {
+  }
+
+  app_event_counters_t before, after;
+  app_get_event_counters(APP_EVENT_CURRENT_HUMID_CHANGED, &before);
+  TEST_ASSERT_EQUAL_INT(ESP_FAIL, post_humid(0, 70));
+  app_get_event_counters(APP_EVENT_CURRENT_HUMID_CHANGED, &after);
+  TEST_ASSERT_EQUAL_INT(1, after.dropped - before.dropped);
+
+  fake_event_loops_run();
+  TEST_ASSERT(last_humid[0] != 70);
+
+  // the next post takes a token again
+  const uint32_t calls = humid_calls;
+  TEST_ASSERT_EQUAL_INT(ESP_OK, post_humid(0, 71));
+  fake_event_loops_run();
+  TEST_ASSERT_EQUAL_INT(calls + 1, humid_calls);
+  TEST_ASSERT_FLOAT_WITHIN(0, 71, last_humid[0]);
+}
+
+
+
+static void test_payload_size_is_checked(void) {
+  // a bare value without the zone
+  const float humid = 40;
+  TEST_ASSERT_EQUAL_INT(
+    ESP_ERR_INVALID_SIZE,
+    app_post_event(APP_EVENT_CURRENT_HUMID_CHANGED, &humid, sizeof(humid))
+  );
+  // no such event, the policy table is not read past its end
+  TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_ARG, app_post_event(APP_EVENT_MAX, &humid, sizeof(humid)));
+  TEST_ASSERT_EQUAL_INT(0, fake_event_loops_pending());
+}
+
+
+
+static void test_rate_limit_merges_bursts(void) {
+  app_set_event_rate_limit(APP_EVENT_CURRENT_TEMP_CHANGED, 5000, 0.05);
+  const uint32_t calls = temp_calls;
+
+  post_temp(20.0);
+  fake_event_loops_run();
+  TEST_ASSERT_EQUAL_INT(calls + 1, temp_calls);
+
+  // within the deadband
+  post_temp(20.01);
+  fake_event_loops_run();
+  TEST_ASSERT_EQUAL_INT(calls + 1, temp_calls);
+
+  // held back until the interval passed, the latest value wins
+  fake_advance(1000 * 1000);
+  post_temp(21.0);
+  post_temp(21.5);
+  fake_advance(3900 * 1000);
+  TEST_ASSERT_EQUAL_INT(calls + 1, temp_calls);
+
+  fake_advance(200 * 1000);
+  TEST_ASSERT_EQUAL_INT(calls + 2, temp_calls);
+  TEST_ASSERT_FLOAT_WITHIN(0, 21.5, last_temp);
+}
+
+
+
+static void test_tap_sees_every_post(void) {
+  const uint32_t before = tapped;
+
+  post_humid(0, 50);
+  app_post_time_updated(NULL);
+  fake_event_loops_run();
+
+  TEST_ASSERT_EQUAL_INT(before + 2, tapped);
+}
+
+
+
+static void test_handler_stats_are_kept_by_name(void) {
+  app_event_handler_stats_t stats[16];
+  const size_t count = app_get_handler_stats(stats, 16);
+
+  const app_event_handler_stats_t * humid = NULL;
+  for (size_t i = 0; i < count; i++) {
+    if (strcmp(stats[i].name, "record_humid") == 0) {
+      humid = &(stats[i]);
+    }
+  }
+
+  TEST_ASSERT_NOT_NULL(humid);
+  TEST_ASSERT_EQUAL_INT(APP_EVENT_LOOP_CONTROL, humid->loop);
+  TEST_ASSERT_EQUAL_INT(APP_EVENT_CURRENT_HUMID_CHANGED, humid->evt_id);
+  TEST_ASSERT_EQUAL_INT(humid_calls, humid->calls);
+}
+
+
+
+int main(void) {
+  esp_log_level_set("*", ESP_LOG_WARN);
+  app_start_event_loops();
+
+  app_subscribe(APP_EVENT_LOOP_CONTROL, time_updated, log_no_data, NULL);
+  app_subscribe(APP_EVENT_LOOP_TELEMETRY, restart, log_no_data, NULL);
+  app_subscribe(APP_EVENT_LOOP_CONTROL, current_humid_changed, record_humid, NULL);
+  app_subscribe(APP_EVENT_LOOP_CONTROL, current_temp_changed, record_temp, NULL);
+  app_subscribe(APP_EVENT_LOOP_TELEMETRY, trace_report, count_trace_reports, NULL);
+  app_set_event_tap(count_posts);
+
+  RUN_TEST(test_events_are_dispatched_in_post_order);
+  RUN_TEST(test_coalesce_delivers_latest_value_once);
+  RUN_TEST(test_zones_coalesce_separately);
+  RUN_TEST(test_unknown_zone_is_rejected);
+  RUN_TEST(test_drop_newest_when_queue_is_full);
+  RUN_TEST(test_mailbox_without_token_counts_a_drop);
+  RUN_TEST(test_payload_size_is_checked);
+  RUN_TEST(test_rate_limit_merges_bursts);
+  RUN_TEST(test_tap_sees_every_post);
+  RUN_TEST(test_handler_stats_are_kept_by_name);
+
+  return TEST_EXIT();
+}
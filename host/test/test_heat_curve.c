@@ -0,0 +1,86 @@
+#include <stdbool.h>
+
+#include "app_heat_curve.h"
+
+#include "./test.h"
+
+
+#define DESIGN_TEMP -12
+#define DESIGN_DUTY 80
+#define LIMIT_TEMP 16
+
+
+
+static app_heat_curve_t linear_curve(void) {
+  app_heat_curve_t curve;
+  app_heat_curve_init(&curve, DESIGN_TEMP, DESIGN_DUTY, LIMIT_TEMP, 100);
+  return curve;
+}
+
+
+
+static void test_runs_from_design_to_limit(void) {
+  app_heat_curve_t curve = linear_curve();
+
+  TEST_ASSERT_EQUAL_INT(DESIGN_DUTY, app_heat_curve_duty(&curve, DESIGN_TEMP * 100, 2000));
+  TEST_ASSERT_EQUAL_INT(DESIGN_DUTY / 2, app_heat_curve_duty(&curve, 200, 2000));
+  TEST_ASSERT_EQUAL_INT(0, app_heat_curve_duty(&curve, LIMIT_TEMP * 100, 2000));
+  TEST_ASSERT_EQUAL_INT(0, app_heat_curve_duty(&curve, 2500, 2000));
+}
+
+
+
+static void test_interpolates_between_points(void) {
+  app_heat_curve_t curve = linear_curve();
+
+  // 80 % over 28 °C, 2.857 % per °C
+  TEST_ASSERT_EQUAL_INT(37, app_heat_curve_duty(&curve, 300, 2000));
+  TEST_ASSERT_EQUAL_INT(36, app_heat_curve_duty(&curve, 350, 2000));
+  TEST_ASSERT_EQUAL_INT(34, app_heat_curve_duty(&curve, 400, 2000));
+}
+
+
+
+static void test_is_limited_to_the_table(void) {
+  app_heat_curve_t curve = linear_curve();
+
+  const uint8_t coldest = app_heat_curve_duty(&curve, APP_HEAT_CURVE_MIN_TEMP * 100, 2000);
+  TEST_ASSERT_EQUAL_INT(coldest, app_heat_curve_duty(&curve, -5000, 2000));
+  TEST_ASSERT_EQUAL_INT(100, coldest);
+}
+
+
+
+static void test_target_shifts_the_curve(void) {
+  app_heat_curve_t curve = linear_curve();
+
+  // 2 °C warmer inside needs what 2 °C colder outside does
+  TEST_ASSERT_EQUAL_INT(
+    app_heat_curve_duty(&curve, 0, 2000),
+    app_heat_curve_duty(&curve, 200, 2200)
+  );
+  TEST_ASSERT(app_heat_curve_duty(&curve, 500, 2200) > app_heat_curve_duty(&curve, 500, 2000));
+}
+
+
+
+static void test_exponent_bends_the_curve(void) {
+  app_heat_curve_t bent;
+  app_heat_curve_init(&bent, DESIGN_TEMP, DESIGN_DUTY, LIMIT_TEMP, 150);
+  app_heat_curve_t curve = linear_curve();
+
+  TEST_ASSERT_EQUAL_INT(DESIGN_DUTY, app_heat_curve_duty(&bent, DESIGN_TEMP * 100, 2000));
+  TEST_ASSERT(app_heat_curve_duty(&bent, 800, 2000) < app_heat_curve_duty(&curve, 800, 2000));
+}
+
+
+
+int main(void) {
+  RUN_TEST(test_runs_from_design_to_limit);
+  RUN_TEST(test_interpolates_between_points);
+  RUN_TEST(test_is_limited_to_the_table);
+  RUN_TEST(test_target_shifts_the_curve);
+  RUN_TEST(test_exponent_bends_the_curve);
+
+  return TEST_EXIT();
+}
@@ -0,0 +1,146 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "app_model.h"
+
+#include "./test.h"
+
+
+#define DT_MS (30 * 1000)
+#define TICKS_PER_HOUR (3600 * 1000 / DT_MS)
+
+// the simulated room, per tick
+#define GAIN 0.0002f
+#define LOSS 0.0005f
+#define AMBIENT 10.0f
+#define DEAD_TIME 6
+
+
+typedef struct {
+  float temp;
+  uint8_t pipe[DEAD_TIME + 1];
+} room_t;
+
+
+
+// steps the room by a tick with `duty`, the sensor reads in 1/100 °C
+static float step_room(room_t * room, uint8_t duty) {
+  for (int i = DEAD_TIME; i > 0; i--) {
+    room->pipe[i] = room->pipe[i - 1];
+  }
+  room->pipe[0] = duty;
+
+  room->temp += GAIN * room->pipe[DEAD_TIME] - LOSS * (room->temp - AMBIENT);
+  return roundf(room->temp * 100) / 100;
+}
+
+
+
+// random heat levels held for a while, like a thermostat would
+static void learn(app_model_t * model, room_t * room, int ticks) {
+  srand(1);
+  uint8_t duty = 0;
+  for (int k = 0; k < ticks; k++) {
+    if (k % 20 == 0) {
+      duty = rand() % 101;
+    }
+    app_model_update(model, step_room(room, duty), duty);
+  }
+}
+
+
+
+static void test_learns_the_room(void) {
+  app_model_t model;
+  app_model_init(&model, DT_MS);
+  room_t room = { .temp = 18 };
+
+  TEST_ASSERT(!app_model_valid(&model));
+  learn(&model, &room, 3000);
+  TEST_ASSERT(app_model_valid(&model));
+
+  app_model_fit_t fit;
+  app_model_get_fit(&model, &fit);
+  TEST_ASSERT(fit.valid);
+  TEST_ASSERT_EQUAL_INT(2999, fit.samples);
+  TEST_ASSERT_EQUAL_INT(DEAD_TIME * DT_MS / 1000, fit.dead_time_sec);
+  TEST_ASSERT_FLOAT_WITHIN(GAIN * TICKS_PER_HOUR * 0.1, GAIN * TICKS_PER_HOUR, fit.gain);
+  TEST_ASSERT_FLOAT_WITHIN(LOSS * TICKS_PER_HOUR * 0.2, LOSS * TICKS_PER_HOUR, fit.loss);
+  TEST_ASSERT_FLOAT_WITHIN(2, AMBIENT, fit.ambient);
+  TEST_ASSERT(fit.rms_error < 0.01);
+}
+
+
+
+static void test_gaps_are_skipped(void) {
+  app_model_t model;
+  app_model_init(&model, DT_MS);
+
+  app_model_update(&model, 20, 50);
+  app_model_skip(&model);
+  app_model_update(&model, 25, 50);
+  TEST_ASSERT_EQUAL_INT(0, model.params.samples);
+
+  app_model_update(&model, 25, 50);
+  TEST_ASSERT_EQUAL_INT(1, model.params.samples);
+}
+
+
+
+static void test_restore_needs_the_same_rate(void) {
+  app_model_t model, other;
+  app_model_init(&model, DT_MS);
+  room_t room = { .temp = 18 };
+  learn(&model, &room, 300);
+
+  app_model_init(&other, DT_MS * 2);
+  TEST_ASSERT(!app_model_restore(&other, &(model.params)));
+  TEST_ASSERT_EQUAL_INT(0, other.params.samples);
+
+  app_model_init(&other, DT_MS);
+  TEST_ASSERT(app_model_restore(&other, &(model.params)));
+  TEST_ASSERT_EQUAL_INT(299, other.params.samples);
+}
+
+
+
+static void test_duty_accounts_for_heat_in_flight(void) {
+  app_model_t model;
+  app_model_init(&model, DT_MS);
+  room_t room = { .temp = 18 };
+  learn(&model, &room, 3000);
+
+  // well below the target, full heat
+  TEST_ASSERT_EQUAL_INT(100, app_model_choose_duty(&model, AMBIENT, 21, 0, 100, TICKS_PER_HOUR / 2));
+
+  // at the steady state duty of the target
+  const uint8_t steady = roundf(LOSS * (21 - AMBIENT) / GAIN);
+  room.temp = 21;
+  memset(room.pipe, steady, sizeof(room.pipe));
+  app_model_skip(&model);
+  float temp = 0;
+  for (int k = 0; k < DEAD_TIME * 2; k++) {
+    temp = step_room(&room, steady);
+    app_model_update(&model, temp, steady);
+  }
+  TEST_ASSERT_INT_WITHIN(3, steady, app_model_choose_duty(&model, temp, 21, 0, 100, TICKS_PER_HOUR / 2));
+
+  // right after a burst at the target, the heat still on its way is enough
+  for (int k = 0; k < DEAD_TIME; k++) {
+    temp = step_room(&room, 100);
+    app_model_update(&model, temp, 100);
+  }
+  TEST_ASSERT(app_model_choose_duty(&model, temp, 21, 0, 100, TICKS_PER_HOUR / 2) < steady);
+}
+
+
+
+int main(void) {
+  RUN_TEST(test_learns_the_room);
+  RUN_TEST(test_gaps_are_skipped);
+  RUN_TEST(test_restore_needs_the_same_rate);
+  RUN_TEST(test_duty_accounts_for_heat_in_flight);
+
+  return TEST_EXIT();
+}
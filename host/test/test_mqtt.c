@@ -0,0 +1,213 @@
+#include "esp_log.h"
+#include "cJSON.h"
+#include "driver/ledc.h"
+#include "mqtt_client.h"
+#include "host_fakes.h"
+
+#include "app_events.h"
+#include "app_mqtt.h"
+#include "app_schedule.h"
+#include "app_state.h"
+#include "app_stats.h"
+#include "app_thermostat.h"
+#include "app_trace.h"
+#include "slow_pwm.h"
+
+#include "./test.h"
+
+
+#define PREFIX "/thermostat"
+
+
+
+static void deliver(const char * topic, const char * data) {
+  fake_mqtt_deliver(topic, data);
+  fake_event_loops_run();
+}
+
+
+
+static cJSON * parse_published(const char * topic) {
+  const char * msg = fake_mqtt_published(topic);
+  return (msg != NULL) ? cJSON_Parse(msg) : NULL;
+}
+
+
+
+static void test_subscribes_on_connect(void) {
+  TEST_ASSERT_TRUE(fake_mqtt_subscribed(PREFIX "/target-temp/set"));
+  TEST_ASSERT_TRUE(fake_mqtt_subscribed(PREFIX "/stats/get"));
+  TEST_ASSERT_TRUE(fake_mqtt_subscribed(PREFIX "/events/metrics/get"));
+  TEST_ASSERT_TRUE(fake_mqtt_subscribed(PREFIX "/system/reset/#"));
+}
+
+
+
+static void test_target_temp_set_reaches_the_thermostat(void) {
+  deliver(PREFIX "/target-temp/set", "{\"value\": 22.5}");
+
+  app_state_t state;
+  app_state_get(0, &state);
+  TEST_ASSERT_FLOAT_WITHIN(0, 22.5, state.target_temp);
+  TEST_ASSERT_EQUAL_INT(100, state.heat);
+}
+
+
+
+static void test_stats_report(void) {
+  deliver(PREFIX "/stats/get", "{}");
+
+  cJSON * stats = parse_published(PREFIX "/stats/report");
+  TEST_ASSERT_NOT_NULL(stats);
+
+  TEST_ASSERT_EQUAL_STRING("host", cJSON_GetObjectItem(stats, "app_version")->valuestring);
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 22.5, cJSON_GetObjectItem(stats, "target_temp")->valuedouble);
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 20, cJSON_GetObjectItem(stats, "current_temp")->valuedouble);
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 1, cJSON_GetObjectItem(stats, "heat")->valuedouble);
+  TEST_ASSERT_FALSE(cJSON_IsTrue(cJSON_GetObjectItem(stats, "error")));
+  cJSON_Delete(stats);
+}
+
+
+
+static void test_stats_led_follows_heat(void) {
+  TEST_ASSERT_EQUAL_INT(20 + 100 * 5, ledc_get_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_2));
+}
+
+
+
+static void test_metrics_report(void) {
+  deliver(PREFIX "/events/metrics/get", "{}");
+
+  cJSON * metrics = parse_published(PREFIX "/events/metrics/report");
+  TEST_ASSERT_NOT_NULL(metrics);
+
+  const cJSON * target_temp = NULL;
+  const cJSON * events = cJSON_GetObjectItem(metrics, "events");
+  for (int i = 0; i < cJSON_GetArraySize(events); i++) {
+    const cJSON * evt = cJSON_GetArrayItem(events, i);
+    if (strcmp(cJSON_GetObjectItem(evt, "event")->valuestring, "target_temp_changed") == 0) {
+      target_temp = evt;
+    }
+  }
+  TEST_ASSERT_NOT_NULL(target_temp);
+  TEST_ASSERT_EQUAL_INT(1, cJSON_GetObjectItem(target_temp, "posted")->valueint);
+
+  const cJSON * handlers = cJSON_GetObjectItem(metrics, "handlers");
+  TEST_ASSERT_TRUE(cJSON_GetArraySize(handlers) > 0);
+
+  const cJSON * pwm = cJSON_GetObjectItem(metrics, "pwm_jitter");
+  TEST_ASSERT_NOT_NULL(cJSON_GetObjectItem(pwm, "max_us"));
+  TEST_ASSERT_EQUAL_INT(SLOW_PWM_JITTER_BUCKETS, cJSON_GetArraySize(cJSON_GetObjectItem(pwm, "histogram")));
+  cJSON_Delete(metrics);
+}
+
+
+
+static void test_trace_report(void) {
+  app_post_trace_report(NULL);
+  fake_event_loops_run();
+
+  cJSON * report = parse_published(PREFIX "/trace/report");
+  TEST_ASSERT_NOT_NULL(report);
+
+  // the target temp set above changed the heat
+  const cJSON * mqtt = cJSON_GetObjectItem(report, "mqtt");
+  TEST_ASSERT_NOT_NULL(mqtt);
+  TEST_ASSERT_EQUAL_INT(1, cJSON_GetObjectItem(mqtt, "count")->valueint);
+  cJSON_Delete(report);
+}
+
+
+
+static void test_zone_subtree(void) {
+  TEST_ASSERT_TRUE(fake_mqtt_subscribed(PREFIX "/zones/+/target-temp/set"));
+
+  deliver(PREFIX "/zones/1/target-temp/set", "{\"value\": 19.5}");
+
+  app_state_t state;
+  app_state_get(1, &state);
+  TEST_ASSERT_FLOAT_WITHIN(0, 19.5, state.target_temp);
+  app_state_get(0, &state);
+  TEST_ASSERT_FLOAT_WITHIN(0, 22.5, state.target_temp);
+
+  deliver(PREFIX "/stats/get", "{}");
+
+  cJSON * stats = parse_published(PREFIX "/zones/1/stats/report");
+  TEST_ASSERT_NOT_NULL(stats);
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 19.5, cJSON_GetObjectItem(stats, "target_temp")->valuedouble);
+  cJSON_Delete(stats);
+}
+
+
+
+static void test_unknown_topic_is_ignored(void) {
+  const uint32_t published = fake_mqtt_publish_count();
+
+  fake_mqtt_deliver(PREFIX "/nothing/here", "{}");
+  TEST_ASSERT_EQUAL_INT(0, fake_event_loops_pending());
+
+  fake_event_loops_run();
+  TEST_ASSERT_EQUAL_INT(published, fake_mqtt_publish_count());
+}
+
+
+
+static void test_schedule_round_trip(void) {
+  deliver(
+    PREFIX "/schedule/set",
+    "{\"entries\": ["
+      "{\"days\": [\"mon\", \"tue\"], \"time\": \"06:30\", \"target\": 21.5},"
+      "{\"days\": [\"sun\"], \"time\": \"22:00\", \"target\": 17}"
+    "]}"
+  );
+
+  cJSON * report = parse_published(PREFIX "/schedule/report");
+  TEST_ASSERT_NOT_NULL(report);
+  cJSON * entries = cJSON_GetObjectItem(report, "entries");
+  TEST_ASSERT_EQUAL_INT(2, cJSON_GetArraySize(entries));
+
+  cJSON * first = cJSON_GetArrayItem(entries, 0);
+  cJSON * days = cJSON_GetObjectItem(first, "days");
+  TEST_ASSERT_EQUAL_INT(2, cJSON_GetArraySize(days));
+  TEST_ASSERT_EQUAL_STRING("mon", cJSON_GetArrayItem(days, 0)->valuestring);
+  TEST_ASSERT_EQUAL_STRING("06:30", cJSON_GetObjectItem(first, "time")->valuestring);
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 21.5, cJSON_GetObjectItem(first, "target")->valuedouble);
+  cJSON_Delete(report);
+
+  // invalid schedules are not applied
+  const uint32_t published = fake_mqtt_publish_count();
+  deliver(PREFIX "/schedule/set", "{\"entries\": [{\"days\": [\"mon\"], \"time\": \"25:00\", \"target\": 20}]}");
+  TEST_ASSERT_EQUAL_INT(published, fake_mqtt_publish_count());
+}
+
+
+
+int main(void) {
+  esp_log_level_set("*", ESP_LOG_WARN);
+  app_start_event_loops();
+
+  esp_mqtt_client_config_t config = { .uri = "mqtts://localhost" };
+  app_start_mqtt(&config, PREFIX);
+  app_start_stats_handler(2);
+  const app_thermostat_zone_t zones[] = {
+    { .gpio_pwm = 25, .target_temp = 21 },
+    { .gpio_pwm = 26, .target_temp = 21 },
+  };
+  app_start_thermostat(zones, APP_ZONES, 10, 50, 100, 60);
+  app_start_schedule();
+  fake_event_loops_run();
+  fake_mqtt_connect();
+
+  RUN_TEST(test_subscribes_on_connect);
+  RUN_TEST(test_target_temp_set_reaches_the_thermostat);
+  RUN_TEST(test_stats_report);
+  RUN_TEST(test_stats_led_follows_heat);
+  RUN_TEST(test_metrics_report);
+  RUN_TEST(test_trace_report);
+  RUN_TEST(test_zone_subtree);
+  RUN_TEST(test_schedule_round_trip);
+  RUN_TEST(test_unknown_topic_is_ignored);
+
+  return TEST_EXIT();
+}
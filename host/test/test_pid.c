@@ -0,0 +1,140 @@
+#include "app_pid.h"
+
+#include "./test.h"
+
+
+#define OUT_MIN 10
+#define OUT_MAX 100
+#define DT_MS (30 * 1000)
+
+
+static const app_pid_gains_t gains = {
+  .kp_q16 = APP_PID_Q16(40),
+  .ki_q16 = APP_PID_Q16(20),
+  .kd_q16 = APP_PID_Q16(0),
+};
+
+
+
+static void test_output_is_clamped(void) {
+  app_pid_t pid;
+  app_pid_init(&pid, &gains, OUT_MIN, OUT_MAX);
+
+  TEST_ASSERT_EQUAL_INT(OUT_MAX, app_pid_update(&pid, 2100, 1500, DT_MS));
+  TEST_ASSERT_EQUAL_INT(OUT_MIN, app_pid_update(&pid, 2100, 2700, DT_MS));
+}
+
+
+
+static void test_proportional_step(void) {
+  app_pid_t pid;
+  app_pid_init(&pid, &gains, 0, 100);
+  app_pid_reset(&pid, 0);
+
+  // 0.5 °C * 40 %/°C, plus 0.5 °C * 20 %/(°C h) for 30 s
+  const uint8_t out = app_pid_update(&pid, 2100, 2050, DT_MS);
+  TEST_ASSERT_EQUAL_INT(20, out);
+  TEST_ASSERT_EQUAL_INT(50, pid.terms.error_cdeg);
+  TEST_ASSERT_EQUAL_INT(APP_PID_Q16(20), pid.terms.p_q16);
+  TEST_ASSERT_INT_WITHIN(2, APP_PID_Q16(20 * 0.5 * 30 / 3600.0), pid.terms.i_q16);
+  // the fraction rounded away is kept for the PWM
+  TEST_ASSERT_EQUAL_INT(pid.terms.p_q16 + pid.terms.i_q16, pid.output_q16);
+  TEST_ASSERT((pid.output_q16 & 0xffff) != 0);
+}
+
+
+
+static void test_no_windup_while_saturated(void) {
+  app_pid_t pid;
+  app_pid_init(&pid, &gains, OUT_MIN, OUT_MAX);
+
+  // a cold start, far below the target for a day
+  for (int i = 0; i < 24 * 120; i++) {
+    app_pid_update(&pid, 2100, 1500, DT_MS);
+  }
+  TEST_ASSERT(pid.integral_q16 <= ((int32_t) OUT_MAX << 16));
+
+  // overshooting, the output leaves saturation within a step
+  TEST_ASSERT(app_pid_update(&pid, 2100, 2150, DT_MS) < OUT_MAX);
+}
+
+
+
+static void test_integral_removes_steady_error(void) {
+  app_pid_t pid;
+  app_pid_init(&pid, &gains, OUT_MIN, OUT_MAX);
+  app_pid_reset(&pid, 30);
+
+  uint8_t out = 0;
+  for (int i = 0; i < 120; i++) {
+    out = app_pid_update(&pid, 2100, 2090, DT_MS);
+  }
+  TEST_ASSERT(out > 30 + 4);
+}
+
+
+
+static void test_derivative_on_measurement(void) {
+  const app_pid_gains_t pd = { .kp_q16 = 0, .ki_q16 = 0, .kd_q16 = APP_PID_Q16(10) };
+  app_pid_t pid;
+  app_pid_init(&pid, &pd, 0, 100);
+  app_pid_reset(&pid, 50);
+
+  app_pid_update(&pid, 2100, 2000, DT_MS);
+
+  // a setpoint change does not kick
+  TEST_ASSERT_EQUAL_INT(50, app_pid_update(&pid, 2300, 2000, DT_MS));
+  TEST_ASSERT_EQUAL_INT(0, pid.terms.d_q16);
+
+  // rising 0.1 °C in 30 s is 12 °C/h, which brakes by 120 %
+  TEST_ASSERT_EQUAL_INT(0, app_pid_update(&pid, 2300, 2010, DT_MS));
+  TEST_ASSERT_EQUAL_INT(APP_PID_Q16(-120), pid.terms.d_q16);
+}
+
+
+
+static void test_reset_is_bumpless(void) {
+  app_pid_t pid;
+  app_pid_init(&pid, &gains, OUT_MIN, OUT_MAX);
+  app_pid_reset(&pid, 50);
+
+  // on target, the output stays where the reset put it
+  TEST_ASSERT_EQUAL_INT(50, app_pid_update(&pid, 2100, 2100, DT_MS));
+
+  // gain changes keep the integral
+  const app_pid_gains_t stronger = { .kp_q16 = APP_PID_Q16(80), .ki_q16 = APP_PID_Q16(40) };
+  app_pid_set_gains(&pid, &stronger);
+  TEST_ASSERT_EQUAL_INT(50, app_pid_update(&pid, 2100, 2100, DT_MS));
+}
+
+
+
+static void test_feedforward_is_trimmed(void) {
+  app_pid_t pid;
+  app_pid_init(&pid, &gains, OUT_MIN, OUT_MAX);
+  app_pid_set_feedforward(&pid, 60);
+  app_pid_reset(&pid, 60);
+
+  // at the target the output is the feedforward, the terms trim it both ways
+  TEST_ASSERT_EQUAL_INT(60, app_pid_update(&pid, 2100, 2100, DT_MS));
+  TEST_ASSERT_EQUAL_INT(40, app_pid_update(&pid, 2100, 2150, DT_MS));
+  TEST_ASSERT_EQUAL_INT(60, pid.terms.feedforward);
+
+  // still limited to the output range
+  TEST_ASSERT_EQUAL_INT(OUT_MIN, app_pid_update(&pid, 2100, 2400, DT_MS));
+  TEST_ASSERT_EQUAL_INT(OUT_MAX, app_pid_update(&pid, 2100, 1800, DT_MS));
+}
+
+
+
+int main(void) {
+  RUN_TEST(test_output_is_clamped);
+  RUN_TEST(test_proportional_step);
+  RUN_TEST(test_no_windup_while_saturated);
+  RUN_TEST(test_integral_removes_steady_error);
+  RUN_TEST(test_derivative_on_measurement);
+  RUN_TEST(test_reset_is_bumpless);
+  RUN_TEST(test_feedforward_is_trimmed);
+
+  return TEST_EXIT();
+}
@@ -0,0 +1,165 @@
+#include <string.h>
+
+#include "app_schedule.h"
+
+#include "./test.h"
+
+
+#define MON_TO_FRI 0x3e
+#define SAT_SUN 0x41
+
+
+static app_schedule_table_t table;
+
+
+
+static struct tm at(int wday, int hour, int min) {
+  return (struct tm) { .tm_wday = wday, .tm_hour = hour, .tm_min = min };
+}
+
+
+
+static int16_t target_at(int wday, int hour, int min) {
+  bool preheating = false;
+  const struct tm time = at(wday, hour, min);
+  // already warm, no optimal start
+  return app_schedule_evaluate(&table, &time, 3000, 1, 0, &preheating);
+}
+
+
+
+static const app_schedule_t schedule = {
+  .count = 4,
+  .entries = {
+    { .days = MON_TO_FRI, .minute = 6 * 60 + 30, .target_cdeg = 2100 },
+    { .days = MON_TO_FRI, .minute = 22 * 60, .target_cdeg = 1700 },
+    { .days = SAT_SUN, .minute = 8 * 60, .target_cdeg = 2150 },
+    { .days = SAT_SUN, .minute = 23 * 60 + 10, .target_cdeg = 1700 },
+  }
+};
+
+
+
+static void test_empty_schedule_is_disabled(void) {
+  const app_schedule_t empty = { .count = 0 };
+  TEST_ASSERT(!app_schedule_compile(&empty, &table));
+
+  const app_schedule_t invalid = { .count = 1, .entries = {{ .days = 0, .minute = 60, .target_cdeg = 2000 }} };
+  TEST_ASSERT(!app_schedule_compile(&invalid, &table));
+}
+
+
+
+static void test_targets_hold_until_the_next_entry(void) {
+  TEST_ASSERT(app_schedule_compile(&schedule, &table));
+
+  TEST_ASSERT_EQUAL_INT(1700, target_at(1, 6, 29));
+  TEST_ASSERT_EQUAL_INT(2100, target_at(1, 6, 30));
+  TEST_ASSERT_EQUAL_INT(2100, target_at(1, 21, 59));
+  TEST_ASSERT_EQUAL_INT(1700, target_at(1, 22, 0));
+
+  // entries are rounded down to the quarter hour
+  TEST_ASSERT_EQUAL_INT(1700, target_at(6, 23, 0));
+  TEST_ASSERT_EQUAL_INT(2150, target_at(6, 22, 59));
+}
+
+
+
+static void test_wraps_around_the_week(void) {
+  TEST_ASSERT(app_schedule_compile(&schedule, &table));
+
+  // Sunday night holds into Monday morning
+  TEST_ASSERT_EQUAL_INT(1700, target_at(0, 23, 30));
+  TEST_ASSERT_EQUAL_INT(1700, target_at(1, 0, 0));
+
+  // the week starts on Sunday, continuing Saturday night
+  TEST_ASSERT_EQUAL_INT(1700, table.target_cdeg[0]);
+  TEST_ASSERT_EQUAL_INT(8 * 4, table.next_change[0]);
+  TEST_ASSERT_EQUAL_INT(8 * 4, table.next_change[6 * 96 + 23 * 4 + 2]);
+}
+
+
+
+static void test_constant_schedule(void) {
+  const app_schedule_t constant = { .count = 1, .entries = {{ .days = 0x7f, .minute = 0, .target_cdeg = 1900 }} };
+  TEST_ASSERT(app_schedule_compile(&constant, &table));
+
+  bool preheating = false;
+  const struct tm time = at(3, 12, 0);
+  TEST_ASSERT_EQUAL_INT(1900, app_schedule_evaluate(&table, &time, 1500, 1, 180, &preheating));
+  TEST_ASSERT(!preheating);
+}
+
+
+
+static void test_optimal_start(void) {
+  TEST_ASSERT(app_schedule_compile(&schedule, &table));
+  bool preheating = false;
+
+  // 2 °C below at 1 °C/h, heating starts two hours early
+  struct tm time = at(2, 4, 29);
+  TEST_ASSERT_EQUAL_INT(1700, app_schedule_evaluate(&table, &time, 1900, 1, 180, &preheating));
+  TEST_ASSERT(!preheating);
+
+  time = at(2, 4, 30);
+  TEST_ASSERT_EQUAL_INT(2100, app_schedule_evaluate(&table, &time, 1900, 1, 180, &preheating));
+  TEST_ASSERT(preheating);
+
+  // a faster room starts later
+  preheating = false;
+  time = at(2, 5, 29);
+  TEST_ASSERT_EQUAL_INT(1700, app_schedule_evaluate(&table, &time, 1900, 4, 180, &preheating));
+  time = at(2, 6, 0);
+  TEST_ASSERT_EQUAL_INT(2100, app_schedule_evaluate(&table, &time, 1900, 4, 180, &preheating));
+
+  // never earlier than the longest preheat
+  preheating = false;
+  time = at(2, 3, 29);
+  TEST_ASSERT_EQUAL_INT(1700, app_schedule_evaluate(&table, &time, 1000, 1, 180, &preheating));
+  time = at(2, 3, 30);
+  TEST_ASSERT_EQUAL_INT(2100, app_schedule_evaluate(&table, &time, 1000, 1, 180, &preheating));
+
+  // no preheat for lower targets
+  preheating = false;
+  time = at(2, 21, 59);
+  TEST_ASSERT_EQUAL_INT(2100, app_schedule_evaluate(&table, &time, 1500, 1, 180, &preheating));
+  TEST_ASSERT(!preheating);
+}
+
+
+
+static void test_preheat_holds_until_its_slot(void) {
+  TEST_ASSERT(app_schedule_compile(&schedule, &table));
+  bool preheating = false;
+
+  // estimated at 1 °C/h from 18 °C, the room actually heats at 3 °C/h
+  struct tm time = at(2, 3, 30);
+  TEST_ASSERT_EQUAL_INT(2100, app_schedule_evaluate(&table, &time, 1800, 1, 180, &preheating));
+  TEST_ASSERT(preheating);
+
+  for (int min = 3 * 60 + 31; min < 6 * 60 + 30; min++) {
+    const int rise_cdeg = (min - (3 * 60 + 30)) * 5;
+    const int16_t current_cdeg = (rise_cdeg < 300) ? 1800 + rise_cdeg : 2100;
+    time = at(2, min / 60, min % 60);
+    TEST_ASSERT_EQUAL_INT(2100, app_schedule_evaluate(&table, &time, current_cdeg, 1, 180, &preheating));
+    TEST_ASSERT(preheating);
+  }
+
+  // the slot began, its target holds without preheating
+  time = at(2, 6, 30);
+  TEST_ASSERT_EQUAL_INT(2100, app_schedule_evaluate(&table, &time, 2100, 1, 180, &preheating));
+  TEST_ASSERT(!preheating);
+}
+
+
+
+int main(void) {
+  RUN_TEST(test_empty_schedule_is_disabled);
+  RUN_TEST(test_targets_hold_until_the_next_entry);
+  RUN_TEST(test_wraps_around_the_week);
+  RUN_TEST(test_constant_schedule);
+  RUN_TEST(test_optimal_start);
+  RUN_TEST(test_preheat_holds_until_its_slot);
+
+  return TEST_EXIT();
+}
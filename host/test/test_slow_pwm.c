@@ -0,0 +1,485 @@
+#include "esp_log.h"
+#include "host_fakes.h"
+
+#include "slow_pwm.h"
+
+#include "./test.h"
+
+
+#define GPIO 4
+#define GPIO_TICKS 5
+#define GPIO_LEDC 6
+#define GPIO_LEDC_2 7
+#define GPIO_GROUP 8
+#define CYCLE_US (10 * 1000 * 1000LL)
+#define TICK_US (CYCLE_US / 100)
+
+
+static slow_pwm_t * pwm = NULL;
+
+
+
+static int64_t high_us_over(int cycles) {
+  const int64_t start = fake_gpio_high_us(GPIO);
+  fake_advance(cycles * CYCLE_US);
+  return fake_gpio_high_us(GPIO) - start;
+}
+
+
+
+static void test_duty_sets_on_time(void) {
+  TEST_ASSERT_INT_WITHIN(TICK_US, 10 * CYCLE_US / 4, high_us_over(10));
+}
+
+
+
+static void test_full_duty_stays_on(void) {
+  set_pwm_duty(pwm, 100);
+  fake_advance(CYCLE_US);
+
+  const uint32_t edges = fake_gpio_edges(GPIO);
+  TEST_ASSERT_EQUAL_INT(3 * CYCLE_US, high_us_over(3));
+  TEST_ASSERT_EQUAL_INT(edges, fake_gpio_edges(GPIO));
+}
+
+
+
+static void test_zero_duty_stays_off(void) {
+  set_pwm_duty(pwm, 0);
+  fake_advance(CYCLE_US);
+
+  TEST_ASSERT_EQUAL_INT(0, high_us_over(3));
+}
+
+
+
+static void test_two_edges_per_cycle(void) {
+  set_pwm_duty(pwm, 50);
+  fake_advance(CYCLE_US);
+
+  const uint32_t edges = fake_gpio_edges(GPIO);
+  fake_advance(5 * CYCLE_US);
+  TEST_ASSERT_EQUAL_INT(edges + 10, fake_gpio_edges(GPIO));
+}
+
+
+
+static void test_edges_wake_at_most_twice_per_cycle(void) {
+  const uint32_t callbacks = fake_timer_callbacks();
+  fake_advance(10 * CYCLE_US);
+  TEST_ASSERT_EQUAL_INT(callbacks + 20, fake_timer_callbacks());
+
+  set_pwm_duty(pwm, 100);
+  fake_advance(CYCLE_US);
+  const uint32_t full = fake_timer_callbacks();
+  fake_advance(10 * CYCLE_US);
+  TEST_ASSERT_EQUAL_INT(full + 10, fake_timer_callbacks());
+}
+
+
+
+static void test_duty_applies_from_the_next_cycle(void) {
+  set_pwm_duty(pwm, 25);
+  fake_advance(CYCLE_US);
+
+  fake_advance(CYCLE_US / 10);
+  set_pwm_duty(pwm, 75);
+  const int64_t start = fake_gpio_high_us(GPIO);
+  fake_advance(CYCLE_US - CYCLE_US / 10);
+  TEST_ASSERT_EQUAL_INT(CYCLE_US / 4 - CYCLE_US / 10, fake_gpio_high_us(GPIO) - start);
+
+  TEST_ASSERT_EQUAL_INT(3 * CYCLE_US / 4, high_us_over(1));
+}
+
+
+
+static void test_lower_duty_moves_the_off_edge(void) {
+  set_pwm_duty(pwm, 75);
+  fake_advance(CYCLE_US);
+
+  // off at the lower duty within the same cycle
+  fake_advance(CYCLE_US / 10);
+  int64_t start = fake_gpio_high_us(GPIO);
+  set_pwm_duty(pwm, 50);
+  fake_advance(CYCLE_US - CYCLE_US / 10);
+  TEST_ASSERT_EQUAL_INT(CYCLE_US / 2 - CYCLE_US / 10, fake_gpio_high_us(GPIO) - start);
+
+  // off right away once the lower duty has passed
+  fake_advance(CYCLE_US / 5);
+  start = fake_gpio_high_us(GPIO);
+  set_pwm_duty(pwm, 10);
+  fake_advance(CYCLE_US - CYCLE_US / 5);
+  TEST_ASSERT_EQUAL_INT(0, fake_gpio_high_us(GPIO) - start);
+
+  TEST_ASSERT_EQUAL_INT(CYCLE_US / 10, high_us_over(1));
+}
+
+
+
+static void test_ticks_mode(void) {
+  slow_pwm_t * ticks = start_pwm_mode(CYCLE_US, 100, 30, GPIO_TICKS, SLOW_PWM_MODE_TICKS);
+  set_pwm_duty(pwm, 0);
+  fake_advance(CYCLE_US);
+
+  const uint32_t callbacks = fake_timer_callbacks();
+  const int64_t start = fake_gpio_high_us(GPIO_TICKS);
+  fake_advance(3 * CYCLE_US);
+
+  TEST_ASSERT_INT_WITHIN(TICK_US, 3 * CYCLE_US * 30 / 100, fake_gpio_high_us(GPIO_TICKS) - start);
+  // a wakeup per tick, and one per cycle of the edges scheduled output
+  TEST_ASSERT_EQUAL_INT(callbacks + 3 * 100 + 3, fake_timer_callbacks());
+
+  // a higher duty switches within the current cycle
+  fake_advance(CYCLE_US / 10);
+  set_pwm_duty(ticks, 60);
+  const int64_t raised = fake_gpio_high_us(GPIO_TICKS);
+  fake_advance(CYCLE_US);
+  TEST_ASSERT_INT_WITHIN(TICK_US, CYCLE_US * 60 / 100, fake_gpio_high_us(GPIO_TICKS) - raised);
+  stop_pwm(ticks);
+}
+
+
+
+static void test_ledc_reports_the_achieved_cycle(void) {
+  slow_pwm_t * ledc = start_pwm_mode(CYCLE_US, 100, 25, GPIO_LEDC, SLOW_PWM_MODE_LEDC);
+
+  slow_pwm_info_t info;
+  get_pwm_info(ledc, &info);
+  TEST_ASSERT_EQUAL_INT(SLOW_PWM_MODE_LEDC, info.mode);
+  TEST_ASSERT_EQUAL_INT(1 << 20, info.resolution);
+  // the divider rounds to 1/256, of 2^20 counts
+  TEST_ASSERT_INT_WITHIN(2048, CYCLE_US, info.period_us);
+  TEST_ASSERT_INT_WITHIN(1, fake_ledc_period_us(LEDC_LOW_SPEED_MODE, LEDC_TIMER_2), info.period_us);
+  TEST_ASSERT_EQUAL_INT(3, ledc->ledc_channel);
+  TEST_ASSERT_EQUAL_INT(info.resolution / 4, ledc_get_duty(LEDC_LOW_SPEED_MODE, ledc->ledc_channel));
+
+  set_pwm_duty(ledc, 100);
+  TEST_ASSERT_EQUAL_INT(info.resolution, ledc_get_duty(LEDC_LOW_SPEED_MODE, ledc->ledc_channel));
+  set_pwm_duty(ledc, 33);
+  TEST_ASSERT_EQUAL_INT(info.resolution * 33 / 100, ledc_get_duty(LEDC_LOW_SPEED_MODE, ledc->ledc_channel));
+
+  stop_pwm(ledc);
+  TEST_ASSERT_EQUAL_INT(0, ledc_get_duty(LEDC_LOW_SPEED_MODE, 3));
+}
+
+
+
+static void test_ledc_needs_no_wakeups(void) {
+  set_pwm_duty(pwm, 0);
+  fake_advance(CYCLE_US);
+
+  slow_pwm_t * ledc = start_pwm_mode(CYCLE_US, 100, 50, GPIO_LEDC, SLOW_PWM_MODE_LEDC);
+  const uint32_t callbacks = fake_timer_callbacks();
+  fake_advance(3 * CYCLE_US);
+  // only the cycle starts of the edges scheduled output
+  TEST_ASSERT_EQUAL_INT(callbacks + 3, fake_timer_callbacks());
+  stop_pwm(ledc);
+}
+
+
+
+static void test_ledc_shares_the_timer(void) {
+  slow_pwm_t * first = start_pwm_mode(CYCLE_US, 100, 10, GPIO_LEDC, SLOW_PWM_MODE_LEDC);
+  slow_pwm_t * second = start_pwm_mode(CYCLE_US, 100, 20, GPIO_LEDC_2, SLOW_PWM_MODE_LEDC);
+  slow_pwm_t * other = start_pwm_mode(2 * CYCLE_US, 100, 20, GPIO_TICKS, SLOW_PWM_MODE_LEDC);
+
+  slow_pwm_info_t info;
+  get_pwm_info(second, &info);
+  TEST_ASSERT_EQUAL_INT(SLOW_PWM_MODE_LEDC, info.mode);
+  TEST_ASSERT_EQUAL_INT(4, second->ledc_channel);
+  // the timer runs the first cycle length only
+  get_pwm_info(other, &info);
+  TEST_ASSERT_EQUAL_INT(SLOW_PWM_MODE_EDGES, info.mode);
+  TEST_ASSERT_EQUAL_INT(2 * CYCLE_US, info.period_us);
+
+  stop_pwm(other);
+  stop_pwm(second);
+  stop_pwm(first);
+}
+
+
+
+static void test_ledc_falls_back_out_of_reach(void) {
+  // 2^20 counts of at most 1024 us
+  slow_pwm_t * ledc = start_pwm_mode(1100 * 1000 * 1000LL, 100, 10, GPIO_LEDC, SLOW_PWM_MODE_LEDC);
+
+  slow_pwm_info_t info;
+  get_pwm_info(ledc, &info);
+  TEST_ASSERT_EQUAL_INT(SLOW_PWM_MODE_EDGES, info.mode);
+  stop_pwm(ledc);
+
+  // fewer counts for short cycles
+  ledc = start_pwm_mode(1000 * 1000, 100, 10, GPIO_LEDC, SLOW_PWM_MODE_LEDC);
+  get_pwm_info(ledc, &info);
+  TEST_ASSERT_EQUAL_INT(SLOW_PWM_MODE_LEDC, info.mode);
+  TEST_ASSERT_EQUAL_INT(1 << 19, info.resolution);
+  TEST_ASSERT_INT_WITHIN(1024, 1000 * 1000, info.period_us);
+  stop_pwm(ledc);
+}
+
+
+
+static void test_group_staggers_switch_on(void) {
+  slow_pwm_group_t * group = start_pwm_group(CYCLE_US, 100, 3);
+  slow_pwm_t * channels[3];
+  for (int i = 0; i < 3; i++) {
+    channels[i] = start_pwm_channel(group, 20, GPIO_GROUP + i);
+    TEST_ASSERT_EQUAL_INT(i, channels[i]->slot);
+  }
+
+  // on at a third of the cycle apart, each for a fifth of it
+  uint32_t edges[3];
+  for (int i = 0; i < 3; i++) {
+    edges[i] = fake_gpio_edges(GPIO_GROUP + i);
+  }
+  fake_advance(CYCLE_US / 3 - TICK_US);
+  TEST_ASSERT_EQUAL_INT(edges[0] + 2, fake_gpio_edges(GPIO_GROUP));
+  TEST_ASSERT_EQUAL_INT(edges[1], fake_gpio_edges(GPIO_GROUP + 1));
+  fake_advance(2 * TICK_US);
+  TEST_ASSERT_EQUAL_INT(edges[1] + 1, fake_gpio_edges(GPIO_GROUP + 1));
+  TEST_ASSERT_EQUAL_INT(edges[2], fake_gpio_edges(GPIO_GROUP + 2));
+  fake_advance(CYCLE_US / 3);
+  TEST_ASSERT_EQUAL_INT(edges[2] + 1, fake_gpio_edges(GPIO_GROUP + 2));
+
+  fake_advance(CYCLE_US);
+  int64_t high[3];
+  for (int i = 0; i < 3; i++) {
+    high[i] = fake_gpio_high_us(GPIO_GROUP + i);
+  }
+  fake_advance(3 * CYCLE_US);
+  for (int i = 0; i < 3; i++) {
+    TEST_ASSERT_EQUAL_INT(3 * CYCLE_US / 5, fake_gpio_high_us(GPIO_GROUP + i) - high[i]);
+  }
+
+  stop_pwm_group(group);
+}
+
+
+
+static void test_group_wakes_once_per_edge(void) {
+  set_pwm_duty(pwm, 0);
+  fake_advance(CYCLE_US);
+
+  slow_pwm_group_t * group = start_pwm_group(CYCLE_US, 100, 2);
+  slow_pwm_t * first = start_pwm_channel(group, 25, GPIO_GROUP);
+  slow_pwm_t * second = start_pwm_channel(group, 25, GPIO_GROUP + 1);
+  fake_advance(CYCLE_US);
+
+  // four edges per cycle, and the cycle start of the edges scheduled output
+  uint32_t callbacks = fake_timer_callbacks();
+  fake_advance(3 * CYCLE_US);
+  TEST_ASSERT_EQUAL_INT(callbacks + 3 * (4 + 1), fake_timer_callbacks());
+
+  // every off edge is the on edge of the other channel
+  set_pwm_duty(first, 50);
+  set_pwm_duty(second, 50);
+  fake_advance(CYCLE_US);
+  callbacks = fake_timer_callbacks();
+  fake_advance(3 * CYCLE_US);
+  TEST_ASSERT_EQUAL_INT(callbacks + 3 * (2 + 1), fake_timer_callbacks());
+
+  // a lower duty switches off within the cycle
+  fake_advance(CYCLE_US / 10);
+  const int64_t start = fake_gpio_high_us(GPIO_GROUP);
+  set_pwm_duty(first, 25);
+  fake_advance(CYCLE_US - CYCLE_US / 10);
+  TEST_ASSERT_EQUAL_INT(CYCLE_US / 4 - CYCLE_US / 10, fake_gpio_high_us(GPIO_GROUP) - start);
+
+  stop_pwm_group(group);
+}
+
+
+
+static void test_group_slots_run_out(void) {
+  slow_pwm_group_t * group = start_pwm_group(CYCLE_US, 100, 1);
+  slow_pwm_t * first = start_pwm_channel(group, 50, GPIO_GROUP);
+  TEST_ASSERT(start_pwm_channel(group, 50, GPIO_GROUP + 1) == NULL);
+
+  stop_pwm(first);
+  TEST_ASSERT_EQUAL_INT(0, gpio_get_level(GPIO_GROUP));
+  slow_pwm_t * second = start_pwm_channel(group, 50, GPIO_GROUP + 1);
+  TEST_ASSERT(second != NULL);
+
+  const int64_t stopped = fake_gpio_high_us(GPIO_GROUP);
+  const int64_t started = fake_gpio_high_us(GPIO_GROUP + 1);
+  fake_advance(2 * CYCLE_US);
+  TEST_ASSERT_EQUAL_INT(stopped, fake_gpio_high_us(GPIO_GROUP));
+  TEST_ASSERT_EQUAL_INT(CYCLE_US, fake_gpio_high_us(GPIO_GROUP + 1) - started);
+
+  stop_pwm_group(group);
+}
+
+
+
+static void test_jitter_counts_late_edges(void) {
+  set_pwm_duty(pwm, 50);
+  fake_advance(CYCLE_US);
+
+  reset_pwm_jitter();
+  fake_advance(3 * CYCLE_US);
+  slow_pwm_jitter_t jitter;
+  get_pwm_jitter(&jitter);
+  TEST_ASSERT_EQUAL_INT(6, jitter.edges);
+  TEST_ASSERT_EQUAL_INT(0, jitter.max_us);
+  TEST_ASSERT_EQUAL_INT(6, jitter.histogram[0]);
+
+  // 300 us late, bucket 256 to 511 us
+  fake_timer_latency(300);
+  reset_pwm_jitter();
+  const int64_t start = fake_gpio_high_us(GPIO);
+  fake_advance(3 * CYCLE_US);
+  get_pwm_jitter(&jitter);
+  fake_timer_latency(0);
+
+  TEST_ASSERT_EQUAL_INT(6, jitter.edges);
+  TEST_ASSERT_EQUAL_INT(300, jitter.max_us);
+  TEST_ASSERT_EQUAL_INT(6, jitter.histogram[9]);
+  // both edges late alike, the edges stay scheduled from the cycle start
+  TEST_ASSERT_EQUAL_INT(3 * CYCLE_US / 2, fake_gpio_high_us(GPIO) - start);
+}
+
+
+
+static void test_jitter_of_ticks(void) {
+  set_pwm_duty(pwm, 0);
+  fake_advance(CYCLE_US);
+
+  slow_pwm_t * ticks = start_pwm_mode(CYCLE_US, 100, 30, GPIO_TICKS, SLOW_PWM_MODE_TICKS);
+  fake_timer_latency(20);
+  reset_pwm_jitter();
+  fake_advance(CYCLE_US);
+  fake_timer_latency(0);
+
+  slow_pwm_jitter_t jitter;
+  get_pwm_jitter(&jitter);
+  // the ticks and the cycle start of the edges scheduled output
+  TEST_ASSERT_EQUAL_INT(100 + 1, jitter.edges);
+  TEST_ASSERT_EQUAL_INT(20, jitter.max_us);
+  stop_pwm(ticks);
+}
+
+
+
+static void test_start_is_no_late_edge(void) {
+  fake_timer_latency(20);
+  reset_pwm_jitter();
+  slow_pwm_t * edges = start_pwm_mode(CYCLE_US, 100, 30, GPIO_TICKS, SLOW_PWM_MODE_EDGES);
+
+  slow_pwm_jitter_t jitter;
+  get_pwm_jitter(&jitter);
+  TEST_ASSERT_EQUAL_INT(0, jitter.edges);
+  fake_timer_latency(0);
+  stop_pwm(edges);
+}
+
+
+
+static void test_resolution_out_of_range(void) {
+  // a full duty in 1/65536 of a step would overflow
+  TEST_ASSERT(start_pwm_mode(CYCLE_US, 65536, 0, GPIO_TICKS, SLOW_PWM_MODE_EDGES) == NULL);
+  TEST_ASSERT(start_pwm_mode(CYCLE_US, 0, 0, GPIO_TICKS, SLOW_PWM_MODE_TICKS) == NULL);
+  TEST_ASSERT(start_pwm_group(CYCLE_US, 65536, 2) == NULL);
+
+  slow_pwm_t * finest = start_pwm_mode(CYCLE_US, 65535, 65535, GPIO_TICKS, SLOW_PWM_MODE_EDGES);
+  TEST_ASSERT(finest != NULL);
+  stop_pwm(finest);
+}
+
+
+
+static void test_fraction_is_carried_over(void) {
+  // 37.4 %, between the steps of 37 and 38 %
+  const uint32_t duty_q16 = 24510;
+  set_pwm_duty_q16(pwm, duty_q16);
+  fake_advance(CYCLE_US);
+
+  const uint32_t callbacks = fake_timer_callbacks();
+  const int64_t start = fake_gpio_high_us(GPIO);
+  fake_advance(50 * CYCLE_US);
+
+  // delivered to within a step, without more wakeups
+  TEST_ASSERT_INT_WITHIN(TICK_US, 50 * CYCLE_US * duty_q16 / 65536, fake_gpio_high_us(GPIO) - start);
+  TEST_ASSERT_EQUAL_INT(callbacks + 2 * 50, fake_timer_callbacks());
+
+  // set again within every on phase, it still is
+  fake_advance(pwm->cycle_start_us + CYCLE_US - esp_timer_get_time());
+  const int64_t again = fake_gpio_high_us(GPIO);
+  for (int cycle = 0; cycle < 50; cycle++) {
+    fake_advance(CYCLE_US / 10);
+    set_pwm_duty_q16(pwm, duty_q16);
+    fake_advance(CYCLE_US - CYCLE_US / 10);
+  }
+  TEST_ASSERT_INT_WITHIN(TICK_US, 50 * CYCLE_US * duty_q16 / 65536, fake_gpio_high_us(GPIO) - again);
+
+  // whole steps stay exact
+  set_pwm_duty_q16(pwm, 65536 / 4);
+  fake_advance(CYCLE_US);
+  TEST_ASSERT_EQUAL_INT(3 * CYCLE_US / 4, high_us_over(3));
+}
+
+
+
+static void test_burst_switches_whole_cycles(void) {
+  TEST_ASSERT(set_pwm_modulation(pwm, SLOW_PWM_MODULATION_BURST));
+  set_pwm_duty(pwm, 25);
+  fake_advance(CYCLE_US);
+
+  const uint32_t edges = fake_gpio_edges(GPIO);
+  TEST_ASSERT_EQUAL_INT(2 * CYCLE_US, high_us_over(8));
+  // a cycle on in every four
+  TEST_ASSERT_EQUAL_INT(edges + 4, fake_gpio_edges(GPIO));
+
+  set_pwm_duty(pwm, 100);
+  fake_advance(CYCLE_US);
+  TEST_ASSERT_EQUAL_INT(3 * CYCLE_US, high_us_over(3));
+
+  TEST_ASSERT(set_pwm_modulation(pwm, SLOW_PWM_MODULATION_PWM));
+  set_pwm_duty(pwm, 25);
+  // after the duty the bursts still owe
+  fake_advance(2 * CYCLE_US);
+  TEST_ASSERT_EQUAL_INT(CYCLE_US / 4, high_us_over(1));
+}
+
+
+
+static void test_ledc_cannot_burst(void) {
+  slow_pwm_t * ledc = start_pwm_mode(CYCLE_US, 100, 0, GPIO_LEDC, SLOW_PWM_MODE_LEDC);
+  TEST_ASSERT(!set_pwm_modulation(ledc, SLOW_PWM_MODULATION_BURST));
+
+  // the hardware takes the fraction
+  set_pwm_duty_q16(ledc, 24510);
+  TEST_ASSERT_INT_WITHIN(16, (1 << 20) * 24510ULL / 65536, ledc_get_duty(LEDC_LOW_SPEED_MODE, ledc->ledc_channel));
+  stop_pwm(ledc);
+}
+
+
+
+int main(void) {
+  esp_log_level_set("*", ESP_LOG_WARN);
+  pwm = start_pwm(CYCLE_US, 100, 25, GPIO);
+
+  RUN_TEST(test_duty_sets_on_time);
+  RUN_TEST(test_full_duty_stays_on);
+  RUN_TEST(test_zero_duty_stays_off);
+  RUN_TEST(test_two_edges_per_cycle);
+  RUN_TEST(test_edges_wake_at_most_twice_per_cycle);
+  RUN_TEST(test_duty_applies_from_the_next_cycle);
+  RUN_TEST(test_lower_duty_moves_the_off_edge);
+  RUN_TEST(test_ticks_mode);
+  RUN_TEST(test_ledc_reports_the_achieved_cycle);
+  RUN_TEST(test_ledc_needs_no_wakeups);
+  RUN_TEST(test_ledc_shares_the_timer);
+  RUN_TEST(test_ledc_falls_back_out_of_reach);
+  RUN_TEST(test_group_staggers_switch_on);
+  RUN_TEST(test_group_wakes_once_per_edge);
+  RUN_TEST(test_group_slots_run_out);
+  RUN_TEST(test_jitter_counts_late_edges);
+  RUN_TEST(test_jitter_of_ticks);
+  RUN_TEST(test_start_is_no_late_edge);
+  RUN_TEST(test_resolution_out_of_range);
+  RUN_TEST(test_fraction_is_carried_over);
+  RUN_TEST(test_burst_switches_whole_cycles);
+  RUN_TEST(test_ledc_cannot_burst);
+
+  return TEST_EXIT();
+}
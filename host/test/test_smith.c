@@ -0,0 +1,126 @@
+#include <math.h>
+#include <stdbool.h>
+
+#include "app_smith.h"
+
+#include "./test.h"
+
+
+#define DT_MS (30 * 1000)
+#define TICKS_PER_HOUR (3600 * 1000 / DT_MS)
+
+// the simulated room, per tick
+#define GAIN 0.0004f
+#define LOSS 0.0005f
+#define AMBIENT 15.0f
+#define DEAD_TIME 10
+
+
+typedef struct {
+  float temp;
+  uint8_t pipe[DEAD_TIME + 1];
+} room_t;
+
+
+
+static float step_room(room_t * room, uint8_t duty) {
+  for (int i = DEAD_TIME; i > 0; i--) {
+    room->pipe[i] = room->pipe[i - 1];
+  }
+  room->pipe[0] = duty;
+
+  room->temp += GAIN * room->pipe[DEAD_TIME] - LOSS * (room->temp - AMBIENT);
+  return room->temp;
+}
+
+
+
+static app_smith_t matched_smith(void) {
+  app_smith_t smith;
+  app_smith_init(&smith, DT_MS);
+  app_smith_set_plant(&smith, GAIN * TICKS_PER_HOUR, LOSS * TICKS_PER_HOUR, DEAD_TIME * DT_MS / 1000);
+  return smith;
+}
+
+
+
+static void test_without_heat_predicts_the_measurement(void) {
+  app_smith_t smith = matched_smith();
+
+  for (int k = 0; k < 20; k++) {
+    app_smith_update(&smith, 0);
+  }
+  TEST_ASSERT_FLOAT_WITHIN(0, 20.5, app_smith_predict(&smith, 20.5));
+}
+
+
+
+static void test_predicts_the_sensor_a_dead_time_ahead(void) {
+  app_smith_t smith = matched_smith();
+  room_t room = { .temp = AMBIENT };
+
+  float predicted[100];
+  float measured[100 + DEAD_TIME];
+  for (int k = 0; k < 100 + DEAD_TIME; k++) {
+    const uint8_t duty = (k / 25) % 2 ? 10 : 90;
+    measured[k] = step_room(&room, duty);
+    app_smith_update(&smith, duty);
+    if (k < 100) {
+      predicted[k] = app_smith_predict(&smith, measured[k]);
+    }
+  }
+
+  for (int k = 0; k < 100; k++) {
+    TEST_ASSERT_FLOAT_WITHIN(0.001, measured[k + DEAD_TIME], predicted[k]);
+  }
+}
+
+
+
+static void test_dead_time_is_limited(void) {
+  app_smith_t smith;
+  app_smith_init(&smith, DT_MS);
+  app_smith_set_plant(&smith, 1, 1, 3600);
+  TEST_ASSERT_EQUAL_INT(APP_SMITH_MAX_DEAD_TICKS, smith.dead_ticks);
+}
+
+
+
+// on/off control to 21 °C from a cold room, returns the overshoot
+static float overshoot(bool compensate) {
+  app_smith_t smith = matched_smith();
+  room_t room = { .temp = 18 };
+  float temp = room.temp;
+  float max_temp = temp;
+
+  for (int k = 0; k < 12 * TICKS_PER_HOUR; k++) {
+    const float control = compensate ? app_smith_predict(&smith, temp) : temp;
+    const uint8_t duty = (control < 21) ? 100 : 0;
+
+    temp = step_room(&room, duty);
+    app_smith_update(&smith, duty);
+    max_temp = fmaxf(max_temp, temp);
+  }
+  return max_temp - 21;
+}
+
+
+
+static void test_reduces_overshoot(void) {
+  const float plain = overshoot(false);
+  const float compensated = overshoot(true);
+
+  TEST_ASSERT(plain > 0.2);
+  TEST_ASSERT(compensated < plain / 4);
+}
+
+
+
+int main(void) {
+  RUN_TEST(test_without_heat_predicts_the_measurement);
+  RUN_TEST(test_predicts_the_sensor_a_dead_time_ahead);
+  RUN_TEST(test_dead_time_is_limited);
+  RUN_TEST(test_reduces_overshoot);
+
+  return TEST_EXIT();
+}
@@ -0,0 +1,134 @@
+#include "esp_log.h"
+#include "host_fakes.h"
+
+#include "app_events.h"
+#include "app_state.h"
+
+#include "./test.h"
+
+
+typedef struct {
+  uint32_t calls;
+  uint32_t changed;
+  app_state_t state;
+} subscriber_t;
+
+
+static subscriber_t heat_sub = {0};
+static subscriber_t temps_sub = {0};
+
+
+
+static void record(void * arg, uint32_t changed, const app_state_t * state) {
+  subscriber_t * sub = (subscriber_t *) arg;
+  sub->calls += 1;
+  sub->changed = changed;
+  sub->state = *state;
+}
+
+
+
+static app_state_t state = {
+  .temp_state = APP_STATE_TEMP_OK,
+  .current_temp = 20,
+  .target_temp = 21,
+  .current_humid = 40,
+  .heat = 10,
+};
+
+
+
+static void test_first_publish_reports_all_fields(void) {
+  TEST_ASSERT_EQUAL_INT(APP_STATE_FIELD_ALL, app_state_publish(&state));
+  fake_event_loops_run();
+
+  TEST_ASSERT_EQUAL_INT(1, heat_sub.calls);
+  TEST_ASSERT_EQUAL_INT(APP_STATE_FIELD_HEAT, heat_sub.changed);
+  TEST_ASSERT_EQUAL_INT(10, heat_sub.state.heat);
+
+  TEST_ASSERT_EQUAL_INT(1, temps_sub.calls);
+  TEST_ASSERT_EQUAL_INT(APP_STATE_FIELD_CURRENT_TEMP | APP_STATE_FIELD_CURRENT_HUMID, temps_sub.changed);
+}
+
+
+
+static void test_unchanged_state_notifies_nobody(void) {
+  TEST_ASSERT_EQUAL_INT(0, app_state_publish(&state));
+  TEST_ASSERT_EQUAL_INT(0, fake_event_loops_run());
+
+  TEST_ASSERT_EQUAL_INT(1, heat_sub.calls);
+  TEST_ASSERT_EQUAL_INT(1, temps_sub.calls);
+}
+
+
+
+static void test_only_subscribers_of_changed_fields_are_called(void) {
+  state.current_humid = 45;
+  TEST_ASSERT_EQUAL_INT(APP_STATE_FIELD_CURRENT_HUMID, app_state_publish(&state));
+  fake_event_loops_run();
+
+  TEST_ASSERT_EQUAL_INT(1, heat_sub.calls);
+  TEST_ASSERT_EQUAL_INT(2, temps_sub.calls);
+  TEST_ASSERT_EQUAL_INT(APP_STATE_FIELD_CURRENT_HUMID, temps_sub.changed);
+  TEST_ASSERT_FLOAT_WITHIN(0, 45, temps_sub.state.current_humid);
+}
+
+
+
+static void test_coalesced_changes_are_merged(void) {
+  state.heat = 50;
+  app_state_publish(&state);
+  state.current_temp = 19;
+  app_state_publish(&state);
+  state.current_humid = 46;
+  app_state_publish(&state);
+  fake_event_loops_run();
+
+  TEST_ASSERT_EQUAL_INT(2, heat_sub.calls);
+  TEST_ASSERT_EQUAL_INT(APP_STATE_FIELD_HEAT, heat_sub.changed);
+  TEST_ASSERT_EQUAL_INT(50, heat_sub.state.heat);
+
+  TEST_ASSERT_EQUAL_INT(3, temps_sub.calls);
+  TEST_ASSERT_EQUAL_INT(APP_STATE_FIELD_CURRENT_TEMP | APP_STATE_FIELD_CURRENT_HUMID, temps_sub.changed);
+  TEST_ASSERT_FLOAT_WITHIN(0, 19, temps_sub.state.current_temp);
+  TEST_ASSERT_FLOAT_WITHIN(0, 46, temps_sub.state.current_humid);
+}
+
+
+
+static void test_snapshot_versions_increase(void) {
+  app_state_t snapshot;
+  const uint32_t version = app_state_get(0, &snapshot);
+
+  state.target_temp = 22;
+  app_state_publish(&state);
+  fake_event_loops_run();
+
+  uint32_t next_version;
+  TEST_ASSERT_TRUE(app_state_try_get(0, &snapshot, &next_version));
+  TEST_ASSERT_EQUAL_INT(version + 2, next_version);
+  TEST_ASSERT_FLOAT_WITHIN(0, 22, snapshot.target_temp);
+}
+
+
+
+int main(void) {
+  esp_log_level_set("*", ESP_LOG_WARN);
+  app_start_event_loops();
+
+  app_state_subscribe(APP_EVENT_LOOP_CONTROL, APP_STATE_FIELD_HEAT, record, &heat_sub);
+  app_state_subscribe(
+    APP_EVENT_LOOP_TELEMETRY,
+    APP_STATE_FIELD_CURRENT_TEMP | APP_STATE_FIELD_CURRENT_HUMID,
+    record,
+    &temps_sub
+  );
+
+  RUN_TEST(test_first_publish_reports_all_fields);
+  RUN_TEST(test_unchanged_state_notifies_nobody);
+  RUN_TEST(test_only_subscribers_of_changed_fields_are_called);
+  RUN_TEST(test_coalesced_changes_are_merged);
+  RUN_TEST(test_snapshot_versions_increase);
+
+  return TEST_EXIT();
+}
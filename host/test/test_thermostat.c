@@ -0,0 +1,374 @@
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "nvs.h"
+#include "host_fakes.h"
+
+#include "app_events.h"
+#include "app_state.h"
+#include "app_thermostat.h"
+#include "app_trace.h"
+
+#include "./test.h"
+
+
+#define GPIO_PWM 25
+#define GPIO_PWM_ZONE_1 26
+#define HEAT_MIN 10
+#define HEAT_NORMAL 50
+#define HEAT_MAX 100
+#define CYCLE_SEC 60
+
+
+
+static app_state_t get_state(void) {
+  app_state_t state;
+  app_state_get(0, &state);
+  return state;
+}
+
+
+
+static void post_current_temp(float temp) {
+  app_traced_temp_t data = { .temp = temp };
+  app_post_current_temp_changed(&data);
+  fake_event_loops_run();
+}
+
+
+
+static void post_target_temp(float temp) {
+  app_traced_temp_t data = { .temp = temp };
+  app_post_target_temp_changed(&data);
+  fake_event_loops_run();
+}
+
+
+
+static void post_sensor_error(bool err) {
+  app_zone_flag_t data = { .value = err };
+  app_post_temp_read_state(&data);
+  fake_event_loops_run();
+}
+
+
+
+static void test_starts_with_min_heat(void) {
+  app_state_t state = get_state();
+
+  TEST_ASSERT_EQUAL_INT(HEAT_MIN, state.heat);
+  TEST_ASSERT_FLOAT_WITHIN(0, 21, state.target_temp);
+  TEST_ASSERT_EQUAL_INT(APP_STATE_TEMP_OK, state.temp_state);
+}
+
+
+
+static void test_heat_follows_temperature(void) {
+  post_current_temp(19.5);
+  TEST_ASSERT_EQUAL_INT(HEAT_MAX, get_state().heat);
+
+  post_current_temp(20.5);
+  TEST_ASSERT_EQUAL_INT(HEAT_NORMAL, get_state().heat);
+
+  post_current_temp(21.5);
+  TEST_ASSERT_EQUAL_INT(HEAT_MIN, get_state().heat);
+
+  post_current_temp(20);
+  TEST_ASSERT_EQUAL_INT(HEAT_MAX, get_state().heat);
+}
+
+
+
+static void test_sensor_error_falls_back_to_min_heat(void) {
+  post_current_temp(19);
+  TEST_ASSERT_EQUAL_INT(HEAT_MAX, get_state().heat);
+
+  post_sensor_error(true);
+  TEST_ASSERT_EQUAL_INT(HEAT_MIN, get_state().heat);
+  TEST_ASSERT_EQUAL_INT(APP_STATE_TEMP_ERROR, get_state().temp_state);
+
+  post_sensor_error(false);
+  TEST_ASSERT_EQUAL_INT(HEAT_MAX, get_state().heat);
+}
+
+
+
+static void test_target_temp_is_persisted(void) {
+  post_target_temp(23.5);
+  TEST_ASSERT_FLOAT_WITHIN(0, 23.5, get_state().target_temp);
+
+  nvs_handle_t handle;
+  uint32_t stored;
+  TEST_ASSERT_EQUAL_INT(ESP_OK, nvs_open("storage", NVS_READONLY, &handle));
+  TEST_ASSERT_EQUAL_INT(ESP_OK, nvs_get_u32(handle, "target_temp", &stored));
+
+  float target_temp;
+  memcpy(&target_temp, &stored, sizeof(target_temp));
+  TEST_ASSERT_FLOAT_WITHIN(0, 23.5, target_temp);
+
+  post_target_temp(21);
+}
+
+
+
+static void test_pwm_output_follows_heat(void) {
+  post_current_temp(20.5);
+  TEST_ASSERT_EQUAL_INT(HEAT_NORMAL, get_state().heat);
+  // the output takes the new duty from the next cycle
+  fake_advance(CYCLE_SEC * 1000 * 1000LL);
+
+  const int64_t start = fake_gpio_high_us(GPIO_PWM);
+  fake_advance(4 * CYCLE_SEC * 1000 * 1000LL);
+  const int64_t high_us = fake_gpio_high_us(GPIO_PWM) - start;
+
+  // within a PWM tick of the duty cycle
+  TEST_ASSERT_INT_WITHIN(CYCLE_SEC * 1000 * 1000LL / 100, 4 * CYCLE_SEC * 1000 * 1000LL / 2, high_us);
+}
+
+
+
+static void test_trace_ends_once_per_input(void) {
+  app_trace_stats_t before, after;
+  app_trace_get_stats(APP_TRACE_ORIGIN_BLE, &before);
+
+  // changed heat or not, both traces end where the heat is applied
+  app_traced_temp_t data = { .temp = 19, .trace = app_trace_begin(APP_TRACE_ORIGIN_BLE) };
+  app_post_current_temp_changed(&data);
+  fake_event_loops_run();
+
+  data = (app_traced_temp_t) { .temp = 19.5, .trace = app_trace_begin(APP_TRACE_ORIGIN_BLE) };
+  app_post_current_temp_changed(&data);
+  fake_event_loops_run();
+
+  app_trace_get_stats(APP_TRACE_ORIGIN_BLE, &after);
+  TEST_ASSERT_EQUAL_INT(before.count + 2, after.count);
+}
+
+
+
+static void test_pid_mode(void) {
+  post_current_temp(20.5);
+  TEST_ASSERT_EQUAL_INT(HEAT_NORMAL, get_state().heat);
+
+  uint8_t mode = APP_THERMOSTAT_MODE_PID;
+  app_post_controller_mode_set(&mode);
+  fake_event_loops_run();
+
+  // bumpless, inputs are only held until the next control tick
+  post_current_temp(20);
+  TEST_ASSERT_EQUAL_INT(HEAT_NORMAL, get_state().heat);
+
+  // 1 °C below the target, 40 % for kp plus the held integral
+  fake_advance(CONFIG_APP_PID_INTERVAL_SEC * 1000 * 1000LL);
+  fake_event_loops_run();
+  TEST_ASSERT_INT_WITHIN(2, HEAT_NORMAL + 40, get_state().heat);
+
+  post_sensor_error(true);
+  TEST_ASSERT_EQUAL_INT(HEAT_MIN, get_state().heat);
+  fake_advance(CONFIG_APP_PID_INTERVAL_SEC * 1000 * 1000LL);
+  fake_event_loops_run();
+  TEST_ASSERT_EQUAL_INT(HEAT_MIN, get_state().heat);
+  post_sensor_error(false);
+
+  uint8_t stored;
+  nvs_handle_t handle;
+  TEST_ASSERT_EQUAL_INT(ESP_OK, nvs_open("storage", NVS_READONLY, &handle));
+  TEST_ASSERT_EQUAL_INT(ESP_OK, nvs_get_u8(handle, "ctrl_mode", &stored));
+  TEST_ASSERT_EQUAL_INT(APP_THERMOSTAT_MODE_PID, stored);
+
+  mode = APP_THERMOSTAT_MODE_LEVELS;
+  app_post_controller_mode_set(&mode);
+  fake_event_loops_run();
+  TEST_ASSERT_EQUAL_INT(HEAT_MAX, get_state().heat);
+}
+
+
+
+static void test_held_input_ends_its_trace_at_the_control_tick(void) {
+  uint8_t mode = APP_THERMOSTAT_MODE_PID;
+  app_post_controller_mode_set(&mode);
+  fake_event_loops_run();
+
+  app_trace_stats_t before, after;
+  app_trace_get_stats(APP_TRACE_ORIGIN_BLE, &before);
+  app_traced_temp_t data = { .temp = 20.5, .trace = app_trace_begin(APP_TRACE_ORIGIN_BLE) };
+  app_post_current_temp_changed(&data);
+  fake_event_loops_run();
+
+  // the duty only follows on the next control tick
+  app_trace_get_stats(APP_TRACE_ORIGIN_BLE, &after);
+  TEST_ASSERT_EQUAL_INT(before.count, after.count);
+
+  fake_advance(CONFIG_APP_PID_INTERVAL_SEC * 1000 * 1000LL);
+  fake_event_loops_run();
+  app_trace_get_stats(APP_TRACE_ORIGIN_BLE, &after);
+  TEST_ASSERT_EQUAL_INT(before.count + 1, after.count);
+
+  mode = APP_THERMOSTAT_MODE_LEVELS;
+  app_post_controller_mode_set(&mode);
+  fake_event_loops_run();
+}
+
+
+
+static app_autotune_result_t autotune_result = {0};
+
+static void record_autotune_result(void * arg, app_event_t evt_id, const app_autotune_result_t * result) {
+  autotune_result = *result;
+}
+
+
+
+static void test_autotune_aborts_on_sensor_error(void) {
+  post_current_temp(21.1);
+
+  uint8_t zone = 0;
+  app_post_autotune_start(&zone);
+  fake_event_loops_run();
+  // the relay heats first
+  TEST_ASSERT_EQUAL_INT(HEAT_MAX, get_state().heat);
+
+  post_current_temp(21.4);
+  fake_advance(CONFIG_APP_PID_INTERVAL_SEC * 1000 * 1000LL);
+  fake_event_loops_run();
+  TEST_ASSERT_EQUAL_INT(HEAT_MIN, get_state().heat);
+
+  post_sensor_error(true);
+  TEST_ASSERT_EQUAL_INT(HEAT_MIN, get_state().heat);
+  TEST_ASSERT_EQUAL_INT(APP_AUTOTUNE_ABORTED, autotune_result.status);
+
+  // the thermostat is back in control once the sensor recovers
+  post_sensor_error(false);
+  post_current_temp(19);
+  TEST_ASSERT_EQUAL_INT(HEAT_MAX, get_state().heat);
+}
+
+
+
+static void post_outdoor_temp(float temp) {
+  app_post_outdoor_temp_changed(&temp);
+  fake_event_loops_run();
+}
+
+
+
+static void test_heat_curve_sets_the_base_heat(void) {
+  post_current_temp(20.5);
+  TEST_ASSERT_EQUAL_INT(HEAT_NORMAL, get_state().heat);
+
+  // the cold snap raises the heat before the room cools down,
+  // the curve's 83 % for a target of 21 °C at -12 °C
+  post_outdoor_temp(-12);
+  TEST_ASSERT_EQUAL_INT(83, get_state().heat);
+
+  // the levels trim the base heat
+  post_current_temp(21.5);
+  TEST_ASSERT_EQUAL_INT(83 - (HEAT_NORMAL - HEAT_MIN), get_state().heat);
+  post_current_temp(19.5);
+  TEST_ASSERT_EQUAL_INT(HEAT_MAX, get_state().heat);
+
+  post_outdoor_temp(20);
+  post_current_temp(21.5);
+  TEST_ASSERT_EQUAL_INT(HEAT_MIN, get_state().heat);
+
+  // stale outdoor readings are ignored
+  post_outdoor_temp(-12);
+  fake_advance(CONFIG_APP_HEAT_CURVE_OUTDOOR_TIMEOUT_MIN * 60 * 1000 * 1000LL + 1);
+  post_current_temp(20.5);
+  TEST_ASSERT_EQUAL_INT(HEAT_NORMAL, get_state().heat);
+}
+
+
+
+static void test_open_window_suspends_heating(void) {
+  post_current_temp(20.5);
+  TEST_ASSERT_EQUAL_INT(HEAT_NORMAL, get_state().heat);
+
+  // 0.5 °C/min, the levels alone would go to heat_max
+  for (int k = 1; k <= 3; k++) {
+    fake_advance(15 * 1000 * 1000LL);
+    post_current_temp(20.5 - k * 0.125);
+  }
+  TEST_ASSERT(get_state().window_open);
+  TEST_ASSERT_EQUAL_INT(HEAT_MIN, get_state().heat);
+
+  post_current_temp(19);
+  TEST_ASSERT_EQUAL_INT(HEAT_MIN, get_state().heat);
+
+  // heating resumes with the control tick after the suspension
+  fake_advance(CONFIG_APP_WINDOW_SUSPEND_MIN * 60 * 1000 * 1000LL);
+  fake_event_loops_run();
+  TEST_ASSERT(!get_state().window_open);
+  TEST_ASSERT_EQUAL_INT(HEAT_MAX, get_state().heat);
+}
+
+
+
+static void test_zones_are_independent(void) {
+  const app_state_t zone_0 = get_state();
+
+  app_traced_temp_t data = { .temp = 19, .zone = 1 };
+  app_post_current_temp_changed(&data);
+  fake_event_loops_run();
+
+  app_state_t zone_1;
+  TEST_ASSERT(app_state_get(1, &zone_1) != 0);
+  TEST_ASSERT_EQUAL_INT(1, zone_1.zone);
+  TEST_ASSERT_FLOAT_WITHIN(0, 19, zone_1.current_temp);
+  TEST_ASSERT_FLOAT_WITHIN(0, 20, zone_1.target_temp);
+  TEST_ASSERT_EQUAL_INT(HEAT_MAX, zone_1.heat);
+
+  TEST_ASSERT_FLOAT_WITHIN(0, zone_0.current_temp, get_state().current_temp);
+  TEST_ASSERT_EQUAL_INT(zone_0.heat, get_state().heat);
+
+  // each zone drives its own valve, the new duty applies from its next cycle
+  fake_advance(CYCLE_SEC * 1000 * 1000LL);
+  const int64_t start = fake_gpio_high_us(GPIO_PWM_ZONE_1);
+  fake_advance(CYCLE_SEC * 1000 * 1000LL);
+  TEST_ASSERT_INT_WITHIN(
+    CYCLE_SEC * 1000 * 1000LL / 100, CYCLE_SEC * 1000 * 1000LL, fake_gpio_high_us(GPIO_PWM_ZONE_1) - start
+  );
+
+  // and keeps its target in its own namespace
+  data = (app_traced_temp_t) { .temp = 18.5, .zone = 1 };
+  app_post_target_temp_changed(&data);
+  fake_event_loops_run();
+  TEST_ASSERT_FLOAT_WITHIN(0, zone_0.target_temp, get_state().target_temp);
+
+  nvs_handle_t handle;
+  uint32_t stored;
+  TEST_ASSERT_EQUAL_INT(ESP_OK, nvs_open("storage1", NVS_READONLY, &handle));
+  TEST_ASSERT_EQUAL_INT(ESP_OK, nvs_get_u32(handle, "target_temp", &stored));
+
+  float target_temp;
+  memcpy(&target_temp, &stored, sizeof(target_temp));
+  TEST_ASSERT_FLOAT_WITHIN(0, 18.5, target_temp);
+}
+
+
+
+int main(void) {
+  esp_log_level_set("*", ESP_LOG_WARN);
+  app_start_event_loops();
+  const app_thermostat_zone_t zones[] = {
+    { .gpio_pwm = GPIO_PWM, .target_temp = 21 },
+    { .gpio_pwm = GPIO_PWM_ZONE_1, .target_temp = 20 },
+  };
+  app_start_thermostat(zones, APP_ZONES, HEAT_MIN, HEAT_NORMAL, HEAT_MAX, CYCLE_SEC);
+  app_subscribe(APP_EVENT_LOOP_TELEMETRY, autotune_result, record_autotune_result, NULL);
+  fake_event_loops_run();
+
+  RUN_TEST(test_starts_with_min_heat);
+  RUN_TEST(test_heat_follows_temperature);
+  RUN_TEST(test_sensor_error_falls_back_to_min_heat);
+  RUN_TEST(test_target_temp_is_persisted);
+  RUN_TEST(test_pwm_output_follows_heat);
+  RUN_TEST(test_trace_ends_once_per_input);
+  RUN_TEST(test_pid_mode);
+  RUN_TEST(test_held_input_ends_its_trace_at_the_control_tick);
+  RUN_TEST(test_autotune_aborts_on_sensor_error);
+  RUN_TEST(test_heat_curve_sets_the_base_heat);
+  RUN_TEST(test_open_window_suspends_heating);
+  RUN_TEST(test_zones_are_independent);
+
+  return TEST_EXIT();
+}
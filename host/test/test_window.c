@@ -0,0 +1,90 @@
+#include <stdbool.h>
+
+#include "app_window.h"
+
+#include "./test.h"
+
+
+#define WINDOW_SEC 180
+#define DROP_CDEG_PER_MIN 20
+
+
+
+static app_window_t new_window(void) {
+  app_window_t window;
+  app_window_init(&window, WINDOW_SEC, DROP_CDEG_PER_MIN);
+  return window;
+}
+
+
+
+// readings every `interval_sec` changing by `rate` °C/min, returns the first flagged one
+static int feed(app_window_t * window, float temp, float rate, int interval_sec, int count) {
+  for (int k = 0; k < count; k++) {
+    const float minutes = k * interval_sec / 60.0f;
+    if (app_window_update(window, k * interval_sec * 1000, temp + rate * minutes)) {
+      return k;
+    }
+  }
+  return -1;
+}
+
+
+
+static void test_flags_a_fast_drop(void) {
+  app_window_t window = new_window();
+
+  TEST_ASSERT_EQUAL_INT(2, feed(&window, 21, -0.5, 15, 20));
+  TEST_ASSERT_FLOAT_WITHIN(0.001, -0.5, window.slope);
+}
+
+
+
+static void test_ignores_a_slow_drop(void) {
+  app_window_t window = new_window();
+
+  TEST_ASSERT_EQUAL_INT(-1, feed(&window, 21, -0.05, 15, 100));
+  TEST_ASSERT_FLOAT_WITHIN(0.001, -0.05, window.slope);
+}
+
+
+
+static void test_ignores_rising_temperatures(void) {
+  app_window_t window = new_window();
+
+  TEST_ASSERT_EQUAL_INT(-1, feed(&window, 18, 0.5, 15, 100));
+}
+
+
+
+static void test_needs_samples_within_the_period(void) {
+  app_window_t window = new_window();
+
+  // a reading every 10 minutes is too sparse for a slope
+  TEST_ASSERT_EQUAL_INT(-1, feed(&window, 21, -0.5, 600, 10));
+  TEST_ASSERT_FLOAT_WITHIN(0, 0, window.slope);
+}
+
+
+
+static void test_reset_forgets_the_samples(void) {
+  app_window_t window = new_window();
+
+  app_window_update(&window, 0, 21);
+  app_window_update(&window, 15000, 20.8);
+  app_window_reset(&window);
+  TEST_ASSERT(!app_window_update(&window, 30000, 20.6));
+  TEST_ASSERT_EQUAL_INT(1, window.count);
+}
+
+
+
+int main(void) {
+  RUN_TEST(test_flags_a_fast_drop);
+  RUN_TEST(test_ignores_a_slow_drop);
+  RUN_TEST(test_ignores_rising_temperatures);
+  RUN_TEST(test_needs_samples_within_the_period);
+  RUN_TEST(test_reset_forgets_the_samples);
+
+  return TEST_EXIT();
+}
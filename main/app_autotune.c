@@ -0,0 +1,149 @@
+#include <math.h>
+
+#include "./app_autotune.h"
+
+
+#define SEC_PER_HOUR 3600.0f
+
+// the PWM cycle recommended per oscillation period, and its limits
+#define CYCLES_PER_PERIOD 40
+#define MIN_HEAT_CYCLE_SEC 10
+#define MAX_HEAT_CYCLE_SEC 255
+
+
+static const char * status_names[APP_AUTOTUNE_STATUS_MAX] = {
+  [APP_AUTOTUNE_RUNNING] = "running",
+  [APP_AUTOTUNE_DONE] = "done",
+  [APP_AUTOTUNE_TIMEOUT] = "timeout",
+  [APP_AUTOTUNE_NO_OSCILLATION] = "no_oscillation",
+  [APP_AUTOTUNE_ABORTED] = "aborted",
+};
+
+
+
+void app_autotune_start(
+  app_autotune_t * autotune, float setpoint, float hysteresis, uint8_t out_low, uint8_t out_high, uint32_t max_ms
+) {
+  *autotune = (app_autotune_t) {
+    .setpoint = setpoint,
+    .hysteresis = hysteresis,
+    .out_low = out_low,
+    .out_high = out_high,
+    .max_ms = max_ms,
+    .high = true,
+    .status = APP_AUTOTUNE_RUNNING,
+  };
+}
+
+
+
+static void complete_cycle(app_autotune_t * autotune) {
+  // the first cycle starts off the oscillation and is not measured
+  if (autotune->settled) {
+    autotune->cycles += 1;
+    autotune->amplitude_sum += (autotune->temp_max - autotune->temp_min) / 2;
+    autotune->period_sum_ms += autotune->elapsed_ms - autotune->cycle_start_ms;
+  }
+  autotune->settled = true;
+}
+
+
+
+app_autotune_status_t app_autotune_update(app_autotune_t * autotune, float temp, uint32_t dt_ms, uint8_t * duty) {
+  if (autotune->status != APP_AUTOTUNE_RUNNING) {
+    *duty = autotune->out_low;
+    return autotune->status;
+  }
+
+  autotune->elapsed_ms += dt_ms;
+
+  if (autotune->in_cycle) {
+    autotune->temp_min = fminf(autotune->temp_min, temp);
+    autotune->temp_max = fmaxf(autotune->temp_max, temp);
+  }
+
+  if (autotune->high && temp > autotune->setpoint + autotune->hysteresis) {
+    autotune->high = false;
+
+  } else if (!autotune->high && temp < autotune->setpoint - autotune->hysteresis) {
+    autotune->high = true;
+
+    // a cycle runs from one switch to high to the next
+    if (autotune->in_cycle) {
+      complete_cycle(autotune);
+    }
+    autotune->in_cycle = true;
+    autotune->cycle_start_ms = autotune->elapsed_ms;
+    autotune->temp_min = temp;
+    autotune->temp_max = temp;
+  }
+
+  if (autotune->cycles >= APP_AUTOTUNE_CYCLES) {
+    const float amplitude = autotune->amplitude_sum / autotune->cycles;
+    autotune->status = (amplitude > autotune->hysteresis)
+      ? APP_AUTOTUNE_DONE
+      : APP_AUTOTUNE_NO_OSCILLATION;
+
+  } else if (autotune->elapsed_ms >= autotune->max_ms) {
+    autotune->status = APP_AUTOTUNE_TIMEOUT;
+  }
+
+  *duty = (autotune->status == APP_AUTOTUNE_RUNNING && autotune->high)
+    ? autotune->out_high
+    : autotune->out_low;
+  return autotune->status;
+}
+
+
+
+void app_autotune_abort(app_autotune_t * autotune) {
+  if (autotune->status == APP_AUTOTUNE_RUNNING) {
+    autotune->status = APP_AUTOTUNE_ABORTED;
+  }
+}
+
+
+
+void app_autotune_get_result(const app_autotune_t * autotune, app_autotune_result_t * result) {
+  *result = (app_autotune_result_t) {
+    .status = autotune->status,
+    .cycles = autotune->cycles,
+  };
+  if (autotune->cycles == 0) {
+    return;
+  }
+
+  const float amplitude = autotune->amplitude_sum / autotune->cycles;
+  const float tu_sec = autotune->period_sum_ms / 1000.0f / autotune->cycles;
+  result->amplitude = amplitude;
+  result->tu_sec = tu_sec;
+
+  if (autotune->status != APP_AUTOTUNE_DONE) {
+    return;
+  }
+
+  // describing function of a relay with hysteresis
+  const float relay = (autotune->out_high - autotune->out_low) / 2.0f;
+  const float hysteresis = autotune->hysteresis;
+  const float ku = 4 * relay / ((float) M_PI * sqrtf(amplitude * amplitude - hysteresis * hysteresis));
+  result->ku = ku;
+
+  // Ziegler-Nichols "some overshoot", milder than the classic rule
+  const float kp = ku / 3;
+  const float ti_h = tu_sec / 2 / SEC_PER_HOUR;
+  const float td_h = tu_sec / 3 / SEC_PER_HOUR;
+  result->gains = (app_pid_gains_t) {
+    .kp_q16 = APP_PID_Q16(kp),
+    .ki_q16 = APP_PID_Q16(kp / ti_h),
+    .kd_q16 = APP_PID_Q16(kp * td_h),
+  };
+
+  const float heat_cycle = tu_sec / CYCLES_PER_PERIOD;
+  result->heat_cycle_sec = fminf(fmaxf(heat_cycle, MIN_HEAT_CYCLE_SEC), MAX_HEAT_CYCLE_SEC);
+}
+
+
+
+const char * app_autotune_status_name(app_autotune_status_t status) {
+  return (status < APP_AUTOTUNE_STATUS_MAX) ? status_names[status] : "unknown";
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "./app_pid.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// Relay feedback experiment after Åström and Hägglund.
+// The duty toggles between a low and a high level whenever the temperature
+// leaves a hysteresis band around the setpoint. The resulting oscillation
+// gives the ultimate gain and period, and from those the PID gains.
+
+// full oscillations measured, after a first one that is discarded
+#define APP_AUTOTUNE_CYCLES 3
+
+
+typedef enum {
+  APP_AUTOTUNE_RUNNING,
+  APP_AUTOTUNE_DONE,
+  // no full set of cycles within the time limit
+  APP_AUTOTUNE_TIMEOUT,
+  // the oscillation did not leave the hysteresis band
+  APP_AUTOTUNE_NO_OSCILLATION,
+  // stopped by a sensor error or by request
+  APP_AUTOTUNE_ABORTED,
+
+  APP_AUTOTUNE_STATUS_MAX
+} app_autotune_status_t;
+
+
+// payload of APP_EVENT_AUTOTUNE_RESULT
+typedef struct {
+  // duty % per °C
+  float ku;
+  float tu_sec;
+  // °C, half of peak to peak
+  float amplitude;
+  app_pid_gains_t gains;
+  uint8_t status;
+  uint8_t cycles;
+  uint8_t heat_cycle_sec;
+  // heating zone of the experiment, set by its owner
+  uint8_t zone;
+} app_autotune_result_t;
+
+
+typedef struct {
+  float setpoint;
+  float hysteresis;
+  uint8_t out_low;
+  uint8_t out_high;
+  uint32_t max_ms;
+
+  bool high;
+  uint32_t elapsed_ms;
+  // start of the current cycle, at a switch to high
+  uint32_t cycle_start_ms;
+  bool in_cycle;
+  // the first cycle was completed
+  bool settled;
+  float temp_min;
+  float temp_max;
+
+  uint8_t cycles;
+  float amplitude_sum;
+  uint32_t period_sum_ms;
+  app_autotune_status_t status;
+} app_autotune_t;
+
+
+void app_autotune_start(
+  app_autotune_t * autotune, float setpoint, float hysteresis, uint8_t out_low, uint8_t out_high, uint32_t max_ms
+);
+
+// Feeds a temperature `dt_ms` after the last one, `duty` is set to the relay
+// output to apply until the next update.
+app_autotune_status_t app_autotune_update(app_autotune_t * autotune, float temp, uint32_t dt_ms, uint8_t * duty);
+
+void app_autotune_abort(app_autotune_t * autotune);
+
+// The measured oscillation and the derived gains, the gains and heat cycle
+// are only set once the status is APP_AUTOTUNE_DONE.
+void app_autotune_get_result(const app_autotune_t * autotune, app_autotune_result_t * result);
+
+const char * app_autotune_status_name(app_autotune_status_t status);
+
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,16 +1,635 @@
+#include <string.h>
+#include <stddef.h>
+#include <math.h>
+
+#include "sdkconfig.h"
+
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
 #include "esp_event.h"
+#include "esp_timer.h"
 
 #include "./app_events.h"
 
 
+static const char* TAG = "app-events";
+
 ESP_EVENT_DEFINE_BASE(APP_EVENT_BASE);
 
 
-void app_post_event(app_event_t evt_id, void *evt_data, size_t evt_data_size) {
-  esp_event_post(APP_EVENT_BASE, evt_id, evt_data, evt_data_size, portMAX_DELAY);
+#define MAX_HANDLERS 4
+
+
+typedef struct {
+  app_event_fn_t handler;
+  void * arg;
+  app_event_handler_stats_t stats;
+} handler_t;
+
+
+// pending events of a DROP_OLDEST or COALESCE event ID and zone, the loop
+// queue only ever holds a single token for them, carrying the zone
+typedef struct {
+  uint8_t data[CONFIG_APP_EVENT_MAILBOX_DEPTH][APP_EVENT_MAILBOX_DATA_SIZE];
+  uint8_t size[CONFIG_APP_EVENT_MAILBOX_DEPTH];
+  uint8_t head;
+  uint8_t count;
+  bool token_pending;
+} mailbox_t;
+
+
+// merges bursts of a float event, see app_set_event_rate_limit
+typedef struct {
+  app_event_t evt_id;
+  int64_t min_interval_us;
+  float deadband;
+
+  int64_t last_delivery;
+  float last_delivered;
+  bool has_delivered;
+
+  uint8_t pending[APP_EVENT_MAILBOX_DATA_SIZE];
+  uint8_t pending_size;
+  bool has_pending;
+  esp_timer_handle_t flush_timer;
+} rate_limit_t;
+
+
+typedef struct {
+  app_event_loop_t loop;
+  app_event_t evt_id;
+  handler_t handlers[MAX_HANDLERS];
+  uint8_t handler_count;
+  // one per zone for zoned events, only the first otherwise
+  mailbox_t * mailboxes[APP_ZONES];
+} subscription_t;
+
+
+static esp_event_loop_handle_t loops[APP_EVENT_LOOP_MAX] = {0};
+
+static subscription_t subscriptions[APP_EVENT_LOOP_MAX][APP_EVENT_MAX] = {0};
+
+static const app_event_policy_t policies[APP_EVENT_MAX] = {
+#define EVENT_POLICY(ID, name, type, policy) [APP_EVENT_##ID] = policy,
+  APP_EVENTS(EVENT_POLICY)
+#undef EVENT_POLICY
+};
+
+static const uint8_t data_sizes[APP_EVENT_MAX] = {
+#define EVENT_DATA_SIZE(ID, name, type, policy) [APP_EVENT_##ID] = sizeof(type),
+  APP_EVENTS(EVENT_DATA_SIZE)
+#undef EVENT_DATA_SIZE
+};
+
+// offset of the zone in the payload, -1 for events of the whole device
+#define ZONE_OFFSET(type) _Generic((type *) NULL, \
+  app_traced_temp_t *: (int8_t) offsetof(app_traced_temp_t, zone), \
+  app_zone_value_t *: (int8_t) offsetof(app_zone_value_t, zone), \
+  app_zone_flag_t *: (int8_t) offsetof(app_zone_flag_t, zone), \
+  default: (int8_t) -1)
+
+static const int8_t zone_offsets[APP_EVENT_MAX] = {
+#define EVENT_ZONE_OFFSET(ID, name, type, policy) [APP_EVENT_##ID] = ZONE_OFFSET(type),
+  APP_EVENTS(EVENT_ZONE_OFFSET)
+#undef EVENT_ZONE_OFFSET
+};
+
+static const char * event_names[APP_EVENT_MAX] = {
+#define EVENT_NAME(ID, name, type, policy) [APP_EVENT_##ID] = #name,
+  APP_EVENTS(EVENT_NAME)
+#undef EVENT_NAME
+};
+
+static app_event_counters_t counters[APP_EVENT_MAX] = {0};
+
+static rate_limit_t * rate_limits[APP_EVENT_MAX][APP_ZONES] = {0};
+
+static app_event_tap_t event_tap = NULL;
+
+// events posted to a loop and not yet dispatched
+static uint32_t loop_depth[APP_EVENT_LOOP_MAX] = {0};
+
+
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+
+
+static esp_event_loop_handle_t create_loop(
+  const char * name, int32_t queue_size, UBaseType_t priority, uint32_t stack_size
+) {
+  esp_event_loop_args_t loop_args = {
+    .queue_size = queue_size,
+    .task_name = name,
+    .task_priority = priority,
+    .task_stack_size = stack_size,
+    .task_core_id = tskNO_AFFINITY
+  };
+
+  esp_event_loop_handle_t loop;
+  ESP_ERROR_CHECK(esp_event_loop_create(&loop_args, &loop));
+
+  ESP_LOGI(TAG, "created event loop %s: queue %d, priority %d", name, queue_size, priority);
+  return loop;
+}
+
+
+
+static void dispatch_event(void *arg, esp_event_base_t evt_base, int32_t id, void *data);
+
+
+
+static void start_loop(
+  app_event_loop_t loop, const char * name, int32_t queue_size, UBaseType_t priority, uint32_t stack_size
+) {
+  loops[loop] = create_loop(name, queue_size, priority, stack_size);
+
+  // a single registration per loop, events are dispatched from the fixed
+  // subscriptions table instead of the esp_event handler lists
+  esp_event_handler_register_with(loops[loop], APP_EVENT_BASE, ESP_EVENT_ANY_ID, dispatch_event, &(subscriptions[loop]));
+}
+
+
+
+void app_start_event_loops(void) {
+  start_loop(
+    APP_EVENT_LOOP_CONTROL,
+    "app-control",
+    CONFIG_APP_EVENT_CONTROL_QUEUE_SIZE,
+    CONFIG_APP_EVENT_CONTROL_TASK_PRIORITY,
+    CONFIG_APP_EVENT_CONTROL_TASK_STACK_SIZE
+  );
+
+  start_loop(
+    APP_EVENT_LOOP_TELEMETRY,
+    "app-telemetry",
+    CONFIG_APP_EVENT_TELEMETRY_QUEUE_SIZE,
+    CONFIG_APP_EVENT_TELEMETRY_TASK_PRIORITY,
+    CONFIG_APP_EVENT_TELEMETRY_TASK_STACK_SIZE
+  );
+}
+
+
+
+static bool uses_mailbox(app_event_policy_t policy) {
+  return policy == APP_EVENT_POLICY_DROP_OLDEST || policy == APP_EVENT_POLICY_COALESCE;
+}
+
+
+
+// zone of the payload, 0 for events of the whole device
+static uint8_t event_zone(app_event_t evt_id, const void * evt_data) {
+  const int8_t offset = zone_offsets[evt_id];
+  return (offset < 0) ? 0 : ((const uint8_t *) evt_data)[offset];
+}
+
+
+
+static void count_loss(app_event_t evt_id, app_event_policy_t policy) {
+  portENTER_CRITICAL_SAFE(&lock);
+  if (policy == APP_EVENT_POLICY_COALESCE) {
+    counters[evt_id].coalesced += 1;
+  } else {
+    counters[evt_id].dropped += 1;
+  }
+  portEXIT_CRITICAL_SAFE(&lock);
+}
+
+
+
+static uint8_t histogram_bucket(uint32_t duration_us) {
+  const uint8_t bucket = (duration_us == 0) ? 0 : 32 - __builtin_clz(duration_us);
+  return (bucket < APP_EVENT_HISTOGRAM_BUCKETS) ? bucket : APP_EVENT_HISTOGRAM_BUCKETS - 1;
+}
+
+
+
+static void call_handler(handler_t * h, app_event_t evt_id, const void * data) {
+  switch (evt_id) {
+#define EVENT_CALL(ID, name, type, policy) \
+    case APP_EVENT_##ID: \
+      ((app_##name##_handler_t) h->handler)(h->arg, evt_id, (const type *) data); \
+      break;
+    APP_EVENTS(EVENT_CALL)
+#undef EVENT_CALL
+    default:
+      break;
+  }
+}
+
+
+
+static void call_handlers(subscription_t * sub, const void * data) {
+  for (int i = 0; i < sub->handler_count; i++) {
+    handler_t * h = &(sub->handlers[i]);
+
+    const int64_t start = esp_timer_get_time();
+    call_handler(h, sub->evt_id, data);
+    const uint32_t duration_us = esp_timer_get_time() - start;
+
+    portENTER_CRITICAL(&lock);
+    h->stats.calls += 1;
+    h->stats.histogram[histogram_bucket(duration_us)] += 1;
+    if (duration_us > h->stats.max_us) {
+      h->stats.max_us = duration_us;
+    }
+    portEXIT_CRITICAL(&lock);
+  }
 }
 
 
-void app_register_evt_handler(app_event_t evt_id, esp_event_handler_t handler, void *handler_arg) {
-  esp_event_handler_register(APP_EVENT_BASE, evt_id, handler, handler_arg);
+
+static void dispatch_event(void *arg, esp_event_base_t evt_base, int32_t id, void *data) {
+  if (id < 0 || id >= APP_EVENT_MAX) {
+    return;
+  }
+
+  subscription_t * sub = &(((subscription_t *) arg)[id]);
+
+  portENTER_CRITICAL(&lock);
+  loop_depth[sub->loop] -= 1;
+  portEXIT_CRITICAL(&lock);
+
+  if (!uses_mailbox(policies[id])) {
+    call_handlers(sub, data);
+    return;
+  }
+
+  // the token names the zone's mailbox
+  mailbox_t * mb = sub->mailboxes[*(const uint8_t *) data];
+
+  uint8_t buf[APP_EVENT_MAILBOX_DATA_SIZE];
+
+  while (true) {
+    portENTER_CRITICAL(&lock);
+    if (mb->count == 0) {
+      mb->token_pending = false;
+      portEXIT_CRITICAL(&lock);
+      break;
+    }
+    memcpy(buf, mb->data[mb->head], mb->size[mb->head]);
+    mb->head = (mb->head + 1) % CONFIG_APP_EVENT_MAILBOX_DEPTH;
+    mb->count -= 1;
+    portEXIT_CRITICAL(&lock);
+
+    call_handlers(sub, buf);
+  }
+}
+
+
+
+// posts to the loop and keeps track of its queue depth
+static esp_err_t post_to_queue(
+  subscription_t * sub, const void *evt_data, size_t evt_data_size, TickType_t ticks_to_wait, bool from_isr
+) {
+  esp_event_loop_handle_t loop = loops[sub->loop];
+
+  // counted up front, the loop task may dispatch before the post returns
+  portENTER_CRITICAL_SAFE(&lock);
+  const uint32_t depth = ++loop_depth[sub->loop];
+  portEXIT_CRITICAL_SAFE(&lock);
+
+  esp_err_t err;
+  if (from_isr) {
+    err = esp_event_isr_post_to(loop, APP_EVENT_BASE, sub->evt_id, evt_data, evt_data_size, NULL);
+  } else {
+    err = esp_event_post_to(loop, APP_EVENT_BASE, sub->evt_id, evt_data, evt_data_size, ticks_to_wait);
+  }
+
+  portENTER_CRITICAL_SAFE(&lock);
+  if (err != ESP_OK) {
+    loop_depth[sub->loop] -= 1;
+  } else if (depth > counters[sub->evt_id].queue_hwm) {
+    counters[sub->evt_id].queue_hwm = depth;
+  }
+  portEXIT_CRITICAL_SAFE(&lock);
+
+  return err;
+}
+
+
+
+static esp_err_t post_token(subscription_t * sub, uint8_t zone, bool from_isr) {
+  return post_to_queue(sub, &zone, sizeof(zone), 0, from_isr);
+}
+
+
+
+static esp_err_t post_to_mailbox(
+  subscription_t * sub, app_event_policy_t policy, const void *evt_data, size_t evt_data_size, bool from_isr
+) {
+  const uint8_t zone = event_zone(sub->evt_id, evt_data);
+  mailbox_t * mb = sub->mailboxes[zone];
+  const uint8_t depth = (policy == APP_EVENT_POLICY_COALESCE) ? 1 : CONFIG_APP_EVENT_MAILBOX_DEPTH;
+  bool lost = false;
+  bool needs_token = false;
+
+  portENTER_CRITICAL_SAFE(&lock);
+  if (mb->count >= depth) {
+    mb->head = (mb->head + 1) % CONFIG_APP_EVENT_MAILBOX_DEPTH;
+    mb->count -= 1;
+    lost = true;
+  }
+  const uint8_t tail = (mb->head + mb->count) % CONFIG_APP_EVENT_MAILBOX_DEPTH;
+  memcpy(mb->data[tail], evt_data, evt_data_size);
+  mb->size[tail] = evt_data_size;
+  mb->count += 1;
+
+  if (!mb->token_pending) {
+    mb->token_pending = true;
+    needs_token = true;
+  }
+  portEXIT_CRITICAL_SAFE(&lock);
+
+  if (lost) {
+    count_loss(sub->evt_id, policy);
+  }
+
+  if (needs_token && post_token(sub, zone, from_isr) != ESP_OK) {
+    // without a token nothing dispatches the mailbox, its events are lost
+    portENTER_CRITICAL_SAFE(&lock);
+    counters[sub->evt_id].dropped += mb->count;
+    mb->count = 0;
+    mb->token_pending = false;
+    portEXIT_CRITICAL_SAFE(&lock);
+    return ESP_FAIL;
+  }
+  return ESP_OK;
+}
+
+
+
+static esp_err_t post_to_loop(
+  subscription_t * sub, const void *evt_data, size_t evt_data_size, TickType_t ticks_to_wait, bool from_isr
+) {
+  const app_event_policy_t policy = policies[sub->evt_id];
+
+  if (uses_mailbox(policy)) {
+    return post_to_mailbox(sub, policy, evt_data, evt_data_size, from_isr);
+  }
+
+  esp_err_t err = post_to_queue(sub, evt_data, evt_data_size, ticks_to_wait, from_isr);
+  if (err != ESP_OK) {
+    count_loss(sub->evt_id, policy);
+  }
+  return err;
+}
+
+
+
+static esp_err_t post_event(
+  app_event_t evt_id, const void *evt_data, size_t evt_data_size, TickType_t ticks_to_wait, bool from_isr
+) {
+  if (evt_id >= APP_EVENT_MAX || evt_data_size != data_sizes[evt_id]) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  if (event_zone(evt_id, evt_data) >= APP_ZONES) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  portENTER_CRITICAL_SAFE(&lock);
+  counters[evt_id].posted += 1;
+  portEXIT_CRITICAL_SAFE(&lock);
+
+  if (event_tap != NULL) {
+    event_tap(evt_id, evt_data, evt_data_size);
+  }
+
+  esp_err_t result = ESP_OK;
+
+  for (int loop = 0; loop < APP_EVENT_LOOP_MAX; loop++) {
+    subscription_t * sub = &(subscriptions[loop][evt_id]);
+    if (sub->handler_count == 0) {
+      continue;
+    }
+
+    esp_err_t err = post_to_loop(sub, evt_data, evt_data_size, ticks_to_wait, from_isr);
+    if (result == ESP_OK) {
+      result = err;
+    }
+  }
+  return result;
+}
+
+
+
+static void flush_rate_limit(void * arg) {
+  rate_limit_t * rl = (rate_limit_t *) arg;
+
+  uint8_t data[APP_EVENT_MAILBOX_DATA_SIZE];
+  uint8_t size = 0;
+
+  portENTER_CRITICAL(&lock);
+  const bool has_pending = rl->has_pending;
+  if (has_pending) {
+    size = rl->pending_size;
+    memcpy(data, rl->pending, size);
+    rl->has_pending = false;
+    rl->last_delivery = esp_timer_get_time();
+    memcpy(&(rl->last_delivered), data, sizeof(float));
+    rl->has_delivered = true;
+    counters[rl->evt_id].delivered += 1;
+  }
+  portEXIT_CRITICAL(&lock);
+
+  if (has_pending) {
+    post_event(rl->evt_id, data, size, 0, false);
+  }
+}
+
+
+
+// Returns true if the event should be delivered right away. Otherwise it was
+// either within the deadband and dropped, or it is held back and delivered
+// by the flush timer once the minimum interval has passed.
+static bool pass_rate_limit(rate_limit_t * rl, const void *evt_data, size_t evt_data_size) {
+  const int64_t now = esp_timer_get_time();
+  float value;
+  memcpy(&value, evt_data, sizeof(value));
+
+  int64_t flush_in = -1;
+  bool pass = false;
+
+  portENTER_CRITICAL(&lock);
+  counters[rl->evt_id].received += 1;
+
+  if (rl->has_delivered && fabsf(value - rl->last_delivered) < rl->deadband) {
+    rl->has_pending = false;
+
+  } else if (!rl->has_delivered || now - rl->last_delivery >= rl->min_interval_us) {
+    rl->has_pending = false;
+    rl->last_delivery = now;
+    rl->last_delivered = value;
+    rl->has_delivered = true;
+    counters[rl->evt_id].delivered += 1;
+    pass = true;
+
+  } else {
+    if (!rl->has_pending) {
+      rl->has_pending = true;
+      flush_in = rl->last_delivery + rl->min_interval_us - now;
+    }
+    memcpy(rl->pending, evt_data, evt_data_size);
+    rl->pending_size = evt_data_size;
+  }
+  portEXIT_CRITICAL(&lock);
+
+  if (flush_in >= 0) {
+    esp_timer_stop(rl->flush_timer);
+    esp_timer_start_once(rl->flush_timer, flush_in);
+  }
+  return pass;
+}
+
+
+
+static esp_err_t post_limited_event(
+  app_event_t evt_id, const void *evt_data, size_t evt_data_size, TickType_t ticks_to_wait
+) {
+  if (evt_id >= APP_EVENT_MAX || evt_data_size != data_sizes[evt_id]) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  const uint8_t zone = event_zone(evt_id, evt_data);
+  rate_limit_t * rl = (zone < APP_ZONES) ? rate_limits[evt_id][zone] : NULL;
+
+  const bool limited = (
+    rl != NULL
+    && evt_data_size >= sizeof(float)
+    && evt_data_size <= APP_EVENT_MAILBOX_DATA_SIZE
+  );
+
+  if (limited && !pass_rate_limit(rl, evt_data, evt_data_size)) {
+    return ESP_OK;
+  }
+  return post_event(evt_id, evt_data, evt_data_size, ticks_to_wait, false);
+}
+
+
+
+esp_err_t app_post_event(app_event_t evt_id, const void *evt_data, size_t evt_data_size) {
+  if (evt_id >= APP_EVENT_MAX) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  const TickType_t ticks_to_wait = (policies[evt_id] == APP_EVENT_POLICY_BLOCK) ? portMAX_DELAY : 0;
+  return post_limited_event(evt_id, evt_data, evt_data_size, ticks_to_wait);
+}
+
+
+
+esp_err_t app_post_event_timeout(
+  app_event_t evt_id, const void *evt_data, size_t evt_data_size, TickType_t ticks_to_wait
+) {
+  return post_limited_event(evt_id, evt_data, evt_data_size, ticks_to_wait);
+}
+
+
+
+esp_err_t app_post_event_isr(app_event_t evt_id, const void *evt_data, size_t evt_data_size) {
+  return post_event(evt_id, evt_data, evt_data_size, 0, true);
+}
+
+
+
+void app_set_event_rate_limit(app_event_t evt_id, uint32_t min_interval_ms, float deadband) {
+  const uint8_t zones = (zone_offsets[evt_id] < 0) ? 1 : APP_ZONES;
+
+  for (uint8_t zone = 0; zone < zones; zone++) {
+    rate_limit_t * rl = rate_limits[evt_id][zone];
+
+    if (rl == NULL) {
+      rl = calloc(1, sizeof(rate_limit_t));
+      if (rl == NULL) {
+        ESP_LOGE(TAG, "no memory to rate limit %s", app_event_name(evt_id));
+        ESP_ERROR_CHECK(ESP_ERR_NO_MEM);
+      }
+      rl->evt_id = evt_id;
+
+      esp_timer_create_args_t timer_args = {
+        .name = "app-events-flush",
+        .callback = &flush_rate_limit,
+        .arg = rl
+      };
+      esp_timer_create(&timer_args, &(rl->flush_timer));
+    }
+
+    rl->min_interval_us = (int64_t) min_interval_ms * 1000;
+    rl->deadband = deadband;
+
+    rate_limits[evt_id][zone] = rl;
+  }
+}
+
+
+
+void app_set_event_tap(app_event_tap_t tap) {
+  event_tap = tap;
+}
+
+
+
+void app_get_event_counters(app_event_t evt_id, app_event_counters_t * out) {
+  portENTER_CRITICAL(&lock);
+  *out = counters[evt_id];
+  portEXIT_CRITICAL(&lock);
+}
+
+
+
+const char * app_event_name(app_event_t evt_id) {
+  return (evt_id < APP_EVENT_MAX && event_names[evt_id] != NULL) ? event_names[evt_id] : "unknown";
+}
+
+
+
+size_t app_get_handler_stats(app_event_handler_stats_t * stats, size_t max_stats) {
+  size_t count = 0;
+
+  for (int loop = 0; loop < APP_EVENT_LOOP_MAX; loop++) {
+    for (int evt_id = 0; evt_id < APP_EVENT_MAX; evt_id++) {
+      subscription_t * sub = &(subscriptions[loop][evt_id]);
+
+      for (int i = 0; i < sub->handler_count && count < max_stats; i++) {
+        portENTER_CRITICAL(&lock);
+        stats[count] = sub->handlers[i].stats;
+        portEXIT_CRITICAL(&lock);
+        count += 1;
+      }
+    }
+  }
+  return count;
+}
+
+
+
+void app_register_evt_handler(
+  app_event_loop_t loop, app_event_t evt_id, app_event_fn_t handler, void *handler_arg,
+  const char * name
+) {
+  subscription_t * sub = &(subscriptions[loop][evt_id]);
+
+  if (sub->handler_count >= MAX_HANDLERS) {
+    ESP_LOGE(TAG, "too many handlers for event %d on loop %d", evt_id, loop);
+    return;
+  }
+
+  sub->handlers[sub->handler_count] = (handler_t) {
+    .handler = handler,
+    .arg = handler_arg,
+    .stats = {
+      .name = name,
+      .loop = loop,
+      .evt_id = evt_id
+    }
+  };
+
+  if (sub->handler_count == 0) {
+    sub->loop = loop;
+    sub->evt_id = evt_id;
+    if (uses_mailbox(policies[evt_id])) {
+      const uint8_t zones = (zone_offsets[evt_id] < 0) ? 1 : APP_ZONES;
+      for (uint8_t zone = 0; zone < zones; zone++) {
+        sub->mailboxes[zone] = calloc(1, sizeof(mailbox_t));
+      }
+    }
+  }
+  sub->handler_count += 1;
 }
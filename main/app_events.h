@@ -1,7 +1,18 @@
 #pragma once
 
+#include <stdbool.h>
+
+#include "esp_err.h"
 #include "esp_event.h"
 
+#include "./app_autotune.h"
+#include "./app_model.h"
+#include "./app_pid.h"
+#include "./app_schedule.h"
+#include "./app_smith.h"
+#include "./app_trace.h"
+#include "./app_zones.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -9,42 +20,211 @@ extern "C" {
 
 ESP_EVENT_DECLARE_BASE(APP_EVENT_BASE);
 
-typedef enum {
-  APP_EVENT_OTA,
-  APP_EVENT_OTA_STARTED,
-  APP_EVENT_OTA_SUCCESS,
-  APP_EVENT_OTA_FAILED,
-
-  APP_EVENT_RESTART,
-
-  APP_EVENT_STARTED,
-
-  APP_EVENT_TARGET_TEMP_CHANGED,
-  APP_EVENT_CURRENT_TEMP_CHANGED,
-  APP_EVENT_BLE_TEMP_CHANGED,
-  APP_EVENT_CURRENT_HUMID_CHANGED,
-  APP_EVENT_TEMP_READ_STATE,
-  APP_EVENT_THERMOSTAT_CHANGED,
 
-  APP_EVENT_TIME_UPDATED,
+// What happens to an event posted while its loop is backed up.
+// Only APP_EVENT_POLICY_BLOCK ever makes a post wait. The kept events of
+// DROP_OLDEST and COALESCE still need a queue slot for their dispatch,
+// without one they are counted as dropped and the post fails.
+typedef enum {
+  // wait until the loop has room
+  APP_EVENT_POLICY_BLOCK,
+  // never wait, the new event is dropped if the loop queue is full
+  APP_EVENT_POLICY_DROP_NEWEST,
+  // never wait, undelivered events of the ID are kept in a small ring
+  // (CONFIG_APP_EVENT_MAILBOX_DEPTH) and the oldest one is dropped on overflow
+  APP_EVENT_POLICY_DROP_OLDEST,
+  // never wait, an undelivered event of the ID is replaced by the new one
+  APP_EVENT_POLICY_COALESCE
+} app_event_policy_t;
+
+
+// payload type of events without data, it has a size of 0
+typedef struct {} app_no_data_t;
+
+
+// Every app event with its payload type and post policy.
+// X(ID, name, payload type, policy)
+#define APP_EVENTS(X) \
+  X(OTA,                   ota,                   app_no_data_t,     APP_EVENT_POLICY_BLOCK)       \
+  X(OTA_STARTED,           ota_started,           app_no_data_t,     APP_EVENT_POLICY_BLOCK)       \
+  X(OTA_SUCCESS,           ota_success,           app_no_data_t,     APP_EVENT_POLICY_BLOCK)       \
+  X(OTA_FAILED,            ota_failed,            esp_err_t,         APP_EVENT_POLICY_BLOCK)       \
+  X(RESTART,               restart,               app_no_data_t,     APP_EVENT_POLICY_BLOCK)       \
+  X(STARTED,               started,               app_no_data_t,     APP_EVENT_POLICY_BLOCK)       \
+  X(TARGET_TEMP_CHANGED,   target_temp_changed,   app_traced_temp_t, APP_EVENT_POLICY_BLOCK)       \
+  X(CURRENT_TEMP_CHANGED,  current_temp_changed,  app_traced_temp_t, APP_EVENT_POLICY_COALESCE)    \
+  X(BLE_TEMP_CHANGED,      ble_temp_changed,      app_traced_temp_t, APP_EVENT_POLICY_COALESCE)    \
+  X(CURRENT_HUMID_CHANGED, current_humid_changed, app_zone_value_t,  APP_EVENT_POLICY_COALESCE)    \
+  X(TEMP_READ_STATE,       temp_read_state,       app_zone_flag_t,   APP_EVENT_POLICY_BLOCK)       \
+  X(STATE_CHANGED,         state_changed,         uint32_t,          APP_EVENT_POLICY_COALESCE)    \
+  X(TIME_UPDATED,          time_updated,          app_no_data_t,     APP_EVENT_POLICY_BLOCK)       \
+  X(STATS_GET,             stats_get,             app_no_data_t,     APP_EVENT_POLICY_BLOCK)       \
+  X(STATS_REPORT,          stats_report,          app_no_data_t,     APP_EVENT_POLICY_DROP_NEWEST) \
+  X(METRICS_GET,           metrics_get,           app_no_data_t,     APP_EVENT_POLICY_BLOCK)       \
+  X(TRACE_REPORT,          trace_report,          app_no_data_t,     APP_EVENT_POLICY_DROP_NEWEST) \
+  X(RESET_FACTORY,         reset_factory,         app_no_data_t,     APP_EVENT_POLICY_BLOCK)       \
+  X(RESET_HOMEKIT,         reset_homekit,         app_no_data_t,     APP_EVENT_POLICY_BLOCK)       \
+  X(RESET_NETWORK,         reset_network,         app_no_data_t,     APP_EVENT_POLICY_BLOCK)       \
+  X(RESET_PAIRING,         reset_pairing,         app_no_data_t,     APP_EVENT_POLICY_BLOCK)       \
+  X(IDENTIFY,              identify,              app_no_data_t,     APP_EVENT_POLICY_BLOCK)       \
+  X(CONTROL_TICK,          control_tick,          app_no_data_t,     APP_EVENT_POLICY_COALESCE)    \
+  X(CONTROLLER_MODE_SET,   controller_mode_set,   uint8_t,           APP_EVENT_POLICY_BLOCK)       \
+  X(PID_GAINS_SET,         pid_gains_set,         app_pid_gains_t,   APP_EVENT_POLICY_BLOCK)       \
+  X(PID_TERMS,             pid_terms,             app_pid_terms_t,   APP_EVENT_POLICY_DROP_NEWEST) \
+  X(MODEL_FIT,             model_fit,             app_model_fit_t,   APP_EVENT_POLICY_DROP_NEWEST) \
+  X(AUTOTUNE_START,        autotune_start,        uint8_t,           APP_EVENT_POLICY_BLOCK)       \
+  X(AUTOTUNE_STOP,         autotune_stop,         uint8_t,           APP_EVENT_POLICY_BLOCK)       \
+  X(AUTOTUNE_RESULT,       autotune_result,       app_autotune_result_t, APP_EVENT_POLICY_DROP_NEWEST) \
+  X(SMITH_PREDICTION,      smith_prediction,      app_smith_prediction_t, APP_EVENT_POLICY_DROP_NEWEST) \
+  X(SCHEDULE_TICK,         schedule_tick,         app_no_data_t,     APP_EVENT_POLICY_COALESCE)    \
+  X(SCHEDULE_SET,          schedule_set,          app_schedule_t,    APP_EVENT_POLICY_BLOCK)       \
+  X(SCHEDULE_GET,          schedule_get,          app_no_data_t,     APP_EVENT_POLICY_BLOCK)       \
+  X(SCHEDULE_REPORT,       schedule_report,       app_schedule_t,    APP_EVENT_POLICY_DROP_NEWEST) \
+  X(OUTDOOR_TEMP_CHANGED,  outdoor_temp_changed,  float,             APP_EVENT_POLICY_COALESCE)
 
-  APP_EVENT_STATS_GET,
-  APP_EVENT_STATS_REPORT,
 
-  APP_EVENT_RESET_FACTORY,
-  APP_EVENT_RESET_HOMEKIT,
-  APP_EVENT_RESET_NETWORK,
-  APP_EVENT_RESET_PAIRING,
+typedef enum {
+#define APP_EVENT_ENUM(ID, name, type, policy) APP_EVENT_##ID,
+  APP_EVENTS(APP_EVENT_ENUM)
+#undef APP_EVENT_ENUM
 
-  APP_EVENT_IDENTIFY
+  APP_EVENT_MAX
 } app_event_t;
 
 
-void app_post_event(app_event_t evt_id, void *evt_data, size_t evt_data_size);
-
-void app_register_evt_handler(app_event_t evt_id, esp_event_handler_t handler, void *handler_arg);
+// Handlers run on one of two dedicated loops, neither of which is the default
+// esp_event loop used for WIFI_EVENT, IP_EVENT and HAP_EVENT.
+// The control loop carries thermostat, sensor and PWM decisions,
+// the telemetry loop carries MQTT, stats and HomeKit fan-out.
+typedef enum {
+  APP_EVENT_LOOP_CONTROL,
+  APP_EVENT_LOOP_TELEMETRY,
+
+  APP_EVENT_LOOP_MAX
+} app_event_loop_t;
+
+
+// largest payload of a DROP_OLDEST or COALESCE event
+#define APP_EVENT_MAILBOX_DATA_SIZE 16
+
+
+typedef struct {
+  uint32_t posted;
+  uint32_t dropped;
+  uint32_t coalesced;
+  // only counted for events with a rate limit
+  uint32_t received;
+  uint32_t delivered;
+  // deepest loop queue seen right after posting the event
+  uint32_t queue_hwm;
+} app_event_counters_t;
+
+
+// bucket 0 counts calls under 1us, bucket n calls of 2^(n-1) to 2^n - 1 us,
+// the last bucket everything slower
+#define APP_EVENT_HISTOGRAM_BUCKETS 20
+
+typedef struct {
+  const char * name;
+  app_event_loop_t loop;
+  app_event_t evt_id;
+  uint32_t calls;
+  uint32_t max_us;
+  uint32_t histogram[APP_EVENT_HISTOGRAM_BUCKETS];
+} app_event_handler_stats_t;
+
+
+// handlers are stored type-erased and cast back to their typed signature
+// by the dispatcher generated from APP_EVENTS
+typedef void (*app_event_fn_t)(void);
+
+
+void app_start_event_loops(void);
+
+// Posts with the event's policy, blocking only for APP_EVENT_POLICY_BLOCK.
+esp_err_t app_post_event(app_event_t evt_id, const void *evt_data, size_t evt_data_size);
+
+// Posts waiting at most ticks_to_wait for room in the loop queue,
+// returns ESP_ERR_TIMEOUT if the event had to be dropped.
+esp_err_t app_post_event_timeout(
+  app_event_t evt_id, const void *evt_data, size_t evt_data_size, TickType_t ticks_to_wait
+);
+
+// Posts from an ISR, never waits. Payloads are limited to 4 bytes
+// unless the event uses a DROP_OLDEST or COALESCE policy.
+esp_err_t app_post_event_isr(app_event_t evt_id, const void *evt_data, size_t evt_data_size);
+
+// Merges bursts of an event whose payload starts with a float value and
+// is no larger than APP_EVENT_MAILBOX_DATA_SIZE: events arriving within
+// min_interval_ms of the last delivery are held back and only the latest
+// value is delivered once the interval has passed. Values closer than
+// deadband to the last delivered value are not delivered at all.
+// Posts from an ISR bypass the rate limit. Zoned events are limited per zone.
+void app_set_event_rate_limit(app_event_t evt_id, uint32_t min_interval_ms, float deadband);
+
+// Called for every posted event in the posting context, which may be an ISR.
+typedef void (*app_event_tap_t)(app_event_t evt_id, const void *evt_data, size_t evt_data_size);
+
+void app_set_event_tap(app_event_tap_t tap);
+
+void app_get_event_counters(app_event_t evt_id, app_event_counters_t * counters);
+
+// Copies the execution time stats of up to max_stats registered handlers,
+// returns the number copied.
+size_t app_get_handler_stats(app_event_handler_stats_t * stats, size_t max_stats);
+
+const char * app_event_name(app_event_t evt_id);
+
+void app_register_evt_handler(
+  app_event_loop_t loop, app_event_t evt_id, app_event_fn_t handler, void *handler_arg,
+  const char * name
+);
+
+
+// Typed helpers generated for every event, e.g. for TARGET_TEMP_CHANGED:
+//
+//   void handler(void * arg, app_event_t evt_id, const app_traced_temp_t * data);
+//   app_subscribe(APP_EVENT_LOOP_CONTROL, target_temp_changed, handler, arg);
+//
+//   app_traced_temp_t data = { .temp = 21, .zone = 0 };
+//   app_post_target_temp_changed(&data);
+//   app_post_target_temp_changed_timeout(&data, ticks_to_wait);
+//   app_post_target_temp_changed_isr(&data);
+//
+// Events without data take a NULL app_no_data_t pointer.
+#define APP_EVENT_HELPERS(ID, name, type, policy) \
+  _Static_assert( \
+    (policy != APP_EVENT_POLICY_DROP_OLDEST && policy != APP_EVENT_POLICY_COALESCE) \
+      || sizeof(type) <= APP_EVENT_MAILBOX_DATA_SIZE, \
+    "payload of APP_EVENT_" #ID " is too large for its policy" \
+  ); \
+  _Static_assert(sizeof(type) <= UINT8_MAX, "payload of APP_EVENT_" #ID " is too large"); \
+  \
+  typedef void (*app_##name##_handler_t)(void * arg, app_event_t evt_id, const type * data); \
+  \
+  static inline esp_err_t app_post_##name(const type * data) { \
+    return app_post_event(APP_EVENT_##ID, data, sizeof(type)); \
+  } \
+  static inline esp_err_t app_post_##name##_timeout(const type * data, TickType_t ticks_to_wait) { \
+    return app_post_event_timeout(APP_EVENT_##ID, data, sizeof(type), ticks_to_wait); \
+  } \
+  static inline esp_err_t app_post_##name##_isr(const type * data) { \
+    return app_post_event_isr(APP_EVENT_##ID, data, sizeof(type)); \
+  } \
+  static inline void app_subscribe_##name( \
+    app_event_loop_t loop, app_##name##_handler_t handler, void * arg, const char * handler_name \
+  ) { \
+    app_register_evt_handler(loop, APP_EVENT_##ID, (app_event_fn_t) handler, arg, handler_name); \
+  }
+
+APP_EVENTS(APP_EVENT_HELPERS)
+
+
+// registers a typed handler under its function name for the handler stats
+#define app_subscribe(loop, name, handler, arg) \
+  app_subscribe_##name(loop, handler, arg, #handler)
 
 
 #ifdef __cplusplus
 }
-#endif
\ No newline at end of file
+#endif
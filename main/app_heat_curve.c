@@ -0,0 +1,50 @@
+#include <math.h>
+
+#include "./app_heat_curve.h"
+
+
+#define CDEG_PER_DEG 100
+#define LAST_POINT (APP_HEAT_CURVE_POINTS - 1)
+
+
+
+void app_heat_curve_init(
+  app_heat_curve_t * curve,
+  int8_t design_temp,
+  uint8_t design_duty,
+  int8_t limit_temp,
+  uint16_t exponent_x100
+) {
+  const float span = limit_temp - design_temp;
+  const float exponent = exponent_x100 / 100.0f;
+
+  for (int i = 0; i < APP_HEAT_CURVE_POINTS; i++) {
+    const int temp = APP_HEAT_CURVE_MIN_TEMP + i;
+    // share of the design load, beyond the design temperature it keeps rising
+    const float load = (span > 0) ? (limit_temp - temp) / span : 0;
+    const float duty = (load > 0) ? design_duty * powf(load, exponent) : 0;
+
+    curve->duty_q8[i] = lroundf(fminf(duty, 100) * 256);
+  }
+}
+
+
+
+uint8_t app_heat_curve_duty(const app_heat_curve_t * curve, int32_t outdoor_cdeg, int32_t target_cdeg) {
+  // a warmer room needs what the reference room needs when colder outside
+  const int32_t shifted = outdoor_cdeg - (target_cdeg - APP_HEAT_CURVE_ROOM_TEMP * CDEG_PER_DEG);
+  const int32_t pos = shifted - APP_HEAT_CURVE_MIN_TEMP * CDEG_PER_DEG;
+
+  uint32_t duty_q8;
+  if (pos <= 0) {
+    duty_q8 = curve->duty_q8[0];
+  } else if (pos >= LAST_POINT * CDEG_PER_DEG) {
+    duty_q8 = curve->duty_q8[LAST_POINT];
+  } else {
+    const int32_t i = pos / CDEG_PER_DEG;
+    const int32_t frac = pos % CDEG_PER_DEG;
+    duty_q8 = (curve->duty_q8[i] * (CDEG_PER_DEG - frac) + curve->duty_q8[i + 1] * frac) / CDEG_PER_DEG;
+  }
+  // rounded to the nearest duty step
+  return (duty_q8 + 128) >> 8;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// Heat curve, the base duty for an outdoor temperature.
+// The curve is precomputed into a table of 1 °C steps, a lookup only
+// interpolates between two of them in fixed point. The room controller
+// trims the base duty, so a cold snap raises the heat before the room
+// cools down.
+
+#define APP_HEAT_CURVE_MIN_TEMP -30
+#define APP_HEAT_CURVE_MAX_TEMP 30
+#define APP_HEAT_CURVE_POINTS (APP_HEAT_CURVE_MAX_TEMP - APP_HEAT_CURVE_MIN_TEMP + 1)
+
+// room temperature the curve is for, other targets shift it in parallel
+#define APP_HEAT_CURVE_ROOM_TEMP 20
+
+
+typedef struct {
+  // duty % in Q8, from APP_HEAT_CURVE_MIN_TEMP up
+  uint16_t duty_q8[APP_HEAT_CURVE_POINTS];
+} app_heat_curve_t;
+
+
+// The curve runs from `design_duty` at `design_temp` down to no heat at
+// `limit_temp`, both in °C outdoors. `exponent_x100` bends it, 100 is a
+// straight line.
+void app_heat_curve_init(
+  app_heat_curve_t * curve,
+  int8_t design_temp,
+  uint8_t design_duty,
+  int8_t limit_temp,
+  uint16_t exponent_x100
+);
+
+// Base duty for the outdoor temperature and the room target, in 1/100 °C.
+uint8_t app_heat_curve_duty(const app_heat_curve_t * curve, int32_t outdoor_cdeg, int32_t target_cdeg);
+
+
+#ifdef __cplusplus
+}
+#endif
@@ -15,8 +15,8 @@
 
 #include "hap_fw_upgrade.h"
 
-#include "./app_thermostat.h"
 #include "./app_events.h"
+#include "./app_state.h"
 
 
 /*  Required for server verification during OTA, PEM format as string  */
@@ -29,6 +29,10 @@ static const char *TAG = "app-homekit";
 #define THERMO_TASK_NAME      "hap_thermo"
 
 
+// the thermostat service of each zone
+static hap_serv_t * services[APP_ZONES] = {0};
+
+
 
 static void hap_set_float(hap_serv_t * hs, const char * type_uuid, float val) {
   hap_val_t hval = {.f = val};
@@ -51,7 +55,7 @@ static void hap_set_uint(hap_serv_t * hs, const char * type_uuid, uint32_t val)
 static int thermo_identify(hap_acc_t *ha) {
   // TODO: flash status LED a few times, i.e. dispatch app event to do so
   ESP_LOGI(TAG, "accessory identified");
-  app_post_event(APP_EVENT_IDENTIFY, NULL, 0);
+  app_post_identify(NULL);
   return HAP_SUCCESS;
 }
 
@@ -111,8 +115,13 @@ static int thermo_write(hap_write_data_t write_data[], int count, void *serv_pri
     if (!strcmp(hap_char_get_type_uuid(write->hc), HAP_CHAR_UUID_TARGET_TEMPERATURE)) {
       ESP_LOGI(TAG, "write HAP_CHAR_UUID_TARGET_TEMPERATURE");
 
-      float target_temp = write->val.f;
-      app_post_event(APP_EVENT_TARGET_TEMP_CHANGED, &target_temp, sizeof(target_temp));
+      app_traced_temp_t target_temp = {
+        .temp = write->val.f,
+        .trace = app_trace_begin(APP_TRACE_ORIGIN_HOMEKIT),
+        // set as the service's private data
+        .zone = (uint8_t) (intptr_t) serv_priv
+      };
+      app_post_target_temp_changed(&target_temp);
     }
   }
   return ret;
@@ -120,37 +129,79 @@ static int thermo_write(hap_write_data_t write_data[], int count, void *serv_pri
 
 
 
-static void handle_thermo_change(void* arg, esp_event_base_t evt_base, int32_t evt_id, void* data) {
-  hap_serv_t * service = (hap_serv_t *) arg;
-  app_thermostat_state_t * state = (app_thermostat_state_t*) data;
+static void handle_thermo_change(void* arg, uint32_t changed, const app_state_t* state) {
+  hap_serv_t * service = services[state->zone];
+  if (service == NULL) {
+    return;
+  }
 
-  float temp = roundf(state->current_temp * 10) / 10;
-  // HAP spec need to use increments of 1 despite accepting a float
-  float humid = roundf(state->current_humid * 100) / 100;
+  if (changed & APP_STATE_FIELD_CURRENT_TEMP) {
+    float temp = roundf(state->current_temp * 10) / 10;
+    hap_set_float(service, HAP_CHAR_UUID_CURRENT_TEMPERATURE, temp);
+  }
 
-  hap_set_float(service, HAP_CHAR_UUID_CURRENT_TEMPERATURE, temp);
-  hap_set_float(service, HAP_CHAR_UUID_CURRENT_RELATIVE_HUMIDITY, humid);
-  // hap_set_float(service, HAP_CHAR_UUID_TARGET_TEMPERATURE, stats->target_temp);
+  if (changed & APP_STATE_FIELD_CURRENT_HUMID) {
+    // HAP spec need to use increments of 1 despite accepting a float
+    float humid = roundf(state->current_humid * 100) / 100;
+    hap_set_float(service, HAP_CHAR_UUID_CURRENT_RELATIVE_HUMIDITY, humid);
+  }
 
-  if (state->heat < 20) {
-    hap_set_uint(service, HAP_CHAR_UUID_CURRENT_HEATING_COOLING_STATE, 0);
-  } else {
-    hap_set_uint(service, HAP_CHAR_UUID_CURRENT_HEATING_COOLING_STATE, 1);
+  // e.g. from the schedule
+  if (changed & APP_STATE_FIELD_TARGET_TEMP) {
+    hap_set_float(service, HAP_CHAR_UUID_TARGET_TEMPERATURE, state->target_temp);
   }
 
-  if (state->temp_state != APP_THERMOSTAT_TEMP_OK) {
-    ESP_LOGE(TAG, "state error %d", state->temp_state);
-    hap_set_uint(service, HAP_CHAR_UUID_STATUS_LOW_BATTERY, 1);
+  if (changed & APP_STATE_FIELD_HEAT) {
+    if (state->heat < 20) {
+      hap_set_uint(service, HAP_CHAR_UUID_CURRENT_HEATING_COOLING_STATE, 0);
+    } else {
+      hap_set_uint(service, HAP_CHAR_UUID_CURRENT_HEATING_COOLING_STATE, 1);
+    }
+  }
 
-  } else {
-    ESP_LOGE(TAG, "state OK %d", state->temp_state);
-    hap_set_uint(service, HAP_CHAR_UUID_STATUS_LOW_BATTERY, 0);
+  if (changed & APP_STATE_FIELD_TEMP_STATE) {
+    if (state->temp_state != APP_STATE_TEMP_OK) {
+      ESP_LOGE(TAG, "state error %d", state->temp_state);
+      hap_set_uint(service, HAP_CHAR_UUID_STATUS_LOW_BATTERY, 1);
+
+    } else {
+      ESP_LOGE(TAG, "state OK %d", state->temp_state);
+      hap_set_uint(service, HAP_CHAR_UUID_STATUS_LOW_BATTERY, 0);
+    }
   }
 }
 
 
 
-void app_start_homekit(char * model, char * hw_rev, char * serial_num, float target_temp) {
+static hap_serv_t * create_zone_service(uint8_t zone, float target_temp) {
+  // TODO: get initial values from main
+  hap_serv_t * service = hap_serv_thermostat_create(
+    0 /*0=OFF, 1=HEAT, 2=COOL*/,
+    3 /* TODO: 3=AUTO */,
+    20, target_temp,
+    0 /* 0=Celsius */
+  );
+
+  hap_char_t * humid = hap_char_current_relative_humidity_create(50);
+  hap_serv_add_char(service, humid);
+
+  hap_char_t * batt = hap_char_status_low_battery_create(0);
+  hap_serv_add_char(service, batt);
+
+  if (zone > 0) {
+    char name[16];
+    snprintf(name, sizeof(name), "Zone %u", zone + 1);
+    hap_serv_add_char(service, hap_char_name_create(name));
+  }
+
+  hap_serv_set_priv(service, (void *) (intptr_t) zone);
+  hap_serv_set_write_cb(service, thermo_write);
+  return service;
+}
+
+
+
+void app_start_homekit(char * model, char * hw_rev, char * serial_num, const float * target_temps, uint8_t zone_count) {
 
   /* Configure HomeKit core to make the Accessory name (and thus the WAC SSID) unique,
    * instead of the default configuration wherein only the WAC SSID is made unique.
@@ -183,23 +234,11 @@ void app_start_homekit(char * model, char * hw_rev, char * serial_num, float tar
   uint8_t product_data[] = {'E','S','P','3','2','H','A','P'};
   hap_acc_add_product_data(accessory, product_data, sizeof(product_data));
 
-  // TODO: get initial values from main
-  hap_serv_t * service = hap_serv_thermostat_create(
-    0 /*0=OFF, 1=HEAT, 2=COOL*/,
-    3 /* TODO: 3=AUTO */,
-    20, target_temp,
-    0 /* 0=Celsius */
-  );
-
-  hap_char_t * humid = hap_char_current_relative_humidity_create(50);
-  hap_serv_add_char(service, humid);
-
-  hap_char_t * batt = hap_char_status_low_battery_create(0);
-  hap_serv_add_char(service, batt);
-
-  hap_serv_set_write_cb(service, thermo_write);
-
-  hap_acc_add_serv(accessory, service);
+  // a thermostat service per zone on the one accessory
+  for (uint8_t zone = 0; zone < zone_count && zone < APP_ZONES; zone++) {
+    services[zone] = create_zone_service(zone, target_temps[zone]);
+    hap_acc_add_serv(accessory, services[zone]);
+  }
   // hap_acc_add_serv(accessory, temp_srv);
 
   hap_add_accessory(accessory);
@@ -207,10 +246,13 @@ void app_start_homekit(char * model, char * hw_rev, char * serial_num, float tar
   /* Register an event handler for HomeKit specific events */
   esp_event_handler_register(HAP_EVENT, ESP_EVENT_ANY_ID, &thermo_hap_event_handler, NULL);
 
-  // TODO: why is hs != service
-  hap_serv_t * hs = hap_acc_get_serv_by_uuid(accessory, HAP_SERV_UUID_THERMOSTAT);
-
-  app_register_evt_handler(APP_EVENT_THERMOSTAT_CHANGED, handle_thermo_change, hs);
+  app_state_subscribe(
+    APP_EVENT_LOOP_TELEMETRY,
+    APP_STATE_FIELD_CURRENT_TEMP | APP_STATE_FIELD_TARGET_TEMP | APP_STATE_FIELD_CURRENT_HUMID
+      | APP_STATE_FIELD_HEAT | APP_STATE_FIELD_TEMP_STATE,
+    handle_thermo_change,
+    NULL
+  );
 
   ESP_LOGI(TAG, "Accessory is paired with %d controllers", hap_get_paired_controller_count());
 
@@ -1,11 +1,14 @@
 #pragma once
 
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 
-void app_start_homekit(char * model, char * hw_rev, char * serial_num, float target_temp);
+// A thermostat service per zone, `target_temps` holds one per zone.
+void app_start_homekit(char * model, char * hw_rev, char * serial_num, const float * target_temps, uint8_t zone_count);
 
 #ifdef __cplusplus
 }
@@ -22,6 +22,9 @@
 #include "./app_events.h"
 #include "./app_restarter.h"
 #include "./app_stats.h"
+#include "./app_recorder.h"
+#include "./app_trace.h"
+#include "./app_schedule.h"
 
 
 static const char* TAG = "app";
@@ -32,16 +35,20 @@ typedef struct {
   char * hw_serial;
   char * hw_rev;
 
-  uint8_t gpio_pwm;
+  // zone 0 from the factory "app" namespace, further zones from "app1", ...
+  uint8_t zone_count;
+  uint8_t gpio_pwm[APP_ZONES];
   uint8_t gpio_temp;
   uint8_t gpio_led;
   uint8_t heat_min;
   uint8_t heat_normal;
   uint8_t heat_max;
   uint8_t heat_cycle_sec;
-  float target_temp;
+  float target_temp[APP_ZONES];
 
-  esp_bd_addr_t ble_themometer_addr;
+  esp_bd_addr_t ble_themometer_addr[APP_ZONES];
+  // optional, all zeros without an outdoor thermometer
+  esp_bd_addr_t ble_outdoor_addr;
 
   char * mqtt_uri;
   char * mqtt_root_ca;
@@ -95,6 +102,7 @@ static void init_system() {
   ESP_LOGI(TAG, "IDF version: %s", esp_get_idf_version());
 
   esp_event_loop_create_default();
+  app_start_event_loops();
 
   init_nvs();
 }
@@ -171,7 +179,7 @@ static esp_err_t init_app_config(app_config_t * config) {
   err = get_str(handle, "hw_model", &config->hw_model);
   err = get_str(handle, "hw_rev", &config->hw_rev);
 
-  err = get_u8(handle, "gpio_pwm", &config->gpio_pwm);
+  err = get_u8(handle, "gpio_pwm", &config->gpio_pwm[0]);
   err = get_u8(handle, "gpio_temp", &config->gpio_temp);
   err = get_u8(handle, "gpio_led", &config->gpio_led);
 
@@ -180,7 +188,8 @@ static esp_err_t init_app_config(app_config_t * config) {
   err = get_u8(handle, "heat_max", &config->heat_max);
   err = get_u8(handle, "heat_cycle", &config->heat_cycle_sec);
 
-  err = get_blob(handle, "ble_thermo_addr", (char *) &config->ble_themometer_addr);
+  err = get_blob(handle, "ble_thermo_addr", (char *) &config->ble_themometer_addr[0]);
+  err = get_blob(handle, "ble_outdoor_addr", (char *) &config->ble_outdoor_addr);
 
   err = get_str(handle, "mqtt_uri", &config->mqtt_uri);
   err = get_str(handle, "root_cert_pem", &config->mqtt_root_ca);
@@ -197,11 +206,43 @@ static esp_err_t init_app_config(app_config_t * config) {
 
 
 
-static float load_target_temp(float default_target_temp) {
+// a zone exists if its factory namespace has a valve and a sensor,
+// the zones are numbered without gaps
+static void init_zone_config(app_config_t * config) {
+  config->zone_count = 1;
+
+  for (uint8_t zone = 1; zone < APP_ZONES; zone++) {
+    char name[APP_ZONE_NVS_NAME_SIZE];
+    app_zone_nvs_namespace(name, "app", zone);
+
+    nvs_handle handle;
+    if (nvs_open_from_partition("factory_nvs", name, NVS_READONLY, &handle) != ESP_OK) {
+      break;
+    }
+    esp_err_t err = get_u8(handle, "gpio_pwm", &config->gpio_pwm[zone]);
+    if (err == ESP_OK) {
+      err = get_blob(handle, "ble_thermo_addr", (char *) &config->ble_themometer_addr[zone]);
+    }
+    nvs_close(handle);
+
+    if (err != ESP_OK) {
+      break;
+    }
+    config->zone_count = zone + 1;
+  }
+  ESP_LOGI(TAG, "%d heating zones", config->zone_count);
+}
+
+
+
+static float load_target_temp(uint8_t zone, float default_target_temp) {
   float target_temp = default_target_temp;
 
+  char name[APP_ZONE_NVS_NAME_SIZE];
+  app_zone_nvs_namespace(name, "storage", zone);
+
   nvs_handle_t nvs_handle;
-  esp_err_t err = nvs_open("storage", NVS_READWRITE, &nvs_handle);
+  esp_err_t err = nvs_open(name, NVS_READWRITE, &nvs_handle);
 
   if (err != ESP_OK) {
     ESP_LOGE(TAG, "Error (%s) opening NVS handle!", esp_err_to_name(err));
@@ -231,6 +272,27 @@ static float load_target_temp(float default_target_temp) {
 }
 
 
+// a heat cycle recommended by the autotune overrides the factory one
+static void load_heat_cycle(uint8_t * heat_cycle_sec) {
+  nvs_handle_t nvs_handle;
+  esp_err_t err = nvs_open("storage", NVS_READONLY, &nvs_handle);
+
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Error (%s) opening NVS handle!", esp_err_to_name(err));
+    return;
+  }
+
+  uint8_t tuned;
+  if (nvs_get_u8(nvs_handle, "heat_cycle", &tuned) == ESP_OK) {
+    ESP_LOGI(TAG, "Using tuned heat_cycle %u instead of %u", tuned, *heat_cycle_sec);
+    *heat_cycle_sec = tuned;
+  }
+
+  nvs_close(nvs_handle);
+}
+
+
+
 static void patch_config() {
 
   nvs_handle_t nvs_handle;
@@ -258,20 +320,34 @@ void app_main(void) {
   ESP_LOGI(TAG, "starting...");
   init_system();
 
+  app_start_recorder();
+  app_start_trace_reporter();
+
   patch_config();
 
   app_config_t conf = {
-    .gpio_pwm = 25,
+    .gpio_pwm = {25},
     .gpio_temp = 26,
     .gpio_led = 27,
     .heat_min = 15,
     .heat_normal = 50,
     .heat_max = 70,
     .heat_cycle_sec = 1,
-    .target_temp = load_target_temp(15),
-    .ble_themometer_addr = {0},
+    .ble_themometer_addr = {{0}},
+    .ble_outdoor_addr = {0},
   };
   init_app_config(&conf);
+  init_zone_config(&conf);
+  load_heat_cycle(&conf.heat_cycle_sec);
+
+  app_thermostat_zone_t zones[APP_ZONES];
+  for (uint8_t zone = 0; zone < conf.zone_count; zone++) {
+    conf.target_temp[zone] = load_target_temp(zone, 15);
+    zones[zone] = (app_thermostat_zone_t) {
+      .gpio_pwm = conf.gpio_pwm[zone],
+      .target_temp = conf.target_temp[zone],
+    };
+  }
 
   esp_http_client_config_t ota_config = {
     .url = conf.ota_uri,
@@ -291,9 +367,9 @@ void app_main(void) {
 
   app_start_networking(portMAX_DELAY);
 
-  app_start_homekit(conf.hw_model, conf.hw_rev, conf.hw_serial, conf.target_temp);
+  app_start_homekit(conf.hw_model, conf.hw_rev, conf.hw_serial, conf.target_temp, conf.zone_count);
 
-  app_start_thermometer(conf.gpio_temp, conf.ble_themometer_addr);
+  app_start_thermometer(conf.gpio_temp, conf.ble_themometer_addr, conf.zone_count, conf.ble_outdoor_addr);
 
   app_start_restart_handler();
 
@@ -301,16 +377,17 @@ void app_main(void) {
 
   app_start_timekeeper();
 
+  app_start_schedule();
+
   app_start_stats_handler(conf.gpio_led);
 
   app_start_thermostat(
-    conf.gpio_pwm,
+    zones, conf.zone_count,
     conf.heat_min, conf.heat_normal, conf.heat_max,
-    conf.heat_cycle_sec,
-    conf.target_temp
+    conf.heat_cycle_sec
   );
 
-  app_post_event(APP_EVENT_STARTED, NULL, 0);
+  app_post_started(NULL);
 
   // TODO: should wait for a restart event
   ESP_LOGI(TAG, "all tasks started");
@@ -0,0 +1,188 @@
+#include <math.h>
+#include <string.h>
+
+#include "./app_model.h"
+
+
+// forgets old samples with a time constant of ~500 ticks
+#define FORGETTING 0.998f
+// P is no longer inflated by the forgetting beyond this trace, it would
+// otherwise blow up while the heat does not change
+#define MAX_P_TRACE 1e4f
+#define INITIAL_P 100.0f
+// weight of the newest squared error in the mse, ~50 ticks
+#define MSE_WEIGHT 0.02f
+
+#define MS_PER_HOUR (3600 * 1000.0f)
+
+
+
+static void init_estimator(app_model_estimator_t * estimator) {
+  memset(estimator, 0, sizeof(app_model_estimator_t));
+  for (int i = 0; i < 3; i++) {
+    estimator->p[i][i] = INITIAL_P;
+  }
+  estimator->mse = -1;
+}
+
+
+
+static void update_estimator(app_model_estimator_t * e, const float phi[3], float y) {
+  float p_phi[3];
+  float denom = FORGETTING;
+  for (int i = 0; i < 3; i++) {
+    p_phi[i] = e->p[i][0] * phi[0] + e->p[i][1] * phi[1] + e->p[i][2] * phi[2];
+    denom += phi[i] * p_phi[i];
+  }
+
+  const float err = y - (e->theta[0] * phi[0] + e->theta[1] * phi[1] + e->theta[2] * phi[2]);
+  e->mse = (e->mse < 0) ? err * err : e->mse + MSE_WEIGHT * (err * err - e->mse);
+
+  float gain[3];
+  for (int i = 0; i < 3; i++) {
+    gain[i] = p_phi[i] / denom;
+    e->theta[i] += gain[i] * err;
+  }
+
+  const float trace = e->p[0][0] + e->p[1][1] + e->p[2][2];
+  const float forget = (trace < MAX_P_TRACE) ? FORGETTING : 1.0f;
+
+  // symmetric update, keeps P from drifting apart in single precision
+  for (int i = 0; i < 3; i++) {
+    for (int j = i; j < 3; j++) {
+      const float value = (e->p[i][j] - gain[i] * p_phi[j]) / forget;
+      e->p[i][j] = value;
+      e->p[j][i] = value;
+    }
+  }
+}
+
+
+
+static bool plausible(const app_model_estimator_t * e) {
+  return e->mse >= 0 && e->theta[0] > 0 && e->theta[1] > 0;
+}
+
+
+
+// the plausible estimator with the smallest error, or -1
+static int best_dead_time(const app_model_t * model) {
+  int best = -1;
+  for (int d = 0; d < APP_MODEL_DEAD_TIMES; d++) {
+    const app_model_estimator_t * e = &(model->params.estimators[d]);
+    if (plausible(e) && (best < 0 || e->mse < model->params.estimators[best].mse)) {
+      best = d;
+    }
+  }
+  return best;
+}
+
+
+
+void app_model_init(app_model_t * model, uint32_t dt_ms) {
+  memset(model, 0, sizeof(app_model_t));
+  model->params.dt_ms = dt_ms;
+  for (int d = 0; d < APP_MODEL_DEAD_TIMES; d++) {
+    init_estimator(&(model->params.estimators[d]));
+  }
+}
+
+
+
+bool app_model_restore(app_model_t * model, const app_model_params_t * params) {
+  if (params->dt_ms != model->params.dt_ms) {
+    return false;
+  }
+  model->params = *params;
+  return true;
+}
+
+
+
+void app_model_update(app_model_t * model, float temp, uint8_t duty) {
+  memmove(&(model->duty_history[1]), &(model->duty_history[0]), APP_MODEL_DEAD_TIMES - 1);
+  model->duty_history[0] = duty;
+
+  if (model->has_prev) {
+    const float change = temp - model->prev_temp;
+    for (int d = 0; d < APP_MODEL_DEAD_TIMES; d++) {
+      const float phi[3] = { model->duty_history[d], -model->prev_temp, 1 };
+      update_estimator(&(model->params.estimators[d]), phi, change);
+    }
+    model->params.samples += 1;
+  }
+
+  model->prev_temp = temp;
+  model->has_prev = true;
+}
+
+
+
+void app_model_skip(app_model_t * model) {
+  model->has_prev = false;
+}
+
+
+
+bool app_model_valid(const app_model_t * model) {
+  return model->params.samples >= APP_MODEL_MIN_SAMPLES && best_dead_time(model) >= 0;
+}
+
+
+
+void app_model_get_fit(const app_model_t * model, app_model_fit_t * fit) {
+  const int d = best_dead_time(model);
+  const float ticks_per_hour = MS_PER_HOUR / model->params.dt_ms;
+
+  *fit = (app_model_fit_t) {
+    .samples = model->params.samples,
+    .valid = app_model_valid(model),
+  };
+  if (d < 0) {
+    return;
+  }
+
+  const app_model_estimator_t * e = &(model->params.estimators[d]);
+  fit->gain = e->theta[0] * ticks_per_hour;
+  fit->loss = e->theta[1] * ticks_per_hour;
+  fit->ambient = e->theta[2] / e->theta[1];
+  fit->rms_error = sqrtf(e->mse);
+  fit->dead_time_sec = d * model->params.dt_ms / 1000;
+}
+
+
+
+uint8_t app_model_choose_duty(
+  const app_model_t * model, float temp, float target, uint8_t out_min, uint8_t out_max, uint16_t horizon
+) {
+  const int d = best_dead_time(model);
+  if (d < 0) {
+    return out_min;
+  }
+  const float * theta = model->params.estimators[d].theta;
+
+  // a new duty only shows after the dead time, look that much further
+  const int ticks = horizon + d;
+
+  uint8_t best_duty = out_min;
+  float best_cost = INFINITY;
+
+  for (int duty = out_min; duty <= out_max; duty++) {
+    float t = temp;
+    float cost = 0;
+
+    for (int k = 0; k < ticks; k++) {
+      // duty of earlier ticks still in the dead time, then the new one
+      const float u = (k < d) ? model->duty_history[d - k - 1] : duty;
+      t += theta[0] * u - theta[1] * t + theta[2];
+      cost += (t - target) * (t - target);
+    }
+
+    // ties go to the lower duty
+    if (cost < best_cost) {
+      best_cost = cost;
+      best_duty = duty;
+    }
+  }
+  return best_duty;
+}
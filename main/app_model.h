@@ -0,0 +1,99 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// First-order RC model of the room, learned online:
+//
+//   T[k+1] - T[k] = gain * u[k - dead_time] - loss * T[k] + c
+//
+// per control tick, u is the heat duty in %. The ambient temperature the
+// room falls to without heat is c / loss.
+// One recursive least squares estimator runs for every candidate dead time
+// of 0 .. APP_MODEL_DEAD_TIMES - 1 ticks, the one predicting best is used.
+
+#define APP_MODEL_DEAD_TIMES 16
+
+// updates before a model is trusted to choose the duty
+#define APP_MODEL_MIN_SAMPLES 240
+
+
+typedef struct {
+  // gain, loss, c
+  float theta[3];
+  float p[3][3];
+  // exponentially weighted a priori squared error, in °C² per tick
+  float mse;
+} app_model_estimator_t;
+
+
+// What is learned and kept in NVS.
+typedef struct {
+  uint32_t dt_ms;
+  uint32_t samples;
+  app_model_estimator_t estimators[APP_MODEL_DEAD_TIMES];
+} app_model_params_t;
+
+
+typedef struct {
+  app_model_params_t params;
+
+  // duty of the last intervals, newest first
+  uint8_t duty_history[APP_MODEL_DEAD_TIMES];
+  float prev_temp;
+  bool has_prev;
+} app_model_t;
+
+
+// The best fit in physical units, payload of APP_EVENT_MODEL_FIT.
+typedef struct {
+  // °C/h per duty %
+  float gain;
+  // 1/h
+  float loss;
+  // °C
+  float ambient;
+  // a priori prediction error of one tick, °C rms
+  float rms_error;
+  uint32_t samples;
+  uint16_t dead_time_sec;
+  bool valid;
+  // heating zone of the model, set by its owner
+  uint8_t zone;
+} app_model_fit_t;
+
+
+void app_model_init(app_model_t * model, uint32_t dt_ms);
+
+// Takes over learned params, unless they were learned at another rate.
+bool app_model_restore(app_model_t * model, const app_model_params_t * params);
+
+// Feeds the temperature at a control tick and the duty applied since the
+// previous tick.
+void app_model_update(app_model_t * model, float temp, uint8_t duty);
+
+// Leaves a gap in the samples, e.g. on sensor errors.
+void app_model_skip(app_model_t * model);
+
+bool app_model_valid(const app_model_t * model);
+
+void app_model_get_fit(const app_model_t * model, app_model_fit_t * fit);
+
+// Predicts `horizon` ticks ahead for every constant duty in
+// [out_min, out_max], including the duty of earlier ticks still on its way
+// through the dead time, and returns the one closest to the target.
+// Only meaningful when app_model_valid().
+uint8_t app_model_choose_duty(
+  const app_model_t * model, float temp, float target, uint8_t out_min, uint8_t out_max, uint16_t horizon
+);
+
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,3 +1,5 @@
+#include <math.h>
+
 #include "esp_log.h"
 #include "esp_wifi.h"
 #include "esp_event.h"
@@ -5,24 +7,40 @@
 #include "mqtt_client.h"
 
 #include "cJSON.h"
+#include "slow_pwm.h"
 
+#include "./app_autotune.h"
 #include "./app_events.h"
-#include "./app_stats.h"
+#include "./app_pid.h"
+#include "./app_schedule.h"
+#include "./app_state.h"
 #include "./app_thermostat.h"
+#include "./app_trace.h"
 
 
 static const char* TAG = "app-mqtt";
 
+#define MAX_TOPIC_LEN 96
+
 typedef struct {
   esp_mqtt_client_handle_t client;
   const char * topic_prefix;
 } ctx_t;
 
 
+// zone 0 keeps the topics of a single zone device, the others are under /zones/<n>
+static void zone_topic(char * zoned, uint8_t zone, const char * topic) {
+  if (zone == 0) {
+    snprintf(zoned, MAX_TOPIC_LEN, "%s", topic);
+  } else {
+    snprintf(zoned, MAX_TOPIC_LEN, "/zones/%u%s", zone, topic);
+  }
+}
+
+
 static bool topic_matches(esp_mqtt_event_handle_t event, ctx_t * ctx, const char * topic) {
-  const size_t max_char = 50;
-  char * full_topic = malloc(max_char);
-  const size_t len = snprintf(full_topic, 50, "%s%s", ctx->topic_prefix, topic);
+  char * full_topic = malloc(MAX_TOPIC_LEN);
+  const size_t len = snprintf(full_topic, MAX_TOPIC_LEN, "%s%s", ctx->topic_prefix, topic);
 
   const bool result = (
     (len == event->topic_len)
@@ -34,9 +52,23 @@ static bool topic_matches(esp_mqtt_event_handle_t event, ctx_t * ctx, const char
 }
 
 
+// matches `topic` of any zone and sets the zone it is of
+static bool zone_topic_matches(esp_mqtt_event_handle_t event, ctx_t * ctx, const char * topic, uint8_t * zone) {
+  char zoned[MAX_TOPIC_LEN];
+  for (uint8_t z = 0; z < APP_ZONES; z++) {
+    zone_topic(zoned, z, topic);
+    if (topic_matches(event, ctx, zoned)) {
+      *zone = z;
+      return true;
+    }
+  }
+  return false;
+}
+
+
 static void subscribe(ctx_t * ctx, const char * topic) {
-  char * full_topic = malloc(50);
-  snprintf(full_topic, 50, "%s%s", ctx->topic_prefix, topic);
+  char * full_topic = malloc(MAX_TOPIC_LEN);
+  snprintf(full_topic, MAX_TOPIC_LEN, "%s%s", ctx->topic_prefix, topic);
 
   ESP_LOGI(TAG, "subscribing to MQTT topic %s", full_topic);
 
@@ -45,9 +77,54 @@ static void subscribe(ctx_t * ctx, const char * topic) {
 }
 
 
+// like tm_wday
+static const char * day_names[7] = {"sun", "mon", "tue", "wed", "thu", "fri", "sat"};
+
+
+// {"entries": [{"days": ["mon", ...], "time": "06:30", "target": 21.5}, ...]}
+static bool parse_schedule(const cJSON * root, app_schedule_t * schedule) {
+  const cJSON * entries = cJSON_GetObjectItem(root, "entries");
+  const int count = cJSON_GetArraySize(entries);
+  if (!cJSON_IsArray(entries) || count > APP_SCHEDULE_MAX_ENTRIES) {
+    return false;
+  }
+
+  schedule->count = count;
+  for (int i = 0; i < count; i++) {
+    const cJSON * item = cJSON_GetArrayItem(entries, i);
+    const cJSON * days = cJSON_GetObjectItem(item, "days");
+    const cJSON * at = cJSON_GetObjectItem(item, "time");
+    const cJSON * target = cJSON_GetObjectItem(item, "target");
+
+    unsigned hour, minute;
+    if (
+      !cJSON_IsArray(days) || !cJSON_IsString(at) || !cJSON_IsNumber(target)
+      || sscanf(at->valuestring, "%u:%u", &hour, &minute) != 2 || hour > 23 || minute > 59
+    ) {
+      return false;
+    }
+
+    app_schedule_entry_t * entry = &(schedule->entries[i]);
+    *entry = (app_schedule_entry_t) {
+      .minute = hour * 60 + minute,
+      .target_cdeg = lround(target->valuedouble * 100),
+    };
+    for (int d = 0; d < cJSON_GetArraySize(days); d++) {
+      const cJSON * day = cJSON_GetArrayItem(days, d);
+      for (int wday = 0; wday < 7; wday++) {
+        if (cJSON_IsString(day) && strcmp(day->valuestring, day_names[wday]) == 0) {
+          entry->days |= 1 << wday;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+
 static void publish(ctx_t * ctx, const char *topic, const char *data, int len, int qos, int retain) {
-  char * full_topic = malloc(50);
-  snprintf(full_topic, 50, "%s%s", ctx->topic_prefix, topic);
+  char * full_topic = malloc(MAX_TOPIC_LEN);
+  snprintf(full_topic, MAX_TOPIC_LEN, "%s%s", ctx->topic_prefix, topic);
 
   ESP_LOGI(TAG, "publish %s %s", full_topic, data);
   esp_mqtt_client_publish(ctx->client, full_topic, data, len, qos, retain);
@@ -55,6 +132,13 @@ static void publish(ctx_t * ctx, const char *topic, const char *data, int len, i
 }
 
 
+static void publish_zone(ctx_t * ctx, uint8_t zone, const char *topic, const char *data) {
+  char zoned[MAX_TOPIC_LEN];
+  zone_topic(zoned, zone, topic);
+  publish(ctx, zoned, data, 0, 0, 0);
+}
+
+
 
 static void handle_ip_event(void* arg, esp_event_base_t evt_base, int32_t evt_id, void* data) {
   esp_mqtt_client_handle_t client = (esp_mqtt_client_handle_t) arg;
@@ -68,10 +152,23 @@ static void handle_ip_event(void* arg, esp_event_base_t evt_base, int32_t evt_id
 static void handle_connected(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data) {
   ctx_t * ctx = (ctx_t *) arg;
   subscribe(ctx, "/target-temp/set");
+  subscribe(ctx, "/controller/mode/set");
+  subscribe(ctx, "/controller/pid/set");
+  subscribe(ctx, "/controller/autotune/start");
+  subscribe(ctx, "/controller/autotune/stop");
+  subscribe(ctx, "/schedule/set");
+  subscribe(ctx, "/schedule/get");
   subscribe(ctx, "/stats/get");
+  subscribe(ctx, "/events/metrics/get");
   subscribe(ctx, "/system/ota");
   subscribe(ctx, "/system/restart");
   subscribe(ctx, "/system/reset/#");
+
+  if (APP_ZONES > 1) {
+    subscribe(ctx, "/zones/+/target-temp/set");
+    subscribe(ctx, "/zones/+/controller/autotune/start");
+    subscribe(ctx, "/zones/+/controller/autotune/stop");
+  }
 }
 
 
@@ -86,30 +183,86 @@ static void handle_message(void *arg, esp_event_base_t event_base, int32_t event
   ESP_LOGI(TAG, "received message %.*s: %s", event->topic_len, event->topic, msg);
   free(msg);
 
+  uint8_t zone;
   if (topic_matches(event, ctx, "/system/ota")) {
-    app_post_event(APP_EVENT_OTA, NULL, 0);
+    app_post_ota(NULL);
 
   } else if (topic_matches(event, ctx, "/system/restart")) {
-    app_post_event(APP_EVENT_RESTART, NULL, 0);
+    app_post_restart(NULL);
 
   } else if (topic_matches(event, ctx, "/system/reset/factory")) {
-    app_post_event(APP_EVENT_RESET_FACTORY, NULL, 0);
+    app_post_reset_factory(NULL);
 
   } else if (topic_matches(event, ctx, "/system/reset/homekit")) {
-    app_post_event(APP_EVENT_RESET_HOMEKIT, NULL, 0);
+    app_post_reset_homekit(NULL);
 
   } else if (topic_matches(event, ctx, "/system/reset/network")) {
-    app_post_event(APP_EVENT_RESET_NETWORK, NULL, 0);
+    app_post_reset_network(NULL);
 
   } else if (topic_matches(event, ctx, "/system/reset/pairing")) {
-    app_post_event(APP_EVENT_RESET_PAIRING, NULL, 0);
+    app_post_reset_pairing(NULL);
 
   } else if (topic_matches(event, ctx, "/stats/get")) {
-    app_post_event(APP_EVENT_STATS_GET, NULL, 0);
-
-  } else if (topic_matches(event, ctx, "/target-temp/set")) {
-    float target_temp = cJSON_GetObjectItem(root, "value")->valuedouble;
-    app_post_event(APP_EVENT_TARGET_TEMP_CHANGED, &target_temp, sizeof(target_temp));
+    app_post_stats_get(NULL);
+
+  } else if (topic_matches(event, ctx, "/events/metrics/get")) {
+    app_post_metrics_get(NULL);
+
+  } else if (zone_topic_matches(event, ctx, "/target-temp/set", &zone)) {
+    app_traced_temp_t target_temp = {
+      .temp = cJSON_GetObjectItem(root, "value")->valuedouble,
+      .trace = app_trace_begin(APP_TRACE_ORIGIN_MQTT),
+      .zone = zone,
+    };
+    app_post_target_temp_changed(&target_temp);
+
+  } else if (topic_matches(event, ctx, "/controller/mode/set")) {
+    const cJSON * value = cJSON_GetObjectItem(root, "value");
+    if (cJSON_IsString(value) && strcmp(value->valuestring, "pid") == 0) {
+      uint8_t mode = APP_THERMOSTAT_MODE_PID;
+      app_post_controller_mode_set(&mode);
+    } else if (cJSON_IsString(value) && strcmp(value->valuestring, "predictive") == 0) {
+      uint8_t mode = APP_THERMOSTAT_MODE_PREDICTIVE;
+      app_post_controller_mode_set(&mode);
+    } else if (cJSON_IsString(value) && strcmp(value->valuestring, "levels") == 0) {
+      uint8_t mode = APP_THERMOSTAT_MODE_LEVELS;
+      app_post_controller_mode_set(&mode);
+    } else {
+      ESP_LOGE(TAG, "unknown controller mode");
+    }
+
+  } else if (zone_topic_matches(event, ctx, "/controller/autotune/start", &zone)) {
+    app_post_autotune_start(&zone);
+
+  } else if (zone_topic_matches(event, ctx, "/controller/autotune/stop", &zone)) {
+    app_post_autotune_stop(&zone);
+
+  } else if (topic_matches(event, ctx, "/schedule/set")) {
+    app_schedule_t * schedule = malloc(sizeof(app_schedule_t));
+    if (parse_schedule(root, schedule)) {
+      app_post_schedule_set(schedule);
+    } else {
+      ESP_LOGE(TAG, "invalid schedule");
+    }
+    free(schedule);
+
+  } else if (topic_matches(event, ctx, "/schedule/get")) {
+    app_post_schedule_get(NULL);
+
+  } else if (topic_matches(event, ctx, "/controller/pid/set")) {
+    const cJSON * kp = cJSON_GetObjectItem(root, "kp");
+    const cJSON * ki = cJSON_GetObjectItem(root, "ki");
+    const cJSON * kd = cJSON_GetObjectItem(root, "kd");
+    if (cJSON_IsNumber(kp) && cJSON_IsNumber(ki) && cJSON_IsNumber(kd)) {
+      app_pid_gains_t gains = {
+        .kp_q16 = APP_PID_Q16(kp->valuedouble),
+        .ki_q16 = APP_PID_Q16(ki->valuedouble),
+        .kd_q16 = APP_PID_Q16(kd->valuedouble),
+      };
+      app_post_pid_gains_set(&gains);
+    } else {
+      ESP_LOGE(TAG, "PID gains need kp, ki and kd");
+    }
 
   } else {
     ESP_LOGI(TAG, "no handler for topic %.*s", event->topic_len, event->topic);
@@ -119,28 +272,230 @@ static void handle_message(void *arg, esp_event_base_t event_base, int32_t event
 }
 
 
-static void handle_stats(void* arg, esp_event_base_t evt_base, int32_t evt_id, void* data) {
-  ctx_t * ctx = (ctx_t *) arg;
-  app_stats_t * stats = (app_stats_t*) data;
-  const esp_app_desc_t * desc = esp_ota_get_app_description();
-
+static void publish_stats(ctx_t * ctx, const esp_app_desc_t * desc, const app_state_t * state) {
   cJSON *json = cJSON_CreateObject();
   cJSON_AddStringToObject(json, "app_version", desc->version);
-  cJSON_AddNumberToObject(json, "current_temp", stats->current_temp);
-  cJSON_AddNumberToObject(json, "target_temp", stats->target_temp);
-  cJSON_AddNumberToObject(json, "current_humid", stats->current_humid);
-  cJSON_AddNumberToObject(json, "heat", stats->heat / 100.0);
-  cJSON_AddBoolToObject(json, "error", stats->error);
+  cJSON_AddNumberToObject(json, "current_temp", state->current_temp);
+  cJSON_AddNumberToObject(json, "target_temp", state->target_temp);
+  cJSON_AddNumberToObject(json, "current_humid", state->current_humid);
+  cJSON_AddNumberToObject(json, "heat", state->heat / 100.0);
+  cJSON_AddBoolToObject(json, "error", state->temp_state == APP_STATE_TEMP_ERROR);
+  cJSON_AddBoolToObject(json, "window_open", state->window_open);
   char * msg = cJSON_Print(json);
   cJSON_Delete(json);
 
   // TODO: QOS = 1 crash when not connected
-  publish(ctx, "/stats/report", msg, 0, 0, 0);
+  publish_zone(ctx, state->zone, "/stats/report", msg);
+  free(msg);
+}
+
+
+static void handle_stats(void* arg, app_event_t evt_id, const app_no_data_t* data) {
+  ctx_t * ctx = (ctx_t *) arg;
+  const esp_app_desc_t * desc = esp_ota_get_app_description();
+
+  for (uint8_t zone = 0; zone < APP_ZONES; zone++) {
+    app_state_t state;
+    // zones without a published state yet are left out
+    if (app_state_get(zone, &state) != 0) {
+      publish_stats(ctx, desc, &state);
+    }
+  }
+}
+
+
+#define MAX_HANDLER_STATS 48
+
+static void handle_metrics(void* arg, app_event_t evt_id, const app_no_data_t* data) {
+  ctx_t * ctx = (ctx_t *) arg;
+
+  cJSON *json = cJSON_CreateObject();
+
+  cJSON *events = cJSON_AddArrayToObject(json, "events");
+  for (int id = 0; id < APP_EVENT_MAX; id++) {
+    app_event_counters_t counters;
+    app_get_event_counters(id, &counters);
+    if (counters.posted == 0) {
+      continue;
+    }
+
+    cJSON *evt = cJSON_CreateObject();
+    cJSON_AddStringToObject(evt, "event", app_event_name(id));
+    cJSON_AddNumberToObject(evt, "posted", counters.posted);
+    cJSON_AddNumberToObject(evt, "dropped", counters.dropped);
+    cJSON_AddNumberToObject(evt, "coalesced", counters.coalesced);
+    cJSON_AddNumberToObject(evt, "received", counters.received);
+    cJSON_AddNumberToObject(evt, "delivered", counters.delivered);
+    cJSON_AddNumberToObject(evt, "queue_hwm", counters.queue_hwm);
+    cJSON_AddItemToArray(events, evt);
+  }
+
+  app_event_handler_stats_t * stats = malloc(MAX_HANDLER_STATS * sizeof(app_event_handler_stats_t));
+  const size_t count = app_get_handler_stats(stats, MAX_HANDLER_STATS);
+
+  cJSON *handlers = cJSON_AddArrayToObject(json, "handlers");
+  for (int i = 0; i < count; i++) {
+    cJSON *handler = cJSON_CreateObject();
+    cJSON_AddStringToObject(handler, "handler", stats[i].name);
+    cJSON_AddStringToObject(handler, "event", app_event_name(stats[i].evt_id));
+    cJSON_AddStringToObject(handler, "loop", stats[i].loop == APP_EVENT_LOOP_CONTROL ? "control" : "telemetry");
+    cJSON_AddNumberToObject(handler, "calls", stats[i].calls);
+    cJSON_AddNumberToObject(handler, "max_us", stats[i].max_us);
+
+    cJSON *histogram = cJSON_AddArrayToObject(handler, "histogram");
+    for (int b = 0; b < APP_EVENT_HISTOGRAM_BUCKETS; b++) {
+      cJSON_AddItemToArray(histogram, cJSON_CreateNumber(stats[i].histogram[b]));
+    }
+    cJSON_AddItemToArray(handlers, handler);
+  }
+  free(stats);
+
+  // how late the heater outputs switch
+  slow_pwm_jitter_t jitter;
+  get_pwm_jitter(&jitter);
+  cJSON *pwm = cJSON_AddObjectToObject(json, "pwm_jitter");
+  cJSON_AddNumberToObject(pwm, "edges", jitter.edges);
+  cJSON_AddNumberToObject(pwm, "max_us", jitter.max_us);
+  cJSON *histogram = cJSON_AddArrayToObject(pwm, "histogram");
+  for (int b = 0; b < SLOW_PWM_JITTER_BUCKETS; b++) {
+    cJSON_AddItemToArray(histogram, cJSON_CreateNumber(jitter.histogram[b]));
+  }
+
+  char * msg = cJSON_PrintUnformatted(json);
+  cJSON_Delete(json);
+
+  publish(ctx, "/events/metrics/report", msg, 0, 0, 0);
+  free(msg);
+}
+
+
+
+static void handle_trace_report(void* arg, app_event_t evt_id, const app_no_data_t* data) {
+  ctx_t * ctx = (ctx_t *) arg;
+
+  cJSON *json = cJSON_CreateObject();
+  for (int origin = APP_TRACE_ORIGIN_NONE + 1; origin < APP_TRACE_ORIGIN_MAX; origin++) {
+    app_trace_stats_t stats;
+    app_trace_get_stats(origin, &stats);
+
+    cJSON *latency = cJSON_AddObjectToObject(json, app_trace_origin_name(origin));
+    cJSON_AddNumberToObject(latency, "count", stats.count);
+    cJSON_AddNumberToObject(latency, "p50_us", stats.p50_us);
+    cJSON_AddNumberToObject(latency, "p90_us", stats.p90_us);
+    cJSON_AddNumberToObject(latency, "p99_us", stats.p99_us);
+    cJSON_AddNumberToObject(latency, "max_us", stats.max_us);
+  }
+  char * msg = cJSON_PrintUnformatted(json);
+  cJSON_Delete(json);
+
+  publish(ctx, "/trace/report", msg, 0, 0, 0);
+  free(msg);
+}
+
+
+static void handle_pid_terms(void* arg, app_event_t evt_id, const app_pid_terms_t* terms) {
+  ctx_t * ctx = (ctx_t *) arg;
+
+  cJSON *json = cJSON_CreateObject();
+  cJSON_AddNumberToObject(json, "error", terms->error_cdeg / 100.0);
+  cJSON_AddNumberToObject(json, "p", terms->p_q16 / 65536.0);
+  cJSON_AddNumberToObject(json, "i", terms->i_q16 / 65536.0);
+  cJSON_AddNumberToObject(json, "d", terms->d_q16 / 65536.0);
+  cJSON_AddNumberToObject(json, "feedforward", terms->feedforward);
+  cJSON_AddNumberToObject(json, "output", terms->output);
+  char * msg = cJSON_PrintUnformatted(json);
+  cJSON_Delete(json);
+
+  publish_zone(ctx, terms->zone, "/controller/pid/terms", msg);
+  free(msg);
+}
+
+
+static void handle_model_fit(void* arg, app_event_t evt_id, const app_model_fit_t* fit) {
+  ctx_t * ctx = (ctx_t *) arg;
+
+  cJSON *json = cJSON_CreateObject();
+  cJSON_AddBoolToObject(json, "valid", fit->valid);
+  cJSON_AddNumberToObject(json, "samples", fit->samples);
+  cJSON_AddNumberToObject(json, "gain", fit->gain);
+  cJSON_AddNumberToObject(json, "loss", fit->loss);
+  cJSON_AddNumberToObject(json, "ambient", fit->ambient);
+  cJSON_AddNumberToObject(json, "dead_time", fit->dead_time_sec);
+  cJSON_AddNumberToObject(json, "rms_error", fit->rms_error);
+  char * msg = cJSON_PrintUnformatted(json);
+  cJSON_Delete(json);
+
+  publish_zone(ctx, fit->zone, "/controller/model/report", msg);
+  free(msg);
+}
+
+
+static void handle_autotune_result(void* arg, app_event_t evt_id, const app_autotune_result_t* result) {
+  ctx_t * ctx = (ctx_t *) arg;
+
+  cJSON *json = cJSON_CreateObject();
+  cJSON_AddStringToObject(json, "status", app_autotune_status_name(result->status));
+  cJSON_AddNumberToObject(json, "cycles", result->cycles);
+  cJSON_AddNumberToObject(json, "ku", result->ku);
+  cJSON_AddNumberToObject(json, "tu", result->tu_sec);
+  cJSON_AddNumberToObject(json, "amplitude", result->amplitude);
+  cJSON_AddNumberToObject(json, "kp", result->gains.kp_q16 / 65536.0);
+  cJSON_AddNumberToObject(json, "ki", result->gains.ki_q16 / 65536.0);
+  cJSON_AddNumberToObject(json, "kd", result->gains.kd_q16 / 65536.0);
+  cJSON_AddNumberToObject(json, "heat_cycle", result->heat_cycle_sec);
+  char * msg = cJSON_PrintUnformatted(json);
+  cJSON_Delete(json);
+
+  publish_zone(ctx, result->zone, "/controller/autotune/result", msg);
   free(msg);
 }
 
 
-static void handle_ota(void* arg, esp_event_base_t evt_base, int32_t evt_id, void* data) {
+static void handle_smith_prediction(void* arg, app_event_t evt_id, const app_smith_prediction_t* prediction) {
+  ctx_t * ctx = (ctx_t *) arg;
+
+  cJSON *json = cJSON_CreateObject();
+  cJSON_AddNumberToObject(json, "measured", prediction->measured);
+  cJSON_AddNumberToObject(json, "predicted", prediction->predicted);
+  char * msg = cJSON_PrintUnformatted(json);
+  cJSON_Delete(json);
+
+  publish_zone(ctx, prediction->zone, "/controller/smith/prediction", msg);
+  free(msg);
+}
+
+
+static void handle_schedule_report(void* arg, app_event_t evt_id, const app_schedule_t* schedule) {
+  ctx_t * ctx = (ctx_t *) arg;
+
+  cJSON *json = cJSON_CreateObject();
+  cJSON *entries = cJSON_AddArrayToObject(json, "entries");
+  for (int i = 0; i < schedule->count; i++) {
+    const app_schedule_entry_t * entry = &(schedule->entries[i]);
+
+    cJSON *item = cJSON_CreateObject();
+    cJSON *days = cJSON_AddArrayToObject(item, "days");
+    for (int wday = 0; wday < 7; wday++) {
+      if (entry->days & (1 << wday)) {
+        cJSON_AddItemToArray(days, cJSON_CreateString(day_names[wday]));
+      }
+    }
+
+    char at[6];
+    snprintf(at, sizeof(at), "%02d:%02d", entry->minute / 60 % 24, entry->minute % 60);
+    cJSON_AddStringToObject(item, "time", at);
+    cJSON_AddNumberToObject(item, "target", entry->target_cdeg / 100.0);
+    cJSON_AddItemToArray(entries, item);
+  }
+  char * msg = cJSON_PrintUnformatted(json);
+  cJSON_Delete(json);
+
+  publish(ctx, "/schedule/report", msg, 0, 0, 0);
+  free(msg);
+}
+
+
+static void handle_ota(void* arg, app_event_t evt_id, const app_no_data_t* data) {
   ctx_t * ctx = (ctx_t *) arg;
 
   // TODO: QOS = 1 crash when not connected
@@ -149,28 +504,31 @@ static void handle_ota(void* arg, esp_event_base_t evt_base, int32_t evt_id, voi
 
   } else if (evt_id == APP_EVENT_OTA_SUCCESS) {
     publish(ctx, "/system/ota/success", "{}", 0, 0, 0);
+  }
+}
+
 
-  } else if (evt_id == APP_EVENT_OTA_FAILED) {
-    esp_err_t ret = * ((esp_err_t *) data);
+static void handle_ota_failed(void* arg, app_event_t evt_id, const esp_err_t* err) {
+  ctx_t * ctx = (ctx_t *) arg;
 
-    cJSON *json = cJSON_CreateObject();
-    cJSON_AddNumberToObject(json, "err", ret);
-    char * msg = cJSON_Print(json);
-    cJSON_Delete(json);
+  cJSON *json = cJSON_CreateObject();
+  cJSON_AddNumberToObject(json, "err", *err);
+  char * msg = cJSON_Print(json);
+  cJSON_Delete(json);
 
-    publish(ctx, "/system/ota/failed", msg, 0, 0, 0);
-    free(msg);
-  }
+  // TODO: QOS = 1 crash when not connected
+  publish(ctx, "/system/ota/failed", msg, 0, 0, 0);
+  free(msg);
 }
 
 
-static void handle_restart(void* arg, esp_event_base_t evt_base, int32_t evt_id, void* data) {
+static void handle_restart(void* arg, app_event_t evt_id, const app_no_data_t* data) {
   ctx_t * ctx = (ctx_t *) arg;
   publish(ctx, "/system/restart/started", "{}", 0, 0, 0);
 }
 
 
-static void handle_time_updated(void* arg, esp_event_base_t evt_base, int32_t evt_id, void* data) {
+static void handle_time_updated(void* arg, app_event_t evt_id, const app_no_data_t* data) {
   ctx_t * ctx = (ctx_t *) arg;
   publish(ctx, "/system/time/updated", "{}", 0, 0, 0);
 }
@@ -191,14 +549,21 @@ void app_start_mqtt(esp_mqtt_client_config_t * config, const char* topic_prefix)
   esp_mqtt_client_register_event(ctx->client, MQTT_EVENT_CONNECTED, handle_connected, ctx);
   esp_mqtt_client_register_event(ctx->client, MQTT_EVENT_DATA, handle_message, ctx);
 
-  app_register_evt_handler(APP_EVENT_STATS_REPORT, handle_stats, ctx);
+  app_subscribe(APP_EVENT_LOOP_TELEMETRY, stats_report, handle_stats, ctx);
+  app_subscribe(APP_EVENT_LOOP_TELEMETRY, metrics_get, handle_metrics, ctx);
+  app_subscribe(APP_EVENT_LOOP_TELEMETRY, trace_report, handle_trace_report, ctx);
+  app_subscribe(APP_EVENT_LOOP_TELEMETRY, pid_terms, handle_pid_terms, ctx);
+  app_subscribe(APP_EVENT_LOOP_TELEMETRY, model_fit, handle_model_fit, ctx);
+  app_subscribe(APP_EVENT_LOOP_TELEMETRY, autotune_result, handle_autotune_result, ctx);
+  app_subscribe(APP_EVENT_LOOP_TELEMETRY, smith_prediction, handle_smith_prediction, ctx);
+  app_subscribe(APP_EVENT_LOOP_TELEMETRY, schedule_report, handle_schedule_report, ctx);
 
-  app_register_evt_handler(APP_EVENT_OTA_STARTED, handle_ota, ctx);
-  app_register_evt_handler(APP_EVENT_OTA_SUCCESS, handle_ota, ctx);
-  app_register_evt_handler(APP_EVENT_OTA_FAILED, handle_ota, ctx);
+  app_subscribe(APP_EVENT_LOOP_TELEMETRY, ota_started, handle_ota, ctx);
+  app_subscribe(APP_EVENT_LOOP_TELEMETRY, ota_success, handle_ota, ctx);
+  app_subscribe(APP_EVENT_LOOP_TELEMETRY, ota_failed, handle_ota_failed, ctx);
 
-  app_register_evt_handler(APP_EVENT_RESTART, handle_restart, ctx);
+  app_subscribe(APP_EVENT_LOOP_TELEMETRY, restart, handle_restart, ctx);
 
-  app_register_evt_handler(APP_EVENT_TIME_UPDATED, handle_time_updated, ctx);
+  app_subscribe(APP_EVENT_LOOP_TELEMETRY, time_updated, handle_time_updated, ctx);
 }
 
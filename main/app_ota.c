@@ -18,25 +18,25 @@ static const char* TAG = "app-ota";
 
 static void ota_task(void * arg) {
   ESP_LOGI(TAG, "OTA task started ...");
-  app_post_event(APP_EVENT_OTA_STARTED, NULL, 0);
+  app_post_ota_started(NULL);
 
   esp_err_t ret = esp_https_ota((esp_http_client_config_t *)arg);
 
   if (ret == ESP_OK) {
-    app_post_event(APP_EVENT_OTA_SUCCESS, NULL, 0);
+    app_post_ota_success(NULL);
     ESP_LOGI(TAG, "OTA upgrade success.");
   } else {
-    app_post_event(APP_EVENT_OTA_FAILED, &ret, sizeof(ret));
+    app_post_ota_failed(&ret);
     ESP_LOGE(TAG, "OTA upgrade failed.");
   }
 
-  app_post_event(APP_EVENT_RESTART, NULL, 0);
+  app_post_restart(NULL);
   ESP_LOGI(TAG, "OTA waiting for restart...");
   sleep(5);
 }
 
 
-static void handle_ota(void* arg, esp_event_base_t base, int32_t id, void* data) {
+static void handle_ota(void* arg, app_event_t evt_id, const app_no_data_t* data) {
   ESP_LOGI(TAG, "OTA requested ...");
 
   TaskHandle_t task_handle;
@@ -46,7 +46,7 @@ static void handle_ota(void* arg, esp_event_base_t base, int32_t id, void* data)
 
 
 void app_start_ota_handler(esp_http_client_config_t * config) {
-  app_register_evt_handler(APP_EVENT_OTA, handle_ota, config);
+  app_subscribe(APP_EVENT_LOOP_TELEMETRY, ota, handle_ota, config);
   ESP_LOGI(TAG, "OTA updater started for %s", config->url);
 }
 
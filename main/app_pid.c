@@ -0,0 +1,98 @@
+#include "./app_pid.h"
+
+
+#define CDEG_PER_DEG 100
+#define MS_PER_HOUR (3600 * 1000LL)
+
+
+
+static int64_t clamp(int64_t value, int64_t min, int64_t max) {
+  return (value < min) ? min : (value > max) ? max : value;
+}
+
+
+
+void app_pid_init(app_pid_t * pid, const app_pid_gains_t * gains, uint8_t out_min, uint8_t out_max) {
+  *pid = (app_pid_t) {
+    .gains = *gains,
+    .out_min = out_min,
+    .out_max = out_max,
+  };
+  app_pid_reset(pid, out_min);
+}
+
+
+
+void app_pid_set_gains(app_pid_t * pid, const app_pid_gains_t * gains) {
+  pid->gains = *gains;
+}
+
+
+
+void app_pid_set_feedforward(app_pid_t * pid, uint8_t duty) {
+  pid->feedforward = duty;
+}
+
+
+
+void app_pid_reset(app_pid_t * pid, uint8_t output) {
+  const int64_t ff_q16 = (int64_t) pid->feedforward << 16;
+  const int64_t out_min_q16 = ((int64_t) pid->out_min << 16) - ff_q16;
+  const int64_t out_max_q16 = ((int64_t) pid->out_max << 16) - ff_q16;
+
+  pid->integral_q16 = clamp(((int64_t) output << 16) - ff_q16, out_min_q16, out_max_q16);
+  pid->has_prev = false;
+  pid->output_q16 = (int32_t) output << 16;
+  pid->terms = (app_pid_terms_t) {
+    .i_q16 = pid->integral_q16,
+    .feedforward = pid->feedforward,
+    .output = output
+  };
+}
+
+
+
+uint8_t app_pid_update(app_pid_t * pid, int32_t setpoint_cdeg, int32_t meas_cdeg, uint32_t dt_ms) {
+  // the terms work around the feedforward, so do their limits
+  const int64_t ff_q16 = (int64_t) pid->feedforward << 16;
+  const int64_t out_min_q16 = ((int64_t) pid->out_min << 16) - ff_q16;
+  const int64_t out_max_q16 = ((int64_t) pid->out_max << 16) - ff_q16;
+  const int32_t error = setpoint_cdeg - meas_cdeg;
+
+  const int64_t p = (int64_t) pid->gains.kp_q16 * error / CDEG_PER_DEG;
+
+  // on the measurement, setpoint changes do not kick the output
+  int64_t d = 0;
+  if (pid->has_prev && dt_ms > 0) {
+    const int64_t change = meas_cdeg - pid->prev_meas_cdeg;
+    d = -(int64_t) pid->gains.kd_q16 * change * MS_PER_HOUR / ((int64_t) dt_ms * CDEG_PER_DEG);
+  }
+  pid->prev_meas_cdeg = meas_cdeg;
+  pid->has_prev = true;
+
+  // anti-windup: no integration further into a saturated output,
+  // and the integral alone never exceeds the output range
+  const int64_t unsaturated = p + pid->integral_q16 + d;
+  const bool saturated_high = unsaturated >= out_max_q16 && error > 0;
+  const bool saturated_low = unsaturated <= out_min_q16 && error < 0;
+
+  if (!saturated_high && !saturated_low) {
+    const int64_t step = (int64_t) pid->gains.ki_q16 * error * dt_ms / (CDEG_PER_DEG * MS_PER_HOUR);
+    pid->integral_q16 = clamp(pid->integral_q16 + step, out_min_q16, out_max_q16);
+  }
+
+  const int64_t out_q16 = clamp(p + pid->integral_q16 + d, out_min_q16, out_max_q16);
+  // rounded to the nearest duty step
+  pid->output_q16 = out_q16 + ff_q16;
+  const uint8_t output = (pid->output_q16 + (1 << 15)) >> 16;
+
+  pid->terms = (app_pid_terms_t) {
+    .error_cdeg = error,
+    .p_q16 = clamp(p, INT32_MIN, INT32_MAX),
+    .i_q16 = pid->integral_q16,
+    .d_q16 = clamp(d, INT32_MIN, INT32_MAX),
+    .feedforward = pid->feedforward,
+    .output = output
+  };
+  return output;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// Fixed-point PID controller for the heating duty.
+// Temperatures are in 1/100 °C, gains and terms are Q16.16 in duty %.
+
+#define APP_PID_Q16(value) ((int32_t) ((value) * 65536))
+
+
+typedef struct {
+  // duty % per °C of error
+  int32_t kp_q16;
+  // duty % per °C of error and hour
+  int32_t ki_q16;
+  // duty % per °C/h change of the measurement
+  int32_t kd_q16;
+} app_pid_gains_t;
+
+
+// The terms of the last update, for telemetry.
+typedef struct {
+  int32_t error_cdeg;
+  int32_t p_q16;
+  int32_t i_q16;
+  int32_t d_q16;
+  uint8_t feedforward;
+  uint8_t output;
+  // heating zone of the loop, set by its owner
+  uint8_t zone;
+} app_pid_terms_t;
+
+
+typedef struct {
+  app_pid_gains_t gains;
+  uint8_t out_min;
+  uint8_t out_max;
+  // base duty the terms are added to, e.g. from the heat curve
+  uint8_t feedforward;
+
+  int32_t integral_q16;
+  int32_t prev_meas_cdeg;
+  bool has_prev;
+  // the output before rounding, duty % in Q16
+  int32_t output_q16;
+
+  app_pid_terms_t terms;
+} app_pid_t;
+
+
+void app_pid_init(app_pid_t * pid, const app_pid_gains_t * gains, uint8_t out_min, uint8_t out_max);
+
+// Gains apply from the next update on, the integral is kept as duty so
+// the output does not jump.
+void app_pid_set_gains(app_pid_t * pid, const app_pid_gains_t * gains);
+
+// Takes effect with the next update, the output follows it right away.
+// Set it before a reset for the reset to stay bumpless.
+void app_pid_set_feedforward(app_pid_t * pid, uint8_t duty);
+
+// Restarts from `output`, used for a bumpless switch to the PID and after
+// sensor errors.
+void app_pid_reset(app_pid_t * pid, uint8_t output);
+
+// Runs one step on the held setpoint and measurement, `dt_ms` since the
+// last step. Returns the duty clamped to [out_min, out_max].
+uint8_t app_pid_update(app_pid_t * pid, int32_t setpoint_cdeg, int32_t meas_cdeg, uint32_t dt_ms);
+
+
+#ifdef __cplusplus
+}
+#endif
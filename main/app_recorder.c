@@ -0,0 +1,277 @@
+#include <string.h>
+#include <time.h>
+
+#include "sdkconfig.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_partition.h"
+
+#include "./app_events.h"
+#include "./app_recorder.h"
+
+
+static const char* TAG = "app-recorder";
+
+
+#define PARTITION_NAME "evtlog"
+#define PARTITION_SUBTYPE 0x40
+
+#define SECTOR_SIZE 4096
+#define HEADER_SIZE 32
+#define RECORD_SIZE 16
+#define RECORDS_PER_SECTOR ((SECTOR_SIZE - HEADER_SIZE) / RECORD_SIZE)
+
+#define SECTOR_MAGIC 0x474c5645 // "EVLG"
+
+#define FLUSH_BATCH 32
+
+#define STACK_SIZE 3072
+
+
+// Layout shared with tools/evtlog_decode.py, all fields little endian.
+// Every sector starts with a header followed by fixed size records,
+// erased flash (evt_id 0xff) marks the end of the written records.
+typedef struct __attribute__((packed)) {
+  uint32_t magic;
+  uint32_t seq;
+  uint32_t boot;
+  // wall-clock seconds at uptime_ms, 0 if the time was not set yet
+  uint32_t epoch;
+  uint32_t uptime_ms;
+  uint8_t reserved[12];
+} sector_header_t;
+
+
+typedef struct __attribute__((packed)) {
+  uint8_t evt_id;
+  // payload size before truncation to data
+  uint8_t data_size;
+  // records lost to a full buffer right before this one
+  uint16_t dropped;
+  uint32_t uptime_ms;
+  uint8_t data[8];
+} record_t;
+
+_Static_assert(sizeof(sector_header_t) == HEADER_SIZE, "sector header size");
+_Static_assert(sizeof(record_t) == RECORD_SIZE, "record size");
+
+
+typedef struct {
+  const esp_partition_t * partition;
+  uint32_t sector_count;
+  uint32_t sector;
+  uint32_t seq;
+  uint32_t boot;
+  uint32_t next_record;
+
+  record_t buffer[CONFIG_APP_RECORDER_BUFFER_SIZE];
+  uint32_t head;
+  uint32_t count;
+  uint32_t dropped;
+
+  TaskHandle_t task;
+} recorder_t;
+
+
+static recorder_t * recorder = NULL;
+
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+
+
+static uint32_t uptime_ms() {
+  return esp_timer_get_time() / 1000;
+}
+
+
+
+static esp_err_t open_sector(recorder_t * rec, uint32_t sector) {
+  const uint32_t offset = sector * SECTOR_SIZE;
+
+  esp_err_t err = esp_partition_erase_range(rec->partition, offset, SECTOR_SIZE);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Error (%s) erasing sector %u", esp_err_to_name(err), sector);
+    return err;
+  }
+
+  time_t now = time(NULL);
+  sector_header_t header = {
+    .magic = SECTOR_MAGIC,
+    .seq = rec->seq,
+    .boot = rec->boot,
+    // anything before 2020 means SNTP has not synced yet
+    .epoch = (now > 1577836800) ? now : 0,
+    .uptime_ms = uptime_ms()
+  };
+  memset(header.reserved, 0xff, sizeof(header.reserved));
+
+  err = esp_partition_write(rec->partition, offset, &header, sizeof(header));
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Error (%s) writing sector header %u", esp_err_to_name(err), sector);
+    return err;
+  }
+
+  rec->sector = sector;
+  rec->next_record = 0;
+  return ESP_OK;
+}
+
+
+
+// continues after the newest sector of the previous boot, each boot starts a fresh sector
+static esp_err_t open_log(recorder_t * rec) {
+  bool found = false;
+  uint32_t newest = 0;
+  sector_header_t newest_header = {0};
+
+  for (uint32_t sector = 0; sector < rec->sector_count; sector++) {
+    sector_header_t header;
+    esp_partition_read(rec->partition, sector * SECTOR_SIZE, &header, sizeof(header));
+
+    if (header.magic == SECTOR_MAGIC && (!found || header.seq > newest_header.seq)) {
+      found = true;
+      newest = sector;
+      newest_header = header;
+    }
+  }
+
+  if (found) {
+    rec->seq = newest_header.seq + 1;
+    rec->boot = newest_header.boot + 1;
+    return open_sector(rec, (newest + 1) % rec->sector_count);
+  }
+
+  rec->seq = 0;
+  rec->boot = 0;
+  return open_sector(rec, 0);
+}
+
+
+
+static void write_records(recorder_t * rec, const record_t * records, uint32_t count) {
+  while (count > 0) {
+    if (rec->next_record >= RECORDS_PER_SECTOR) {
+      rec->seq += 1;
+      if (open_sector(rec, (rec->sector + 1) % rec->sector_count) != ESP_OK) {
+        return;
+      }
+    }
+
+    uint32_t chunk = RECORDS_PER_SECTOR - rec->next_record;
+    if (chunk > count) {
+      chunk = count;
+    }
+
+    const uint32_t offset = rec->sector * SECTOR_SIZE + HEADER_SIZE + rec->next_record * RECORD_SIZE;
+    esp_err_t err = esp_partition_write(rec->partition, offset, records, chunk * RECORD_SIZE);
+    if (err != ESP_OK) {
+      ESP_LOGE(TAG, "Error (%s) writing records", esp_err_to_name(err));
+    }
+
+    rec->next_record += chunk;
+    records += chunk;
+    count -= chunk;
+  }
+}
+
+
+
+static void flush(recorder_t * rec) {
+  record_t batch[FLUSH_BATCH];
+
+  while (true) {
+    portENTER_CRITICAL(&lock);
+    uint32_t count = rec->count < FLUSH_BATCH ? rec->count : FLUSH_BATCH;
+    for (uint32_t i = 0; i < count; i++) {
+      batch[i] = rec->buffer[(rec->head + i) % CONFIG_APP_RECORDER_BUFFER_SIZE];
+    }
+    rec->head = (rec->head + count) % CONFIG_APP_RECORDER_BUFFER_SIZE;
+    rec->count -= count;
+    portEXIT_CRITICAL(&lock);
+
+    if (count == 0) {
+      break;
+    }
+    write_records(rec, batch, count);
+  }
+}
+
+
+
+static void recorder_task(void * arg) {
+  recorder_t * rec = (recorder_t *) arg;
+
+  while (true) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(CONFIG_APP_RECORDER_FLUSH_INTERVAL_SEC * 1000));
+    flush(rec);
+  }
+}
+
+
+
+// the event tap, runs in the posting context which may be an ISR
+static void record_event(app_event_t evt_id, const void *evt_data, size_t evt_data_size) {
+  recorder_t * rec = recorder;
+
+  record_t record = {
+    .evt_id = evt_id,
+    .data_size = evt_data_size,
+    .uptime_ms = uptime_ms()
+  };
+  memset(record.data, 0xff, sizeof(record.data));
+  memcpy(record.data, evt_data, evt_data_size < sizeof(record.data) ? evt_data_size : sizeof(record.data));
+
+  bool wake = false;
+
+  portENTER_CRITICAL_SAFE(&lock);
+  if (rec->count >= CONFIG_APP_RECORDER_BUFFER_SIZE) {
+    rec->dropped += 1;
+  } else {
+    record.dropped = rec->dropped < UINT16_MAX ? rec->dropped : UINT16_MAX;
+    rec->dropped = 0;
+    rec->buffer[(rec->head + rec->count) % CONFIG_APP_RECORDER_BUFFER_SIZE] = record;
+    rec->count += 1;
+    // flush a batch once half the buffer is used, long before it overflows
+    wake = rec->count == CONFIG_APP_RECORDER_BUFFER_SIZE / 2;
+  }
+  portEXIT_CRITICAL_SAFE(&lock);
+
+  if (wake) {
+    if (xPortInIsrContext()) {
+      vTaskNotifyGiveFromISR(rec->task, NULL);
+    } else {
+      xTaskNotifyGive(rec->task);
+    }
+  }
+}
+
+
+
+void app_start_recorder(void) {
+  const esp_partition_t * partition = esp_partition_find_first(
+    ESP_PARTITION_TYPE_DATA, PARTITION_SUBTYPE, PARTITION_NAME
+  );
+  if (partition == NULL) {
+    ESP_LOGE(TAG, "no %s partition, not recording events", PARTITION_NAME);
+    return;
+  }
+
+  recorder_t * rec = calloc(1, sizeof(recorder_t));
+  rec->partition = partition;
+  rec->sector_count = partition->size / SECTOR_SIZE;
+
+  if (open_log(rec) != ESP_OK) {
+    free(rec);
+    return;
+  }
+
+  ESP_LOGI(TAG, "recording events, boot %u, sector %u of %u", rec->boot, rec->sector, rec->sector_count);
+
+  xTaskCreate(recorder_task, "app-recorder", STACK_SIZE, rec, 1, &(rec->task));
+
+  recorder = rec;
+  app_set_event_tap(record_event);
+}
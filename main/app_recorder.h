@@ -0,0 +1,14 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// Appends every app event to the "evtlog" partition, see tools/evtlog_decode.py
+void app_start_recorder(void);
+
+
+#ifdef __cplusplus
+}
+#endif
@@ -18,27 +18,27 @@ static const char* TAG = "app-restarter";
 
 
 static void handle_short_reset_press(void *arg) {
-  app_post_event(APP_EVENT_RESET_NETWORK, NULL, 0);
+  app_post_reset_network(NULL);
 }
 
 
 
 static void handle_long_reset_press(void *arg) {
-  app_post_event(APP_EVENT_RESET_FACTORY, NULL, 0);
+  app_post_reset_factory(NULL);
 }
 
 
 
-static void handle_app_evt(void* arg, esp_event_base_t base, int32_t id, void* data) {
-  if (id == APP_EVENT_RESET_FACTORY) {
+static void handle_app_evt(void* arg, app_event_t evt_id, const app_no_data_t* data) {
+  if (evt_id == APP_EVENT_RESET_FACTORY) {
     hap_reset_to_factory();
-  } else if (id == APP_EVENT_RESET_HOMEKIT) {
+  } else if (evt_id == APP_EVENT_RESET_HOMEKIT) {
     hap_reset_homekit_data();
-  } else if (id == APP_EVENT_RESET_NETWORK) {
+  } else if (evt_id == APP_EVENT_RESET_NETWORK) {
     hap_reset_network();
-  } else if (id == APP_EVENT_RESET_PAIRING) {
+  } else if (evt_id == APP_EVENT_RESET_PAIRING) {
     hap_reset_pairings();
-  } else if (id == APP_EVENT_RESTART) {
+  } else if (evt_id == APP_EVENT_RESTART) {
     hap_reboot_accessory();
   }
 }
@@ -49,11 +49,11 @@ static void handle_app_evt(void* arg, esp_event_base_t base, int32_t id, void* d
 void app_start_restart_handler() {
   ESP_LOGI(TAG, "starting restart/reset handler");
 
-  app_register_evt_handler(APP_EVENT_RESTART, handle_app_evt, NULL);
-  app_register_evt_handler(APP_EVENT_RESET_FACTORY, handle_app_evt, NULL);
-  app_register_evt_handler(APP_EVENT_RESET_HOMEKIT, handle_app_evt, NULL);
-  app_register_evt_handler(APP_EVENT_RESET_NETWORK, handle_app_evt, NULL);
-  app_register_evt_handler(APP_EVENT_RESET_PAIRING, handle_app_evt, NULL);
+  app_subscribe(APP_EVENT_LOOP_TELEMETRY, restart, handle_app_evt, NULL);
+  app_subscribe(APP_EVENT_LOOP_TELEMETRY, reset_factory, handle_app_evt, NULL);
+  app_subscribe(APP_EVENT_LOOP_TELEMETRY, reset_homekit, handle_app_evt, NULL);
+  app_subscribe(APP_EVENT_LOOP_TELEMETRY, reset_network, handle_app_evt, NULL);
+  app_subscribe(APP_EVENT_LOOP_TELEMETRY, reset_pairing, handle_app_evt, NULL);
 
   button_handle_t handle = iot_button_create(RESET_GPIO, BUTTON_ACTIVE_LOW);
   iot_button_add_on_release_cb(handle, RESET_SHORT_BUTTON_TIMEOUT, handle_short_reset_press, NULL);
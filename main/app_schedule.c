@@ -0,0 +1,328 @@
+#include <string.h>
+#include <math.h>
+#include <sys/time.h>
+
+#include "sdkconfig.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs_flash.h"
+
+#include "./app_events.h"
+#include "./app_schedule.h"
+#include "./app_state.h"
+
+
+static const char* TAG = "app-schedule";
+
+
+#define SLOTS_PER_DAY (24 * 60 / APP_SCHEDULE_SLOT_MIN)
+#define NO_TARGET INT16_MIN
+
+// wall clock times before this were never set by SNTP
+#define MIN_VALID_TIME 1609459200
+
+// a heat-up of less is too short to measure a rate
+#define MIN_HEATUP_CDEG 50
+#define MIN_HEATUP_SEC (10 * 60)
+// weight of a new heat-up in the rate
+#define HEATUP_RATE_WEIGHT 0.3f
+
+
+typedef struct {
+  app_schedule_t schedule;
+  app_schedule_table_t table;
+  bool enabled;
+
+  int16_t applied_cdeg;
+  float heatup_rate;
+  // a started preheat holds until its slot begins
+  bool preheating;
+
+  // heat-up being measured
+  bool heating_up;
+  int16_t heatup_target_cdeg;
+  float heatup_start_temp;
+  int64_t heatup_start_us;
+} ctx_t;
+
+
+
+bool app_schedule_compile(const app_schedule_t * schedule, app_schedule_table_t * table) {
+  for (int s = 0; s < APP_SCHEDULE_SLOTS; s++) {
+    table->target_cdeg[s] = NO_TARGET;
+  }
+
+  int last = -1;
+  for (int i = 0; i < schedule->count && i < APP_SCHEDULE_MAX_ENTRIES; i++) {
+    const app_schedule_entry_t * entry = &(schedule->entries[i]);
+    if (entry->minute >= 24 * 60 || entry->target_cdeg == NO_TARGET) {
+      continue;
+    }
+    for (int day = 0; day < 7; day++) {
+      if (entry->days & (1 << day)) {
+        const int slot = day * SLOTS_PER_DAY + entry->minute / APP_SCHEDULE_SLOT_MIN;
+        table->target_cdeg[slot] = entry->target_cdeg;
+        last = (slot > last) ? slot : last;
+      }
+    }
+  }
+
+  if (last < 0) {
+    return false;
+  }
+
+  // an entry holds until the next one, across the end of the week
+  int16_t target = table->target_cdeg[last];
+  for (int s = 0; s < APP_SCHEDULE_SLOTS; s++) {
+    if (table->target_cdeg[s] == NO_TARGET) {
+      table->target_cdeg[s] = target;
+    } else {
+      target = table->target_cdeg[s];
+    }
+  }
+
+  // walks back twice, the second round sees the changes after the wrap
+  int next = -1;
+  for (int i = 2 * APP_SCHEDULE_SLOTS - 1; i >= 0; i--) {
+    const int s = i % APP_SCHEDULE_SLOTS;
+    const int after = (s + 1) % APP_SCHEDULE_SLOTS;
+    if (table->target_cdeg[after] != table->target_cdeg[s]) {
+      next = after;
+    }
+    // a week without changes points every slot to itself
+    table->next_change[s] = (next < 0) ? s : next;
+  }
+  return true;
+}
+
+
+
+int16_t app_schedule_evaluate(
+  const app_schedule_table_t * table,
+  const struct tm * time,
+  int16_t current_cdeg,
+  float heatup_rate,
+  uint16_t max_lead_min,
+  bool * preheating
+) {
+  const int minute = time->tm_hour * 60 + time->tm_min;
+  const int slot = time->tm_wday * SLOTS_PER_DAY + minute / APP_SCHEDULE_SLOT_MIN;
+  const int16_t target = table->target_cdeg[slot];
+  const int next = table->next_change[slot];
+  const int16_t next_target = table->target_cdeg[next];
+
+  const bool held = *preheating;
+  *preheating = false;
+  if (next == slot || next_target <= target) {
+    return target;
+  }
+
+  const int slots_to_next = (next - slot + APP_SCHEDULE_SLOTS) % APP_SCHEDULE_SLOTS;
+  const int minutes_to_next = slots_to_next * APP_SCHEDULE_SLOT_MIN - minute % APP_SCHEDULE_SLOT_MIN;
+
+  // however fast the room heats, the target does not flip back and forth
+  if (held && minutes_to_next <= max_lead_min) {
+    *preheating = true;
+    return next_target;
+  }
+  if (next_target <= current_cdeg || heatup_rate <= 0) {
+    return target;
+  }
+
+  const float lead_min = fminf((next_target - current_cdeg) / 100.0f / heatup_rate * 60, max_lead_min);
+
+  if (minutes_to_next <= lead_min) {
+    *preheating = true;
+    return next_target;
+  }
+  return target;
+}
+
+
+
+static void persist(const ctx_t * ctx) {
+  nvs_handle_t nvs_handle;
+  esp_err_t err = nvs_open("storage", NVS_READWRITE, &nvs_handle);
+
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Error (%s) opening NVS handle!", esp_err_to_name(err));
+    return;
+  }
+
+  const size_t size = ctx->schedule.count * sizeof(app_schedule_entry_t);
+  err = nvs_set_blob(nvs_handle, "schedule", ctx->schedule.entries, size);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Error (%s) storing schedule", esp_err_to_name(err));
+  }
+
+  uint32_t rate;
+  memcpy(&rate, &(ctx->heatup_rate), sizeof(rate));
+  err = nvs_set_u32(nvs_handle, "heatup_rate", rate);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Error (%s) storing heat-up rate", esp_err_to_name(err));
+  }
+
+  err = nvs_commit(nvs_handle);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Error (%s) committing storage", esp_err_to_name(err));
+  }
+
+  nvs_close(nvs_handle);
+}
+
+
+
+static void load(ctx_t * ctx) {
+  nvs_handle_t nvs_handle;
+  if (nvs_open("storage", NVS_READONLY, &nvs_handle) != ESP_OK) {
+    return;
+  }
+
+  size_t size = sizeof(ctx->schedule.entries);
+  if (nvs_get_blob(nvs_handle, "schedule", ctx->schedule.entries, &size) == ESP_OK) {
+    ctx->schedule.count = size / sizeof(app_schedule_entry_t);
+  }
+
+  uint32_t rate;
+  if (nvs_get_u32(nvs_handle, "heatup_rate", &rate) == ESP_OK) {
+    memcpy(&(ctx->heatup_rate), &rate, sizeof(rate));
+  }
+
+  nvs_close(nvs_handle);
+}
+
+
+
+static void compile(ctx_t * ctx) {
+  ctx->enabled = app_schedule_compile(&(ctx->schedule), &(ctx->table));
+  // the next evaluation applies the new schedule
+  ctx->applied_cdeg = NO_TARGET;
+  ctx->preheating = false;
+  ESP_LOGI(TAG, "schedule of %d entries %s", ctx->schedule.count, ctx->enabled ? "enabled" : "disabled");
+}
+
+
+
+// learns from the time it took the thermostat to reach a scheduled target
+static void track_heatup(ctx_t * ctx, const app_state_t * state) {
+  const int16_t target_cdeg = lroundf(state->target_temp * 100);
+  if (!ctx->heating_up) {
+    return;
+  }
+  if (target_cdeg != ctx->heatup_target_cdeg || state->temp_state != APP_STATE_TEMP_OK) {
+    // overridden, or no reliable temperatures
+    ctx->heating_up = false;
+    return;
+  }
+  if (state->current_temp < state->target_temp) {
+    return;
+  }
+
+  ctx->heating_up = false;
+  const float rise = state->current_temp - ctx->heatup_start_temp;
+  const float elapsed_sec = (esp_timer_get_time() - ctx->heatup_start_us) / 1e6f;
+  if (rise * 100 < MIN_HEATUP_CDEG || elapsed_sec < MIN_HEATUP_SEC) {
+    return;
+  }
+
+  const float rate = rise / (elapsed_sec / 3600);
+  ctx->heatup_rate += HEATUP_RATE_WEIGHT * (rate - ctx->heatup_rate);
+  ESP_LOGI(TAG, "heated up at %.2f °C/h, rate now %.2f °C/h", rate, ctx->heatup_rate);
+  persist(ctx);
+}
+
+
+
+static void handle_tick(void* arg, app_event_t evt_id, const app_no_data_t* data) {
+  ctx_t * ctx = (ctx_t *) arg;
+
+  const time_t now = time(NULL);
+  if (!ctx->enabled || now < MIN_VALID_TIME) {
+    return;
+  }
+
+  // the schedule drives the first zone
+  app_state_t state;
+  app_state_get(0, &state);
+  track_heatup(ctx, &state);
+
+  struct tm local;
+  localtime_r(&now, &local);
+
+  const int16_t target_cdeg = app_schedule_evaluate(
+    &(ctx->table),
+    &local,
+    lroundf(state.current_temp * 100),
+    ctx->heatup_rate,
+    CONFIG_APP_SCHEDULE_MAX_PREHEAT_MIN,
+    &(ctx->preheating)
+  );
+
+  // only changes of the schedule are applied, a manual target holds until then
+  if (target_cdeg == ctx->applied_cdeg) {
+    return;
+  }
+  ctx->applied_cdeg = target_cdeg;
+
+  ESP_LOGI(TAG, "scheduled target %.2f%s", target_cdeg / 100.0, ctx->preheating ? ", preheating" : "");
+
+  if (state.temp_state == APP_STATE_TEMP_OK && target_cdeg - state.current_temp * 100 >= MIN_HEATUP_CDEG) {
+    ctx->heating_up = true;
+    ctx->heatup_target_cdeg = target_cdeg;
+    ctx->heatup_start_temp = state.current_temp;
+    ctx->heatup_start_us = esp_timer_get_time();
+  }
+
+  app_traced_temp_t target = { .temp = target_cdeg / 100.0f };
+  app_post_target_temp_changed(&target);
+}
+
+
+
+static void handle_set(void* arg, app_event_t evt_id, const app_schedule_t* schedule) {
+  ctx_t * ctx = (ctx_t *) arg;
+
+  ctx->schedule = *schedule;
+  compile(ctx);
+  persist(ctx);
+
+  app_post_schedule_report(&(ctx->schedule));
+}
+
+
+
+static void handle_get(void* arg, app_event_t evt_id, const app_no_data_t* data) {
+  ctx_t * ctx = (ctx_t *) arg;
+  app_post_schedule_report(&(ctx->schedule));
+}
+
+
+
+// called from the esp_timer task, must never block
+static void post_tick(void * arg) {
+  app_post_schedule_tick_timeout(NULL, 0);
+}
+
+
+
+void app_start_schedule(void) {
+  ctx_t * ctx = malloc(sizeof(ctx_t));
+  *ctx = (ctx_t) {
+    .heatup_rate = CONFIG_APP_SCHEDULE_HEATUP_RATE / 10.0f,
+  };
+  load(ctx);
+  compile(ctx);
+
+  app_subscribe(APP_EVENT_LOOP_CONTROL, schedule_tick, handle_tick, ctx);
+  app_subscribe(APP_EVENT_LOOP_CONTROL, schedule_set, handle_set, ctx);
+  app_subscribe(APP_EVENT_LOOP_CONTROL, schedule_get, handle_get, ctx);
+
+  esp_timer_create_args_t timer_args = {
+    .name = "app-schedule",
+    .callback = &post_tick,
+  };
+  esp_timer_handle_t timer;
+  esp_timer_create(&timer_args, &timer);
+  esp_timer_start_periodic(timer, 60 * 1000 * 1000LL);
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// Weekly setpoint schedule.
+// The entries are compiled into a table of quarter hour slots, so a tick
+// only indexes it by the local time.
+
+#define APP_SCHEDULE_MAX_ENTRIES 32
+#define APP_SCHEDULE_SLOT_MIN 15
+#define APP_SCHEDULE_SLOTS (7 * 24 * 60 / APP_SCHEDULE_SLOT_MIN)
+
+
+// From `minute` of every day in `days` on the target is `target_cdeg`,
+// until the next entry.
+typedef struct {
+  // bit 0 is Sunday, like tm_wday
+  uint8_t days;
+  // minute of the day, rounded down to the slot
+  uint16_t minute;
+  // 1/100 °C
+  int16_t target_cdeg;
+} app_schedule_entry_t;
+
+
+// payload of APP_EVENT_SCHEDULE_SET and APP_EVENT_SCHEDULE_REPORT,
+// no entries turn the schedule off
+typedef struct {
+  uint8_t count;
+  app_schedule_entry_t entries[APP_SCHEDULE_MAX_ENTRIES];
+} app_schedule_t;
+
+
+typedef struct {
+  int16_t target_cdeg[APP_SCHEDULE_SLOTS];
+  // first slot after this one with another target
+  uint16_t next_change[APP_SCHEDULE_SLOTS];
+} app_schedule_table_t;
+
+
+// Returns false if the schedule has no valid entries.
+bool app_schedule_compile(const app_schedule_t * schedule, app_schedule_table_t * table);
+
+// The target of the slot `time` is in, or that of the next slot up to
+// `max_lead_min` earlier when heating at `heatup_rate` (°C/h) from
+// `current_cdeg` would otherwise reach it late. `preheating` is kept
+// between calls, a preheat it holds continues until its slot begins.
+int16_t app_schedule_evaluate(
+  const app_schedule_table_t * table,
+  const struct tm * time,
+  int16_t current_cdeg,
+  float heatup_rate,
+  uint16_t max_lead_min,
+  bool * preheating
+);
+
+// Evaluates the schedule once a minute against the wall clock and posts a
+// target change of zone 0 whenever the scheduled target changes. Runs from
+// the RTC once the time was set, the network is only needed for the first
+// sync.
+void app_start_schedule(void);
+
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,39 @@
+#include <string.h>
+
+#include "./app_smith.h"
+
+
+#define MS_PER_HOUR (3600 * 1000.0f)
+
+
+
+void app_smith_init(app_smith_t * smith, uint32_t dt_ms) {
+  memset(smith, 0, sizeof(app_smith_t));
+  smith->dt_ms = dt_ms;
+}
+
+
+
+void app_smith_set_plant(app_smith_t * smith, float gain, float loss, uint32_t dead_time_sec) {
+  const float ticks_per_hour = MS_PER_HOUR / smith->dt_ms;
+  const uint32_t dead_ticks = dead_time_sec * 1000 / smith->dt_ms;
+
+  smith->gain = gain / ticks_per_hour;
+  smith->loss = loss / ticks_per_hour;
+  smith->dead_ticks = (dead_ticks < APP_SMITH_MAX_DEAD_TICKS) ? dead_ticks : APP_SMITH_MAX_DEAD_TICKS;
+}
+
+
+
+void app_smith_update(app_smith_t * smith, uint8_t duty) {
+  const float rise = smith->rise[0] + smith->gain * duty - smith->loss * smith->rise[0];
+
+  memmove(&(smith->rise[1]), &(smith->rise[0]), APP_SMITH_MAX_DEAD_TICKS * sizeof(float));
+  smith->rise[0] = rise;
+}
+
+
+
+float app_smith_predict(const app_smith_t * smith, float measured) {
+  return measured + smith->rise[0] - smith->rise[smith->dead_ticks];
+}
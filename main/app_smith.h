@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// Smith predictor for the dead time between the heat and the sensor.
+// A first-order model of the heat's effect on the room runs twice, with
+// and without the dead time. Their difference is the change the sensor
+// has not seen yet, added to the measurement it gives the temperature the
+// controller should act on.
+
+#define APP_SMITH_MAX_DEAD_TICKS 64
+
+
+typedef struct {
+  uint32_t dt_ms;
+  // per tick
+  float gain;
+  float loss;
+  uint8_t dead_ticks;
+
+  // heat driven rise of the undelayed model, newest first
+  float rise[APP_SMITH_MAX_DEAD_TICKS + 1];
+} app_smith_t;
+
+
+// payload of APP_EVENT_SMITH_PREDICTION, both in °C
+typedef struct {
+  float measured;
+  float predicted;
+  uint8_t zone;
+} app_smith_prediction_t;
+
+
+void app_smith_init(app_smith_t * smith, uint32_t dt_ms);
+
+// gain in °C/h per duty %, loss in 1/h, dead times beyond
+// APP_SMITH_MAX_DEAD_TICKS are cut
+void app_smith_set_plant(app_smith_t * smith, float gain, float loss, uint32_t dead_time_sec);
+
+// Advances the model by a tick in which `duty` was applied.
+void app_smith_update(app_smith_t * smith, uint8_t duty);
+
+// The measurement plus the change still on its way to the sensor.
+float app_smith_predict(const app_smith_t * smith, float measured);
+
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,193 @@
+#include <stdatomic.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+
+#include "./app_events.h"
+#include "./app_state.h"
+
+
+static const char* TAG = "app-state";
+
+
+#define MAX_SUBSCRIBERS 8
+
+
+typedef struct {
+  app_event_loop_t loop;
+  uint32_t fields;
+  app_state_handler_t handler;
+  void * arg;
+  const char * name;
+  // changed fields not yet seen by the handler, per zone
+  atomic_uint_fast32_t pending[APP_ZONES];
+} subscriber_t;
+
+
+static subscriber_t subscribers[MAX_SUBSCRIBERS];
+static size_t subscriber_count = 0;
+
+// loops with a registered dispatcher
+static bool dispatching[APP_EVENT_LOOP_MAX] = {0};
+
+// odd while an update is in progress, bumped by 2 for every published state
+static atomic_uint_fast32_t published_seq[APP_ZONES] = {0};
+static app_state_t published_state[APP_ZONES] = {0};
+
+
+
+static uint32_t changed_fields(const app_state_t * prev, const app_state_t * next) {
+  uint32_t changed = 0;
+
+  if (prev->temp_state != next->temp_state) {
+    changed |= APP_STATE_FIELD_TEMP_STATE;
+  }
+  if (prev->current_temp != next->current_temp) {
+    changed |= APP_STATE_FIELD_CURRENT_TEMP;
+  }
+  if (prev->target_temp != next->target_temp) {
+    changed |= APP_STATE_FIELD_TARGET_TEMP;
+  }
+  if (prev->current_humid != next->current_humid) {
+    changed |= APP_STATE_FIELD_CURRENT_HUMID;
+  }
+  if (prev->heat != next->heat) {
+    changed |= APP_STATE_FIELD_HEAT;
+  }
+  if (prev->window_open != next->window_open) {
+    changed |= APP_STATE_FIELD_WINDOW_OPEN;
+  }
+  return changed;
+}
+
+
+
+uint32_t app_state_publish(const app_state_t * state) {
+  const uint8_t zone = state->zone;
+  if (zone >= APP_ZONES) {
+    ESP_LOGE(TAG, "no zone %d", zone);
+    return 0;
+  }
+
+  // the first state reports all fields
+  const uint32_t seq = atomic_load_explicit(&(published_seq[zone]), memory_order_relaxed);
+  const uint32_t changed = (seq == 0)
+    ? APP_STATE_FIELD_ALL
+    : changed_fields(&(published_state[zone]), state);
+
+  atomic_store_explicit(&(published_seq[zone]), seq + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+
+  published_state[zone] = *state;
+
+  atomic_store_explicit(&(published_seq[zone]), seq + 2, memory_order_release);
+
+  bool notify = false;
+  for (size_t i = 0; i < subscriber_count; i++) {
+    subscriber_t * sub = &(subscribers[i]);
+    if (sub->fields & changed) {
+      atomic_fetch_or(&(sub->pending[zone]), sub->fields & changed);
+      notify = true;
+    }
+  }
+
+  if (notify) {
+    app_post_state_changed(&changed);
+  }
+  return changed;
+}
+
+
+
+bool app_state_try_get(uint8_t zone, app_state_t * state, uint32_t * version) {
+  const uint32_t begin = atomic_load_explicit(&(published_seq[zone]), memory_order_acquire);
+  if (begin & 1) {
+    return false;
+  }
+
+  *state = published_state[zone];
+
+  atomic_thread_fence(memory_order_acquire);
+  const uint32_t end = atomic_load_explicit(&(published_seq[zone]), memory_order_relaxed);
+  if (begin != end) {
+    return false;
+  }
+
+  if (version != NULL) {
+    *version = begin;
+  }
+  return true;
+}
+
+
+
+uint32_t app_state_get(uint8_t zone, app_state_t * state) {
+  uint32_t version;
+  while (!app_state_try_get(zone, state, &version)) {
+  }
+  return version;
+}
+
+
+
+static void dispatch_state_changed(void * arg, app_event_t evt_id, const uint32_t * changed) {
+  const app_event_loop_t loop = (app_event_loop_t) (intptr_t) arg;
+
+  // `changed` only holds the latest change when posts were coalesced,
+  // the pending bits hold all of them.
+  // They are taken before the snapshot, so it is never older than them.
+  for (uint8_t zone = 0; zone < APP_ZONES; zone++) {
+    uint32_t pending[MAX_SUBSCRIBERS] = {0};
+    bool any = false;
+    for (size_t i = 0; i < subscriber_count; i++) {
+      if (subscribers[i].loop == loop) {
+        pending[i] = atomic_exchange(&(subscribers[i].pending[zone]), 0);
+        any = any || pending[i] != 0;
+      }
+    }
+
+    if (!any) {
+      continue;
+    }
+
+    app_state_t state;
+    app_state_get(zone, &state);
+
+    for (size_t i = 0; i < subscriber_count; i++) {
+      if (pending[i] != 0) {
+        subscribers[i].handler(subscribers[i].arg, pending[i], &state);
+      }
+    }
+  }
+}
+
+
+
+void app_state_subscribe_fields(
+  app_event_loop_t loop,
+  uint32_t fields,
+  app_state_handler_t handler,
+  void * arg,
+  const char * name
+) {
+  if (subscriber_count >= MAX_SUBSCRIBERS) {
+    ESP_LOGE(TAG, "too many subscribers, dropping %s", name);
+    return;
+  }
+
+  subscribers[subscriber_count] = (subscriber_t) {
+    .loop = loop,
+    .fields = fields,
+    .handler = handler,
+    .arg = arg,
+    .name = name,
+  };
+  subscriber_count += 1;
+
+  if (!dispatching[loop]) {
+    app_subscribe(loop, state_changed, dispatch_state_changed, (void *) (intptr_t) loop);
+    dispatching[loop] = true;
+  }
+
+  ESP_LOGI(TAG, "%s subscribed to fields 0x%02x", name, fields);
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "./app_events.h"
+#include "./app_trace.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+typedef enum {
+  APP_STATE_TEMP_OK,
+  APP_STATE_TEMP_ERROR
+} app_state_temp_t;
+
+
+// The canonical thermostat values of a zone, owned by the store.
+typedef struct {
+  // the zone the state is of, not a field
+  uint8_t zone;
+  app_state_temp_t temp_state;
+  float current_temp;
+  float target_temp;
+  float current_humid;
+  uint8_t heat;
+  // heating is suspended until the window is closed again
+  bool window_open;
+  // input that caused this state, not a field, changes to it are not reported
+  app_trace_t trace;
+} app_state_t;
+
+
+// Field bits of the change masks.
+typedef enum {
+  APP_STATE_FIELD_TEMP_STATE    = 1 << 0,
+  APP_STATE_FIELD_CURRENT_TEMP  = 1 << 1,
+  APP_STATE_FIELD_TARGET_TEMP   = 1 << 2,
+  APP_STATE_FIELD_CURRENT_HUMID = 1 << 3,
+  APP_STATE_FIELD_HEAT          = 1 << 4,
+  APP_STATE_FIELD_WINDOW_OPEN   = 1 << 5,
+
+  APP_STATE_FIELD_ALL           = (1 << 6) - 1
+} app_state_field_t;
+
+
+// `changed` holds the fields of `state->zone` changed since the handler was
+// last called for the zone, limited to the fields it subscribed to. `state`
+// is a consistent snapshot at least as new as those changes.
+typedef void (*app_state_handler_t)(void * arg, uint32_t changed, const app_state_t * state);
+
+
+// Publishes a new state of its zone, there must only be a single writer
+// per zone. Subscribers of the fields that differ from the zone's previous
+// state are notified through APP_EVENT_STATE_CHANGED on their loop.
+// Returns the mask of changed fields.
+uint32_t app_state_publish(const app_state_t * state);
+
+// Each zone's state is published as a seqlock, readers never block the writer.
+// Copies the zone's published state in a single attempt, returns false if
+// the copy was torn by a concurrent update, the caller may retry right away.
+bool app_state_try_get(uint8_t zone, app_state_t * state, uint32_t * version);
+
+// Copies the zone's published state, retrying until the copy is consistent.
+// Returns the version of the copied state, 0 if the zone never published one.
+uint32_t app_state_get(uint8_t zone, app_state_t * state);
+
+// Subscriptions must be made before the first state is published.
+void app_state_subscribe_fields(
+  app_event_loop_t loop,
+  uint32_t fields,
+  app_state_handler_t handler,
+  void * arg,
+  const char * name
+);
+
+#define app_state_subscribe(loop, fields, handler, arg) \
+  app_state_subscribe_fields(loop, fields, handler, arg, #handler)
+
+
+#ifdef __cplusplus
+}
+#endif
@@ -4,7 +4,7 @@
 #include "driver/ledc.h"
 
 #include "./app_events.h"
-#include "./app_thermostat.h"
+#include "./app_state.h"
 #include "./app_stats.h"
 
 
@@ -20,37 +20,33 @@ static void set_led_level(uint8_t lvl){
 }
 
 
+// called from the esp_timer task, must never block
 static void report_stats(void * arg) {
-  app_stats_t * stats = (app_stats_t*) arg;
-  app_post_event(APP_EVENT_STATS_REPORT, stats, sizeof(app_stats_t));
+  app_post_stats_report_timeout(NULL, 0);
 }
 
 
-static void handle_get_stats(void* arg, esp_event_base_t base, int32_t id, void* data) {
+static void handle_get_stats(void* arg, app_event_t evt_id, const app_no_data_t* data) {
   report_stats(arg);
 }
 
 
-static void handle_change(void* arg, esp_event_base_t evt_base, int32_t evt_id, void* data) {
-  app_stats_t * stats = (app_stats_t*) arg;
-  app_thermostat_state_t * current_state = (app_thermostat_state_t*) data;
-
-  stats->current_temp = current_state->current_temp;
-  stats->heat = current_state->heat;
-  stats->target_temp = current_state->target_temp;
-  stats->current_humid = current_state->current_humid;
-  stats->error = current_state->temp_state == APP_THERMOSTAT_TEMP_ERROR ? true : false;
-
+static void handle_change(void* arg, uint32_t changed, const app_state_t* state) {
   ESP_LOGI(TAG,
-    "curr: %f C, target: %f C heat: %d ERR: %d" ,
-    stats->current_temp, stats->target_temp, stats->heat, stats->error
+    "zone: %d curr: %f C, target: %f C heat: %d ERR: %d" ,
+    state->zone, state->current_temp, state->target_temp, state->heat, state->temp_state == APP_STATE_TEMP_ERROR
   );
 
-  if (stats->heat == 0) {
+  // the LED shows the first zone
+  if (!(changed & APP_STATE_FIELD_HEAT) || state->zone != 0) {
+    return;
+  }
+
+  if (state->heat == 0) {
     set_led_level(0);
-  } else if (stats->heat < 50) {
+  } else if (state->heat < 50) {
     set_led_level(10);
-  } else if (stats->heat < 100) {
+  } else if (state->heat < 100) {
     set_led_level(55);
   } else {
     set_led_level(100);
@@ -90,27 +86,21 @@ void app_start_stats_handler(gpio_num_t gpio_led) {
 
   init_led(gpio_led);
 
-  app_stats_t * stats = malloc(sizeof(app_stats_t));
-  // TODO: pass values in as args
-  *stats = (app_stats_t) {
-    .current_temp = 20.0,
-    .target_temp = 20.0,
-    .current_humid = 0,
-    .heat = 0,
-    .error = false
-  };
-
-  app_register_evt_handler(APP_EVENT_STATS_GET, handle_get_stats, stats);
-  app_register_evt_handler(APP_EVENT_THERMOSTAT_CHANGED, handle_change, stats);
+  app_subscribe(APP_EVENT_LOOP_TELEMETRY, stats_get, handle_get_stats, NULL);
+  app_state_subscribe(
+    APP_EVENT_LOOP_TELEMETRY,
+    APP_STATE_FIELD_HEAT | APP_STATE_FIELD_TARGET_TEMP | APP_STATE_FIELD_TEMP_STATE,
+    handle_change,
+    NULL
+  );
 
   esp_timer_create_args_t timer_args = {
     .name = "app-stats",
     .callback = &report_stats,
-    .arg = stats
   };
   esp_timer_handle_t timer;
   esp_timer_create(&timer_args, &timer);
   esp_timer_start_periodic(timer, stats_interval_sec * 1000*1000);
 
-  // TODO: need a stop func/handler and free(state);
+  // TODO: need a stop func/handler
 }
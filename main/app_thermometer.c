@@ -1,5 +1,7 @@
 #include <string.h>
 
+#include "sdkconfig.h"
+
 #include "esp_task_wdt.h"
 #include "esp_bt.h"
 #include "esp_gap_ble_api.h"
@@ -16,19 +18,38 @@
 #define TAG "app-thermometer"
 
 
-static void post_curr_temp_change_event(float temp) {
-  app_post_event(APP_EVENT_CURRENT_TEMP_CHANGED, &temp, sizeof(temp));
+// a sensor per zone and an optional one outside
+static esp_bd_addr_t zone_addrs[APP_ZONES] = {0};
+static uint8_t zone_count = 0;
+static esp_bd_addr_t outdoor_addr = {0};
+static bool has_outdoor = false;
+
+
+static void post_curr_temp_change_event(const app_traced_temp_t * temp) {
+  app_post_current_temp_changed(temp);
 }
 
 
 
-static void post_ble_temp_change_event(float temp) {
-  app_post_event(APP_EVENT_BLE_TEMP_CHANGED, &temp, sizeof(temp));
+// called from the Bluedroid task, must never block
+static void post_ble_temp_change_event(uint8_t zone, float temp) {
+  app_traced_temp_t data = {
+    .temp = temp,
+    .trace = app_trace_begin(APP_TRACE_ORIGIN_BLE),
+    .zone = zone
+  };
+  app_post_ble_temp_changed_timeout(&data, 0);
+}
+
+
+static void post_ble_humid_change_event(uint8_t zone, float humid) {
+  app_zone_value_t data = { .value = humid, .zone = zone };
+  app_post_current_humid_changed_timeout(&data, 0);
 }
 
 
-static void post_ble_humid_change_event(float humid) {
-  app_post_event(APP_EVENT_CURRENT_HUMID_CHANGED, &humid, sizeof(humid));
+static void post_outdoor_temp_change_event(float temp) {
+  app_post_outdoor_temp_changed_timeout(&temp, 0);
 }
 
 
@@ -87,8 +108,17 @@ static void gap_callback(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *p
         uint16_t humid_dec = 0;
         memcpy(&humid_dec, &scan_result->scan_rst.ble_adv[23], 2);
         float humid = humid_dec / 16.0;
-        post_ble_temp_change_event(temp);
-        post_ble_humid_change_event(humid);
+
+        // the whitelist only lets the configured sensors through
+        if (has_outdoor && memcmp(scan_result->scan_rst.bda, outdoor_addr, ESP_BD_ADDR_LEN) == 0) {
+          post_outdoor_temp_change_event(temp);
+        }
+        for (uint8_t zone = 0; zone < zone_count; zone++) {
+          if (memcmp(scan_result->scan_rst.bda, zone_addrs[zone], ESP_BD_ADDR_LEN) == 0) {
+            post_ble_temp_change_event(zone, temp);
+            post_ble_humid_change_event(zone, humid);
+          }
+        }
       }
     }
   }
@@ -103,7 +133,7 @@ static void gap_callback(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *p
 
 
 
-static void start_ble_thermometer(esp_bd_addr_t addr) {
+static void start_ble_thermometer(void) {
   ESP_LOGI(TAG, "starting BLE thermometer");
 
   // ESP_ERROR_CHECK(esp_bt_controller_mem_release(ESP_BT_MODE_CLASSIC_BT));
@@ -143,7 +173,12 @@ static void start_ble_thermometer(esp_bd_addr_t addr) {
     return;
   }
 
-  esp_ble_gap_update_whitelist(ESP_BLE_WHITELIST_ADD, addr, BLE_WL_ADDR_TYPE_PUBLIC);
+  for (uint8_t zone = 0; zone < zone_count; zone++) {
+    esp_ble_gap_update_whitelist(ESP_BLE_WHITELIST_ADD, zone_addrs[zone], BLE_WL_ADDR_TYPE_PUBLIC);
+  }
+  if (has_outdoor) {
+    esp_ble_gap_update_whitelist(ESP_BLE_WHITELIST_ADD, outdoor_addr, BLE_WL_ADDR_TYPE_PUBLIC);
+  }
 
   esp_err_t scan_ret = esp_ble_gap_set_scan_params(&ble_scan_params);
   if (scan_ret){
@@ -153,19 +188,18 @@ static void start_ble_thermometer(esp_bd_addr_t addr) {
 
 
 
-static void handle_ble_temp_changed(void *arg, esp_event_base_t evt_base, int32_t id, void *data) {
-  float temp = * (float*) data;
-
-  ESP_LOGI(TAG, "BLE temp: %f", temp);
+static void handle_ble_temp_changed(void *arg, app_event_t evt_id, const app_traced_temp_t *data) {
+  ESP_LOGI(TAG, "BLE temp of zone %d: %f", data->zone, data->temp);
 
   esp_task_wdt_reset();
 
-  post_curr_temp_change_event(temp);
+  // forwards the trace, the latency covers the whole path from the advertisement
+  post_curr_temp_change_event(data);
 }
 
 
 
-static void handle_app_started(void *arg, esp_event_base_t evt_base, int32_t id, void *data) {
+static void handle_app_started(void *arg, app_event_t evt_id, const app_no_data_t *data) {
   // watchdog for BLE, careful not to set it lower than OTA update time
   ESP_LOGI(TAG, "adding watchdog");
   esp_task_wdt_init(5*60, true);
@@ -173,18 +207,46 @@ static void handle_app_started(void *arg, esp_event_base_t evt_base, int32_t id,
 }
 
 
-static void handle_ota_request(void *arg, esp_event_base_t evt_base, int32_t id, void *data) {
+static void handle_ota_request(void *arg, app_event_t evt_id, const app_no_data_t *data) {
   ESP_LOGI(TAG, "removing watchdog");
   esp_task_wdt_delete(NULL);
 }
 
 
-void app_start_thermometer(gpio_num_t gpio_temp, esp_bd_addr_t addr) {
-  app_register_evt_handler(APP_EVENT_BLE_TEMP_CHANGED, handle_ble_temp_changed, 0);
-  app_register_evt_handler(APP_EVENT_STARTED, handle_app_started, NULL);
-  app_register_evt_handler(APP_EVENT_OTA, handle_ota_request, NULL);
-
-  start_ble_thermometer(addr);
+void app_start_thermometer(gpio_num_t gpio_temp, const esp_bd_addr_t * addrs, uint8_t count, esp_bd_addr_t outdoor) {
+  static const esp_bd_addr_t none = {0};
+
+  zone_count = (count < APP_ZONES) ? count : APP_ZONES;
+  memcpy(zone_addrs, addrs, zone_count * sizeof(esp_bd_addr_t));
+  memcpy(outdoor_addr, outdoor, ESP_BD_ADDR_LEN);
+  has_outdoor = memcmp(outdoor, none, ESP_BD_ADDR_LEN) != 0;
+  ESP_LOGI(TAG, "outdoor thermometer: %s", has_outdoor ? "yes" : "none");
+
+  // the watchdog is added to and fed from the task running these handlers,
+  // so they all have to stay on the same loop
+
+  // BLE_TEMP_CHANGED itself is not limited, it feeds the watchdog
+  app_set_event_rate_limit(
+    APP_EVENT_CURRENT_TEMP_CHANGED,
+    CONFIG_APP_THERMOMETER_MIN_INTERVAL_MS,
+    CONFIG_APP_THERMOMETER_TEMP_DEADBAND / 100.0
+  );
+  app_set_event_rate_limit(
+    APP_EVENT_CURRENT_HUMID_CHANGED,
+    CONFIG_APP_THERMOMETER_MIN_INTERVAL_MS,
+    CONFIG_APP_THERMOMETER_HUMID_DEADBAND / 100.0
+  );
+  app_set_event_rate_limit(
+    APP_EVENT_OUTDOOR_TEMP_CHANGED,
+    CONFIG_APP_THERMOMETER_MIN_INTERVAL_MS,
+    CONFIG_APP_THERMOMETER_TEMP_DEADBAND / 100.0
+  );
+
+  app_subscribe(APP_EVENT_LOOP_CONTROL, ble_temp_changed, handle_ble_temp_changed, 0);
+  app_subscribe(APP_EVENT_LOOP_CONTROL, started, handle_app_started, NULL);
+  app_subscribe(APP_EVENT_LOOP_CONTROL, ota, handle_ota_request, NULL);
+
+  start_ble_thermometer();
 }
 
 
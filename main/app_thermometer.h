@@ -9,7 +9,10 @@ extern "C" {
 #endif
 
 
-void app_start_thermometer(gpio_num_t gpio_temp, esp_bd_addr_t addr);
+// `addrs` holds the sensor address of each of `count` zones, the readings
+// carry the zone. `outdoor` is the address of an optional sensor outside,
+// all zeros without one. Its readings go to APP_EVENT_OUTDOOR_TEMP_CHANGED.
+void app_start_thermometer(gpio_num_t gpio_temp, const esp_bd_addr_t * addrs, uint8_t count, esp_bd_addr_t outdoor);
 
 
 #ifdef __cplusplus
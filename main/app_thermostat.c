@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <math.h>
 #include <string.h>
+#include <stdatomic.h>
 
 #include "sdkconfig.h"
 
@@ -10,6 +11,7 @@
 
 #include "esp_log.h"
 #include "esp_sleep.h"
+#include "esp_timer.h"
 #include "driver/adc.h"
 #include "nvs_flash.h"
 
@@ -17,17 +19,92 @@
 #include "temp_sensor.h"
 
 #include "./app_thermostat.h"
+#include "./app_autotune.h"
 #include "./app_events.h"
+#include "./app_heat_curve.h"
+#include "./app_model.h"
+#include "./app_pid.h"
+#include "./app_smith.h"
+#include "./app_state.h"
+#include "./app_window.h"
 
 #define sec 1000000
 
+// at least one tick, control intervals may be longer than both
+#define AT_LEAST_ONE_TICK(secs) (((secs) < CONFIG_APP_PID_INTERVAL_SEC) ? 1 : (secs) / CONFIG_APP_PID_INTERVAL_SEC)
+#define HORIZON_TICKS AT_LEAST_ONE_TICK(CONFIG_APP_MODEL_HORIZON_MIN * 60)
+#define MODEL_PERSIST_TICKS AT_LEAST_ONE_TICK(CONFIG_APP_MODEL_PERSIST_INTERVAL_MIN * 60)
+
 static const char* TAG = "app-thermostat";
 
 
+typedef struct {
+  app_state_t state;
+  uint8_t heat_min;
+  uint8_t heat_normal;
+  uint8_t heat_max;
+
+  app_thermostat_mode_t mode;
+  app_pid_t pid;
+  int64_t last_tick_us;
+
+  app_model_t model;
+  uint32_t model_ticks;
+
+  bool autotuning;
+  app_autotune_t autotune;
+
+  bool smith_enabled;
+  app_smith_t smith;
+
+  bool curve_enabled;
+  app_heat_curve_t curve;
+  float outdoor_temp;
+  // time of the last outdoor reading, 0 before the first
+  int64_t outdoor_us;
+
+  bool window_enabled;
+  app_window_t window;
+  int64_t window_until_us;
+
+  slow_pwm_t * pwm;
+  // the heat the PWM runs at, with the fraction the PID chose
+  int32_t heat_q16;
+} thermostat_t;
+
+
+// handlers get all zones, zoned events are dispatched by their zone index
+typedef struct {
+  thermostat_t * zones[APP_ZONES];
+  uint8_t count;
+  // the heaters of all zones, switched on at staggered phases
+  slow_pwm_group_t * pwm_group;
+} zones_t;
+
+
+
+static thermostat_t * zone_thermostat(const zones_t * zones, uint8_t zone) {
+  if (zone >= zones->count) {
+    ESP_LOGE(TAG, "no zone %d", zone);
+    return NULL;
+  }
+  return zones->zones[zone];
+}
+
+
 
-static void persist_target_temp(float target_temp) {
+// the zone's own settings, the controller settings are shared in "storage"
+static esp_err_t open_zone_storage(uint8_t zone, nvs_open_mode_t open_mode, nvs_handle_t * nvs_handle) {
+  char name[APP_ZONE_NVS_NAME_SIZE];
+  app_zone_nvs_namespace(name, "storage", zone);
+  return nvs_open(name, open_mode, nvs_handle);
+}
+
+
+
+static void persist_target_temp(uint8_t zone, float target_temp) {
   nvs_handle_t nvs_handle;
-  esp_err_t err = nvs_open("storage", NVS_READWRITE, &nvs_handle);
+  esp_err_t err = open_zone_storage(zone, NVS_READWRITE, &nvs_handle);
 
   if (err != ESP_OK) {
     ESP_LOGE(TAG, "Error (%s) opening NVS handle!", esp_err_to_name(err));
@@ -50,116 +127,763 @@ static void persist_target_temp(float target_temp) {
 
 
 
-static void post_changed_event(app_thermostat_state_t * state) {
-  app_post_event(APP_EVENT_THERMOSTAT_CHANGED, state, sizeof(app_thermostat_state_t));
+static void persist_controller(const thermostat_t * thermostat) {
+  nvs_handle_t nvs_handle;
+  esp_err_t err = nvs_open("storage", NVS_READWRITE, &nvs_handle);
+
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Error (%s) opening NVS handle!", esp_err_to_name(err));
+    return;
+  }
+
+  err = nvs_set_u8(nvs_handle, "ctrl_mode", thermostat->mode);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Error (%s) storing controller mode", esp_err_to_name(err));
+  }
+
+  err = nvs_set_blob(nvs_handle, "pid_gains", &(thermostat->pid.gains), sizeof(app_pid_gains_t));
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Error (%s) storing PID gains", esp_err_to_name(err));
+  }
+
+  err = nvs_commit(nvs_handle);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Error (%s) committing storage", esp_err_to_name(err));
+  }
+
+  nvs_close(nvs_handle);
+}
+
+
+
+// falls back to the Kconfig defaults for anything not stored yet
+static void load_controller(app_thermostat_mode_t * mode, app_pid_gains_t * gains) {
+#if defined(CONFIG_APP_CONTROLLER_PID)
+  *mode = APP_THERMOSTAT_MODE_PID;
+#elif defined(CONFIG_APP_CONTROLLER_PREDICTIVE)
+  *mode = APP_THERMOSTAT_MODE_PREDICTIVE;
+#else
+  *mode = APP_THERMOSTAT_MODE_LEVELS;
+#endif
+
+  *gains = (app_pid_gains_t) {
+    .kp_q16 = APP_PID_Q16(CONFIG_APP_PID_KP / 100.0),
+    .ki_q16 = APP_PID_Q16(CONFIG_APP_PID_KI / 100.0),
+    .kd_q16 = APP_PID_Q16(CONFIG_APP_PID_KD / 100.0),
+  };
+
+  nvs_handle_t nvs_handle;
+  if (nvs_open("storage", NVS_READONLY, &nvs_handle) != ESP_OK) {
+    return;
+  }
+
+  uint8_t stored_mode;
+  if (nvs_get_u8(nvs_handle, "ctrl_mode", &stored_mode) == ESP_OK && stored_mode < APP_THERMOSTAT_MODE_MAX) {
+    *mode = stored_mode;
+  }
+
+  app_pid_gains_t stored_gains;
+  size_t size = sizeof(stored_gains);
+  if (nvs_get_blob(nvs_handle, "pid_gains", &stored_gains, &size) == ESP_OK && size == sizeof(stored_gains)) {
+    *gains = stored_gains;
+  }
+
+  nvs_close(nvs_handle);
+}
+
+
+
+static void persist_model(uint8_t zone, const app_model_t * model) {
+  nvs_handle_t nvs_handle;
+  esp_err_t err = open_zone_storage(zone, NVS_READWRITE, &nvs_handle);
+
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Error (%s) opening NVS handle!", esp_err_to_name(err));
+    return;
+  }
+
+  err = nvs_set_blob(nvs_handle, "room_model", &(model->params), sizeof(app_model_params_t));
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Error (%s) storing room model", esp_err_to_name(err));
+  }
+
+  err = nvs_commit(nvs_handle);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Error (%s) committing storage", esp_err_to_name(err));
+  }
+
+  nvs_close(nvs_handle);
+}
+
+
+
+static void load_model(uint8_t zone, app_model_t * model) {
+  nvs_handle_t nvs_handle;
+  if (open_zone_storage(zone, NVS_READONLY, &nvs_handle) != ESP_OK) {
+    return;
+  }
+
+  // too large to keep on the stack
+  app_model_params_t * params = malloc(sizeof(app_model_params_t));
+  if (params == NULL) {
+    ESP_LOGE(TAG, "No memory to load the room model of zone %d, learning from scratch", zone);
+    nvs_close(nvs_handle);
+    return;
+  }
+  size_t size = sizeof(app_model_params_t);
+  esp_err_t err = nvs_get_blob(nvs_handle, "room_model", params, &size);
+
+  if (err == ESP_OK && size == sizeof(app_model_params_t) && app_model_restore(model, params)) {
+    ESP_LOGI(TAG, "Loaded room model of zone %d of %u samples", zone, params->samples);
+  } else {
+    ESP_LOGI(TAG, "No room model of zone %d in storage yet, learning from scratch", zone);
+  }
+
+  free(params);
+  nvs_close(nvs_handle);
+}
+
+
+
+// used by app_main for the PWM from the next start on
+static void persist_heat_cycle(uint8_t heat_cycle_sec) {
+  nvs_handle_t nvs_handle;
+  esp_err_t err = nvs_open("storage", NVS_READWRITE, &nvs_handle);
+
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Error (%s) opening NVS handle!", esp_err_to_name(err));
+    return;
+  }
+
+  err = nvs_set_u8(nvs_handle, "heat_cycle", heat_cycle_sec);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Error (%s) storing heat cycle", esp_err_to_name(err));
+  }
+
+  err = nvs_commit(nvs_handle);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Error (%s) committing storage", esp_err_to_name(err));
+  }
+
+  nvs_close(nvs_handle);
+}
+
+
+
+static void publish_state(thermostat_t * thermostat) {
+  app_state_publish(&(thermostat->state));
+}
+
+
+
+// Sets the PWM to the decided heat in Q16, the caller passes the PID's
+// output before rounding to have its fraction delivered over the cycles.
+// The PWM is only woken when the duty changes, every decision ends its
+// trace here all the same.
+static void apply_heat(thermostat_t * thermostat, int32_t heat_q16) {
+  if (heat_q16 != thermostat->heat_q16) {
+    // the heat is in % of the cycle, whole steps of the PWM's resolution
+    // are set exactly, anything else as a share of the cycle
+    const int64_t steps_x100_q16 = (int64_t) heat_q16 * thermostat->pwm->cycle_ticks;
+    if (steps_x100_q16 % (100 << 16) == 0) {
+      set_pwm_duty(thermostat->pwm, steps_x100_q16 / (100 << 16));
+    } else {
+      set_pwm_duty_q16(thermostat->pwm, (heat_q16 + 50) / 100);
+    }
+    thermostat->heat_q16 = heat_q16;
+  }
+
+  app_trace_end(&(thermostat->state.trace));
+  thermostat->state.trace = (app_trace_t) {0};
+}
+
+
+
+// what the levels and the PID act on
+static float control_temp(const thermostat_t * thermostat) {
+  const float measured = thermostat->state.current_temp;
+  return thermostat->smith_enabled
+    ? app_smith_predict(&(thermostat->smith), measured)
+    : measured;
+}
+
+
+
+// advances the predictor by the heat of the last tick, on the learned plant once there is one
+static void update_smith(thermostat_t * thermostat) {
+  app_model_fit_t fit;
+  app_model_get_fit(&(thermostat->model), &fit);
+  if (fit.valid) {
+    app_smith_set_plant(&(thermostat->smith), fit.gain, fit.loss, fit.dead_time_sec);
+  }
+
+  app_smith_update(&(thermostat->smith), thermostat->state.heat);
+
+  if (thermostat->state.temp_state == APP_STATE_TEMP_OK) {
+    app_smith_prediction_t prediction = {
+      .measured = thermostat->state.current_temp,
+      .predicted = control_temp(thermostat),
+      .zone = thermostat->state.zone,
+    };
+    ESP_LOGI(TAG, "measured %.2f predicted %.2f", prediction.measured, prediction.predicted);
+    app_post_smith_prediction(&prediction);
+  }
+}
+
+
+
+// the heat curve's duty for the latest outdoor reading, if there is a recent one
+static bool base_heat(const thermostat_t * thermostat, uint8_t * heat) {
+#ifdef CONFIG_APP_HEAT_CURVE
+  const int64_t max_age_us = CONFIG_APP_HEAT_CURVE_OUTDOOR_TIMEOUT_MIN * 60 * (int64_t) sec;
+
+  if (!thermostat->curve_enabled || thermostat->outdoor_us == 0
+      || esp_timer_get_time() - thermostat->outdoor_us > max_age_us) {
+    return false;
+  }
+  *heat = app_heat_curve_duty(
+    &(thermostat->curve),
+    lroundf(thermostat->outdoor_temp * 100),
+    lroundf(thermostat->state.target_temp * 100)
+  );
+  return true;
+#else
+  return false;
+#endif
+}
+
+
+
+// the PID trims the base heat, without one it is on its own
+static void update_feedforward(thermostat_t * thermostat) {
+  uint8_t base;
+  app_pid_set_feedforward(&(thermostat->pid), base_heat(thermostat, &base) ? base : 0);
 }
 
 
 
-static void handle_temp_change(app_thermostat_state_t * state){
+// with a base heat the levels trim it, by their distance to heat_normal
+static uint8_t levels_heat(const thermostat_t * thermostat, float temp_diff) {
+  uint8_t level;
+  if (temp_diff <= -1) {
+    level = thermostat->heat_max;
+  } else if (temp_diff < 0) {
+    level = thermostat->heat_normal;
+  } else {
+    level = thermostat->heat_min;
+  }
+
+  uint8_t base;
+  if (!base_heat(thermostat, &base)) {
+    return level;
+  }
+  const int trimmed = base + level - thermostat->heat_normal;
+  if (trimmed < thermostat->heat_min) {
+    return thermostat->heat_min;
+  }
+  if (trimmed > thermostat->heat_max) {
+    return thermostat->heat_max;
+  }
+  return trimmed;
+}
+
+
+
+// flags a window on a fall of the temperature too fast for the heating
+static void detect_window(thermostat_t * thermostat) {
+#ifdef CONFIG_APP_WINDOW_DETECTION
+  app_state_t * state = &(thermostat->state);
+  if (!thermostat->window_enabled || state->window_open || state->temp_state != APP_STATE_TEMP_OK) {
+    return;
+  }
+
+  const int64_t now = esp_timer_get_time();
+  if (app_window_update(&(thermostat->window), now / 1000, state->current_temp)) {
+    ESP_LOGW(TAG, "window open, temp falling %.2f °C/min", thermostat->window.slope);
+    state->window_open = true;
+    thermostat->window_until_us = now + CONFIG_APP_WINDOW_SUSPEND_MIN * 60 * (int64_t) sec;
+    app_window_reset(&(thermostat->window));
+  }
+#endif
+}
+
+
+
+// heating resumes, the PID bumpless from the suspended heat
+static void close_window(thermostat_t * thermostat) {
+  ESP_LOGI(TAG, "resuming heating after the open window");
+  thermostat->state.window_open = false;
+  update_feedforward(thermostat);
+  app_pid_reset(&(thermostat->pid), thermostat->state.heat);
+}
+
+
+
+// applies and reports the outcome, the caller restores the heat
+static void finish_autotune(thermostat_t * thermostat) {
+  app_autotune_result_t result;
+  app_autotune_get_result(&(thermostat->autotune), &result);
+  result.zone = thermostat->state.zone;
+  thermostat->autotuning = false;
+
+  ESP_LOGI(TAG, "autotune %s after %d cycles", app_autotune_status_name(result.status), result.cycles);
+
+  if (result.status == APP_AUTOTUNE_DONE) {
+    app_pid_set_gains(&(thermostat->pid), &(result.gains));
+    persist_controller(thermostat);
+    persist_heat_cycle(result.heat_cycle_sec);
+  }
+  // bumpless, from the last relay output
+  update_feedforward(thermostat);
+  app_pid_reset(&(thermostat->pid), thermostat->state.heat);
+  thermostat->last_tick_us = esp_timer_get_time();
+
+  app_post_autotune_result(&result);
+}
+
+
+
+static void handle_temp_change(thermostat_t * thermostat){
+  app_state_t * state = &(thermostat->state);
   ESP_LOGI(TAG, "calculating new heat: %f -> %f", state->current_temp, state->target_temp);
 
-  float temp_diff = state->current_temp - state->target_temp;
+  float temp_diff = control_temp(thermostat) - state->target_temp;
 
   uint8_t heat = state->heat;
+  bool hold = false;
 
-  if (state->temp_state != APP_THERMOSTAT_TEMP_OK) {
+  if (state->temp_state != APP_STATE_TEMP_OK) {
     ESP_LOGE(TAG, "temp error ... min heat");
-    heat = state->heat_min;
-
-  } else if (temp_diff <= -1) {
-    heat = state->heat_max;
+    if (thermostat->autotuning) {
+      app_autotune_abort(&(thermostat->autotune));
+      finish_autotune(thermostat);
+    }
+    heat = thermostat->heat_min;
+    // the PID continues from its last output once the sensor recovers
+    app_pid_reset(&(thermostat->pid), thermostat->pid.terms.output);
+
+  } else if (state->window_open) {
+    ESP_LOGI(TAG, "window open ... min heat");
+    if (thermostat->autotuning) {
+      app_autotune_abort(&(thermostat->autotune));
+      finish_autotune(thermostat);
+    }
+    heat = thermostat->heat_min;
 
-  } else if (temp_diff < 0) {
-    heat = state->heat_normal;
+  } else if (thermostat->autotuning || thermostat->mode != APP_THERMOSTAT_MODE_LEVELS) {
+    // sample and hold, picked up on the next control tick, which ends the
+    // trace once the duty follows; a later input replaces the trace
+    hold = true;
 
   } else {
-    heat = state->heat_min;
+    heat = levels_heat(thermostat, temp_diff);
   }
 
   state->heat = heat;
-  post_changed_event(state);
+  publish_state(thermostat);
+  if (!hold) {
+    apply_heat(thermostat, (int32_t) heat << 16);
+  }
 }
 
 
 
-static void handle_traget_temp_changed(void *arg, esp_event_base_t evt_base, int32_t id, void *data) {
-
-  app_thermostat_state_t * state = (app_thermostat_state_t*) arg;
-  float target_temp = *((float*) data);
+static void handle_traget_temp_changed(void *arg, app_event_t evt_id, const app_traced_temp_t *data) {
+  thermostat_t * thermostat = zone_thermostat((zones_t *) arg, data->zone);
+  if (thermostat == NULL) {
+    return;
+  }
+  float target_temp = data->temp;
 
-  state->target_temp = target_temp;
+  thermostat->state.target_temp = target_temp;
+  thermostat->state.trace = data->trace;
   // TODO: should not live here
-  persist_target_temp(target_temp);
-  handle_temp_change(state);
+  persist_target_temp(data->zone, target_temp);
+  handle_temp_change(thermostat);
+}
+
+
+
+static void handle_current_temp_changed(void *arg, app_event_t evt_id, const app_traced_temp_t *data) {
+  thermostat_t * thermostat = zone_thermostat((zones_t *) arg, data->zone);
+  if (thermostat == NULL) {
+    return;
+  }
+  thermostat->state.current_temp = data->temp;
+  thermostat->state.trace = data->trace;
+  detect_window(thermostat);
+  handle_temp_change(thermostat);
 }
 
 
 
-static void handle_current_temp_changed(void *arg, esp_event_base_t evt_base, int32_t id, void *data) {
-  app_thermostat_state_t * state = (app_thermostat_state_t*) arg;
-  float temp = *((float*) data);
-  state->current_temp = temp;
-  handle_temp_change(state);
+// a cold snap changes the heat right away, not once the room has cooled
+static void handle_outdoor_temp_changed(void *arg, app_event_t evt_id, const float *data) {
+  zones_t * zones = (zones_t *) arg;
+  ESP_LOGI(TAG, "outdoor temp: %f", *data);
+
+  // all zones share the outdoor thermometer
+  for (uint8_t zone = 0; zone < zones->count; zone++) {
+    thermostat_t * thermostat = zones->zones[zone];
+    thermostat->outdoor_temp = *data;
+    thermostat->outdoor_us = esp_timer_get_time();
+    handle_temp_change(thermostat);
+  }
 }
 
 
 
-static void handle_current_humid_changed(void *arg, esp_event_base_t evt_base, int32_t id, void *data) {
-  app_thermostat_state_t * state = (app_thermostat_state_t*) arg;
-  float humid = *((float*) data);
-  state->current_humid = humid;
-  post_changed_event(state);
+static void handle_current_humid_changed(void *arg, app_event_t evt_id, const app_zone_value_t *data) {
+  thermostat_t * thermostat = zone_thermostat((zones_t *) arg, data->zone);
+  if (thermostat == NULL) {
+    return;
+  }
+  thermostat->state.current_humid = data->value;
+  publish_state(thermostat);
 }
 
 
-static void handle_temp_read_state_changed(void *arg, esp_event_base_t evt_base, int32_t id, void *data) {
-  app_thermostat_state_t * state = (app_thermostat_state_t*) arg;
-  bool err = *((bool*) data);
+static void handle_temp_read_state_changed(void *arg, app_event_t evt_id, const app_zone_flag_t *data) {
+  thermostat_t * thermostat = zone_thermostat((zones_t *) arg, data->zone);
+  if (thermostat == NULL) {
+    return;
+  }
+  bool err = data->value;
 
-  state->temp_state = err
-    ? APP_THERMOSTAT_TEMP_ERROR
-    : APP_THERMOSTAT_TEMP_OK;
+  thermostat->state.temp_state = err
+    ? APP_STATE_TEMP_ERROR
+    : APP_STATE_TEMP_OK;
 
-  handle_temp_change(state);
+  // a slope across the gap is not reliable
+  app_window_reset(&(thermostat->window));
+  handle_temp_change(thermostat);
 }
 
 
 
-static void handle_heat_changed(void *arg, esp_event_base_t evt_base, int32_t id, void *data) {
-  slow_pwm_t * pwm = (slow_pwm_t*) arg;
-  app_thermostat_state_t * state = (app_thermostat_state_t*) data;
-  set_pwm_duty(pwm, state->heat);
+static void control_tick(thermostat_t * thermostat) {
+  app_state_t * state = &(thermostat->state);
+
+  const int64_t now = esp_timer_get_time();
+  const uint32_t dt_ms = (now - thermostat->last_tick_us) / 1000;
+  thermostat->last_tick_us = now;
+
+  // learns in every mode, from the heat held since the last tick,
+  // an open window is no behaviour of the room
+  if (state->temp_state == APP_STATE_TEMP_OK && !state->window_open) {
+    app_model_update(&(thermostat->model), state->current_temp, state->heat);
+  } else {
+    app_model_skip(&(thermostat->model));
+  }
+
+  if (thermostat->smith_enabled) {
+    update_smith(thermostat);
+  }
+
+  thermostat->model_ticks += 1;
+  if (thermostat->model_ticks >= MODEL_PERSIST_TICKS) {
+    thermostat->model_ticks = 0;
+    persist_model(state->zone, &(thermostat->model));
+
+    app_model_fit_t fit;
+    app_model_get_fit(&(thermostat->model), &fit);
+    fit.zone = state->zone;
+    app_post_model_fit(&fit);
+  }
+
+  if (state->window_open) {
+    if (now >= thermostat->window_until_us) {
+      close_window(thermostat);
+      handle_temp_change(thermostat);
+    }
+    return;
+  }
+
+  if (thermostat->autotuning && state->temp_state == APP_STATE_TEMP_OK) {
+    const app_autotune_status_t status = app_autotune_update(
+      &(thermostat->autotune), state->current_temp, dt_ms, &(state->heat)
+    );
+    publish_state(thermostat);
+    apply_heat(thermostat, (int32_t) state->heat << 16);
+
+    if (status != APP_AUTOTUNE_RUNNING) {
+      finish_autotune(thermostat);
+      handle_temp_change(thermostat);
+    }
+    return;
+  }
+
+  if (thermostat->mode == APP_THERMOSTAT_MODE_LEVELS || state->temp_state != APP_STATE_TEMP_OK) {
+    return;
+  }
+  update_feedforward(thermostat);
+
+  if (thermostat->mode == APP_THERMOSTAT_MODE_PREDICTIVE && app_model_valid(&(thermostat->model))) {
+    state->heat = app_model_choose_duty(
+      &(thermostat->model),
+      state->current_temp,
+      state->target_temp,
+      thermostat->heat_min,
+      thermostat->heat_max,
+      HORIZON_TICKS
+    );
+    // the PID takes over bumpless should the model become implausible
+    app_pid_reset(&(thermostat->pid), state->heat);
+    publish_state(thermostat);
+    apply_heat(thermostat, (int32_t) state->heat << 16);
+    return;
+  }
+
+  state->heat = app_pid_update(
+    &(thermostat->pid),
+    lroundf(state->target_temp * 100),
+    lroundf(control_temp(thermostat) * 100),
+    dt_ms
+  );
+  publish_state(thermostat);
+  // changes within the rounding do not change the published heat
+  apply_heat(thermostat, thermostat->pid.output_q16);
+
+  app_pid_terms_t terms = thermostat->pid.terms;
+  terms.zone = state->zone;
+  app_post_pid_terms(&terms);
 }
 
 
 
-void app_start_thermostat(gpio_num_t gpio_pwm, uint8_t heat_min, uint8_t heat_normal, uint8_t heat_max, uint8_t cycle_len, float target_temp) {
-  ESP_LOGI(TAG, "starting thermostat min, normal, max: %d, %d, %d -> %f", heat_min, heat_normal, heat_max, target_temp);
+static void handle_control_tick(void *arg, app_event_t evt_id, const app_no_data_t *data) {
+  zones_t * zones = (zones_t *) arg;
+  for (uint8_t zone = 0; zone < zones->count; zone++) {
+    control_tick(zones->zones[zone]);
+  }
+}
 
-  const uint64_t pwm_freq = cycle_len * sec;
-  const uint32_t pwm_resolution = 100;
-  const uint32_t pwm_duty = 0;
 
-  slow_pwm_t * pwm = start_pwm(pwm_freq, pwm_resolution, pwm_duty, gpio_pwm);
 
-  app_thermostat_state_t * state = malloc(sizeof(app_thermostat_state_t));
-  *state = (app_thermostat_state_t) {
-    .temp_state = APP_THERMOSTAT_TEMP_OK,
-    .current_temp = 20,
-    .target_temp = target_temp,
-    .current_humid = 0,
-    .heat = heat_min,
+// called from the esp_timer task, must never block
+static void post_control_tick(void * arg) {
+  app_post_control_tick_timeout(NULL, 0);
+}
+
+
+
+static void handle_autotune_start(void *arg, app_event_t evt_id, const uint8_t *data) {
+  thermostat_t * thermostat = zone_thermostat((zones_t *) arg, *data);
+  if (thermostat == NULL) {
+    return;
+  }
+  app_state_t * state = &(thermostat->state);
+
+  if (thermostat->autotuning) {
+    ESP_LOGW(TAG, "autotune already running");
+    return;
+  }
+  if (state->temp_state != APP_STATE_TEMP_OK) {
+    ESP_LOGE(TAG, "temp error ... not starting autotune");
+    app_autotune_result_t result = { .status = APP_AUTOTUNE_ABORTED, .zone = state->zone };
+    app_post_autotune_result(&result);
+    return;
+  }
+
+  ESP_LOGI(TAG, "starting autotune of zone %d around %f", state->zone, state->target_temp);
+  app_autotune_start(
+    &(thermostat->autotune),
+    state->target_temp,
+    CONFIG_APP_AUTOTUNE_HYSTERESIS_CDEG / 100.0f,
+    thermostat->heat_min,
+    thermostat->heat_max,
+    CONFIG_APP_AUTOTUNE_MAX_HOURS * 3600 * 1000
+  );
+  thermostat->autotuning = true;
+
+  // the relay switches right away, not on the next tick
+  app_autotune_update(&(thermostat->autotune), state->current_temp, 0, &(state->heat));
+  publish_state(thermostat);
+  apply_heat(thermostat, (int32_t) state->heat << 16);
+}
+
+
+
+static void handle_autotune_stop(void *arg, app_event_t evt_id, const uint8_t *data) {
+  thermostat_t * thermostat = zone_thermostat((zones_t *) arg, *data);
+
+  if (thermostat != NULL && thermostat->autotuning) {
+    app_autotune_abort(&(thermostat->autotune));
+    finish_autotune(thermostat);
+    handle_temp_change(thermostat);
+  }
+}
+
+
+
+static void set_mode(thermostat_t * thermostat, app_thermostat_mode_t mode) {
+  ESP_LOGI(TAG, "zone %d controller mode %d -> %d", thermostat->state.zone, thermostat->mode, mode);
+  if (thermostat->autotuning) {
+    app_autotune_abort(&(thermostat->autotune));
+    finish_autotune(thermostat);
+  }
+  if (mode != APP_THERMOSTAT_MODE_LEVELS && thermostat->mode == APP_THERMOSTAT_MODE_LEVELS) {
+    // bumpless, the PID starts from the current heat
+    update_feedforward(thermostat);
+    app_pid_reset(&(thermostat->pid), thermostat->state.heat);
+    thermostat->last_tick_us = esp_timer_get_time();
+  }
+  thermostat->mode = mode;
+  handle_temp_change(thermostat);
+}
+
+
+
+// the controller settings apply to all zones
+static void handle_controller_mode_set(void *arg, app_event_t evt_id, const uint8_t *data) {
+  zones_t * zones = (zones_t *) arg;
+  const app_thermostat_mode_t mode = *data;
+
+  if (mode >= APP_THERMOSTAT_MODE_MAX) {
+    ESP_LOGE(TAG, "unknown controller mode %d", mode);
+    return;
+  }
+
+  for (uint8_t zone = 0; zone < zones->count; zone++) {
+    set_mode(zones->zones[zone], mode);
+  }
+  persist_controller(zones->zones[0]);
+}
+
+
+
+static void handle_pid_gains_set(void *arg, app_event_t evt_id, const app_pid_gains_t *data) {
+  zones_t * zones = (zones_t *) arg;
+  ESP_LOGI(TAG, "PID gains kp, ki, kd: %d, %d, %d (Q16)", data->kp_q16, data->ki_q16, data->kd_q16);
+
+  for (uint8_t zone = 0; zone < zones->count; zone++) {
+    app_pid_set_gains(&(zones->zones[zone]->pid), data);
+  }
+  persist_controller(zones->zones[0]);
+}
+
+
+
+static thermostat_t * start_zone(
+  uint8_t zone,
+  const app_thermostat_zone_t * conf,
+  uint8_t heat_min,
+  uint8_t heat_normal,
+  uint8_t heat_max,
+  slow_pwm_group_t * pwm_group
+) {
+  ESP_LOGI(TAG, "starting zone %d on GPIO %d -> %f", zone, conf->gpio_pwm, conf->target_temp);
+
+  const uint32_t pwm_duty = 0;
+
+  app_thermostat_mode_t mode;
+  app_pid_gains_t gains;
+  load_controller(&mode, &gains);
+
+  thermostat_t * thermostat = malloc(sizeof(thermostat_t));
+  *thermostat = (thermostat_t) {
+    .state = {
+      .zone = zone,
+      .temp_state = APP_STATE_TEMP_OK,
+      .current_temp = 20,
+      .target_temp = conf->target_temp,
+      .current_humid = 0,
+      .heat = heat_min,
+    },
     .heat_min = heat_min,
     .heat_max = heat_max,
     .heat_normal = heat_normal,
+    .mode = mode,
+    .last_tick_us = esp_timer_get_time(),
+    .pwm = start_pwm_channel(pwm_group, pwm_duty, conf->gpio_pwm),
+    .heat_q16 = pwm_duty << 16,
   };
+  app_pid_init(&(thermostat->pid), &gains, heat_min, heat_max);
+  app_model_init(&(thermostat->model), CONFIG_APP_PID_INTERVAL_SEC * 1000);
+  load_model(zone, &(thermostat->model));
+#ifdef CONFIG_APP_SMITH_PREDICTOR
+  thermostat->smith_enabled = true;
+  app_smith_init(&(thermostat->smith), CONFIG_APP_PID_INTERVAL_SEC * 1000);
+  app_smith_set_plant(
+    &(thermostat->smith),
+    CONFIG_APP_SMITH_GAIN / 1000.0f,
+    CONFIG_APP_SMITH_LOSS / 1000.0f,
+    CONFIG_APP_SMITH_DEAD_TIME_SEC
+  );
+#endif
+
+#ifdef CONFIG_APP_WINDOW_DETECTION
+  thermostat->window_enabled = true;
+  app_window_init(&(thermostat->window), CONFIG_APP_WINDOW_DETECT_SEC, CONFIG_APP_WINDOW_DROP_RATE);
+#endif
+
+#ifdef CONFIG_APP_HEAT_CURVE
+  thermostat->curve_enabled = true;
+  app_heat_curve_init(
+    &(thermostat->curve),
+    CONFIG_APP_HEAT_CURVE_DESIGN_TEMP,
+    CONFIG_APP_HEAT_CURVE_DESIGN_DUTY,
+    CONFIG_APP_HEAT_CURVE_LIMIT_TEMP,
+    CONFIG_APP_HEAT_CURVE_EXPONENT
+  );
+#endif
+
+#ifdef CONFIG_APP_HEAT_BURST_FIRE
+  if (!set_pwm_modulation(thermostat->pwm, SLOW_PWM_MODULATION_BURST)) {
+    ESP_LOGW(TAG, "no burst fire output for zone %d", zone);
+  }
+#endif
+
+  return thermostat;
+}
+
+
+
+void app_start_thermostat(
+  const app_thermostat_zone_t * zone_conf,
+  uint8_t zone_count,
+  uint8_t heat_min,
+  uint8_t heat_normal,
+  uint8_t heat_max,
+  uint8_t cycle_len
+) {
+  ESP_LOGI(TAG, "starting %d zones min, normal, max: %d, %d, %d", zone_count, heat_min, heat_normal, heat_max);
 
-  app_register_evt_handler(APP_EVENT_TARGET_TEMP_CHANGED, handle_traget_temp_changed, state);
-  app_register_evt_handler(APP_EVENT_CURRENT_TEMP_CHANGED, handle_current_temp_changed, state);
-  app_register_evt_handler(APP_EVENT_CURRENT_HUMID_CHANGED, handle_current_humid_changed, state);
-  app_register_evt_handler(APP_EVENT_TEMP_READ_STATE, handle_temp_read_state_changed, state);
-  app_register_evt_handler(APP_EVENT_THERMOSTAT_CHANGED, handle_heat_changed, pwm);
+  zones_t * zones = calloc(1, sizeof(zones_t));
+  zones->count = (zone_count < APP_ZONES) ? zone_count : APP_ZONES;
+
+  const uint64_t pwm_freq = cycle_len * sec;
+  const uint32_t pwm_resolution = 100;
+  zones->pwm_group = start_pwm_group(pwm_freq, pwm_resolution, zones->count);
+  for (uint8_t zone = 0; zone < zones->count; zone++) {
+    zones->zones[zone] = start_zone(zone, &(zone_conf[zone]), heat_min, heat_normal, heat_max, zones->pwm_group);
+  }
+
+  for (uint8_t zone = 0; zone < zones->count; zone++) {
+    thermostat_t * thermostat = zones->zones[zone];
+    publish_state(thermostat);
+    apply_heat(thermostat, (int32_t) thermostat->state.heat << 16);
+  }
+
+  app_subscribe(APP_EVENT_LOOP_CONTROL, target_temp_changed, handle_traget_temp_changed, zones);
+  app_subscribe(APP_EVENT_LOOP_CONTROL, current_temp_changed, handle_current_temp_changed, zones);
+  app_subscribe(APP_EVENT_LOOP_CONTROL, outdoor_temp_changed, handle_outdoor_temp_changed, zones);
+  app_subscribe(APP_EVENT_LOOP_CONTROL, current_humid_changed, handle_current_humid_changed, zones);
+  app_subscribe(APP_EVENT_LOOP_CONTROL, temp_read_state, handle_temp_read_state_changed, zones);
+
+  app_subscribe(APP_EVENT_LOOP_CONTROL, control_tick, handle_control_tick, zones);
+  app_subscribe(APP_EVENT_LOOP_CONTROL, controller_mode_set, handle_controller_mode_set, zones);
+  app_subscribe(APP_EVENT_LOOP_CONTROL, pid_gains_set, handle_pid_gains_set, zones);
+  app_subscribe(APP_EVENT_LOOP_CONTROL, autotune_start, handle_autotune_start, zones);
+  app_subscribe(APP_EVENT_LOOP_CONTROL, autotune_stop, handle_autotune_stop, zones);
+
+  esp_timer_create_args_t timer_args = {
+    .name = "app-control",
+    .callback = &post_control_tick,
+  };
+  esp_timer_handle_t timer;
+  esp_timer_create(&timer_args, &timer);
+  esp_timer_start_periodic(timer, (uint64_t) CONFIG_APP_PID_INTERVAL_SEC * sec);
 }
 
 
@@ -8,32 +8,31 @@ extern "C" {
 #endif
 
 
+// payload of APP_EVENT_CONTROLLER_MODE_SET
 typedef enum {
-  APP_THERMOSTAT_TEMP_OK,
-  APP_THERMOSTAT_TEMP_ERROR
-} app_thermostat_temp_state_t;
+  APP_THERMOSTAT_MODE_LEVELS,
+  APP_THERMOSTAT_MODE_PID,
+  APP_THERMOSTAT_MODE_PREDICTIVE,
+
+  APP_THERMOSTAT_MODE_MAX
+} app_thermostat_mode_t;
 
 
 typedef struct {
-  app_thermostat_temp_state_t temp_state;
-  float current_temp;
+  gpio_num_t gpio_pwm;
   float target_temp;
-  float current_humid;
-  uint8_t heat;
-  uint8_t heat_min;
-  uint8_t heat_normal;
-  uint8_t heat_max;
-} app_thermostat_state_t;
-
+} app_thermostat_zone_t;
 
 
+// A thermostat per zone, up to APP_ZONES. The heat levels, the PWM cycle
+// and the controller settings are shared by all zones.
 void app_start_thermostat(
-  gpio_num_t gpio_pwm,
+  const app_thermostat_zone_t * zones,
+  uint8_t zone_count,
   uint8_t heat_min,
   uint8_t heat_normal,
   uint8_t heat_max,
-  uint8_t cycle_len,
-  float target_temp
+  uint8_t cycle_len
 );
 
 
@@ -1,4 +1,7 @@
 #include <time.h>
+#include <stdlib.h>
+
+#include "sdkconfig.h"
 
 #include "esp_log.h"
 #include "esp_sntp.h"
@@ -18,18 +21,21 @@ static void log_curr_time() {
 
   char strftime_buf[64];
   strftime(strftime_buf, sizeof(strftime_buf), "%c", &timeinfo);
-  ESP_LOGI(TAG, "current date/time is: %s UTC", strftime_buf);
+  ESP_LOGI(TAG, "current date/time is: %s %s", strftime_buf, CONFIG_APP_TIMEZONE);
 }
 
 
 static void time_sync_notification_cb(struct timeval *tv) {
-  app_post_event(APP_EVENT_TIME_UPDATED, NULL, 0);
+  app_post_time_updated(NULL);
   log_curr_time();
 }
 
 
 void app_start_timekeeper(void) {
   ESP_LOGI(TAG, "initializing SNTP...");
+  // local time of the log and the schedule
+  setenv("TZ", CONFIG_APP_TIMEZONE, 1);
+  tzset();
   log_curr_time();
   sntp_setoperatingmode(SNTP_OPMODE_POLL);
   sntp_setservername(0, "pool.ntp.org");
@@ -0,0 +1,136 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "sdkconfig.h"
+
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "./app_events.h"
+#include "./app_trace.h"
+
+
+static const char* TAG = "app-trace";
+
+
+#define SAMPLES 64
+
+
+typedef struct {
+  uint32_t samples[SAMPLES];
+  uint32_t next;
+  uint32_t count;
+  uint32_t max_us;
+} latencies_t;
+
+
+static latencies_t latencies[APP_TRACE_ORIGIN_MAX] = {0};
+
+static atomic_uint_fast16_t next_id = 1;
+
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+static const char * origin_names[APP_TRACE_ORIGIN_MAX] = {
+  [APP_TRACE_ORIGIN_NONE] = "none",
+  [APP_TRACE_ORIGIN_BLE] = "ble",
+  [APP_TRACE_ORIGIN_HOMEKIT] = "homekit",
+  [APP_TRACE_ORIGIN_MQTT] = "mqtt",
+};
+
+
+
+app_trace_t app_trace_begin(app_trace_origin_t origin) {
+  return (app_trace_t) {
+    .origin_us = (uint32_t) esp_timer_get_time(),
+    .id = atomic_fetch_add(&next_id, 1),
+    .origin = origin
+  };
+}
+
+
+
+void app_trace_end(const app_trace_t * trace) {
+  if (trace->origin == APP_TRACE_ORIGIN_NONE || trace->origin >= APP_TRACE_ORIGIN_MAX) {
+    return;
+  }
+
+  const uint32_t latency_us = (uint32_t) esp_timer_get_time() - trace->origin_us;
+  latencies_t * lat = &(latencies[trace->origin]);
+
+  portENTER_CRITICAL(&lock);
+  lat->samples[lat->next] = latency_us;
+  lat->next = (lat->next + 1) % SAMPLES;
+  lat->count += 1;
+  if (latency_us > lat->max_us) {
+    lat->max_us = latency_us;
+  }
+  portEXIT_CRITICAL(&lock);
+
+  ESP_LOGD(TAG, "trace %u from %s: %u us", trace->id, origin_names[trace->origin], latency_us);
+}
+
+
+
+static int compare_u32(const void * a, const void * b) {
+  const uint32_t x = *(const uint32_t *) a;
+  const uint32_t y = *(const uint32_t *) b;
+  return (x > y) - (x < y);
+}
+
+
+
+static uint32_t percentile(const uint32_t * sorted, uint32_t n, uint32_t pct) {
+  return sorted[(n - 1) * pct / 100];
+}
+
+
+
+void app_trace_get_stats(app_trace_origin_t origin, app_trace_stats_t * stats) {
+  uint32_t sorted[SAMPLES];
+  latencies_t * lat = &(latencies[origin]);
+
+  portENTER_CRITICAL(&lock);
+  const uint32_t n = lat->count < SAMPLES ? lat->count : SAMPLES;
+  memcpy(sorted, lat->samples, n * sizeof(uint32_t));
+  *stats = (app_trace_stats_t) {
+    .count = lat->count,
+    .max_us = lat->max_us
+  };
+  portEXIT_CRITICAL(&lock);
+
+  if (n == 0) {
+    return;
+  }
+
+  qsort(sorted, n, sizeof(uint32_t), compare_u32);
+  stats->p50_us = percentile(sorted, n, 50);
+  stats->p90_us = percentile(sorted, n, 90);
+  stats->p99_us = percentile(sorted, n, 99);
+}
+
+
+
+const char * app_trace_origin_name(app_trace_origin_t origin) {
+  return (origin < APP_TRACE_ORIGIN_MAX) ? origin_names[origin] : "unknown";
+}
+
+
+
+// called from the esp_timer task, must never block
+static void report_traces(void * arg) {
+  app_post_trace_report_timeout(NULL, 0);
+}
+
+
+
+void app_start_trace_reporter(void) {
+  esp_timer_create_args_t timer_args = {
+    .name = "app-trace",
+    .callback = &report_traces,
+  };
+  esp_timer_handle_t timer;
+  esp_timer_create(&timer_args, &timer);
+  esp_timer_start_periodic(timer, (uint64_t) CONFIG_APP_TRACE_REPORT_INTERVAL_SEC * 1000 * 1000);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// Where a heat decision started, latencies are kept per origin.
+typedef enum {
+  APP_TRACE_ORIGIN_NONE,
+  APP_TRACE_ORIGIN_BLE,
+  APP_TRACE_ORIGIN_HOMEKIT,
+  APP_TRACE_ORIGIN_MQTT,
+
+  APP_TRACE_ORIGIN_MAX
+} app_trace_origin_t;
+
+
+// Trace context carried through event payloads from the origin to the PWM.
+typedef struct {
+  // lower 32 bits of esp_timer_get_time at the origin, differences stay valid across wraps
+  uint32_t origin_us;
+  uint16_t id;
+  uint8_t origin;
+} app_trace_t;
+
+
+typedef struct {
+  float temp;
+  // heating zone the temperature belongs to, ahead of the trace to be
+  // within the bytes the event recorder keeps
+  uint8_t zone;
+  app_trace_t trace;
+} app_traced_temp_t;
+
+
+typedef struct {
+  uint32_t count;
+  uint32_t p50_us;
+  uint32_t p90_us;
+  uint32_t p99_us;
+  uint32_t max_us;
+} app_trace_stats_t;
+
+
+app_trace_t app_trace_begin(app_trace_origin_t origin);
+
+// Records the latency from the trace origin until now, traces without origin are ignored.
+void app_trace_end(const app_trace_t * trace);
+
+// Percentiles over the most recent latencies of the origin, max since start.
+void app_trace_get_stats(app_trace_origin_t origin, app_trace_stats_t * stats);
+
+const char * app_trace_origin_name(app_trace_origin_t origin);
+
+// Periodically posts APP_EVENT_TRACE_REPORT.
+void app_start_trace_reporter(void);
+
+
+#ifdef __cplusplus
+}
+#endif
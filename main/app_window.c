@@ -0,0 +1,61 @@
+#include <string.h>
+
+#include "./app_window.h"
+
+
+// fewer samples give no reliable slope
+#define MIN_SAMPLES 3
+
+
+
+void app_window_init(app_window_t * window, uint32_t window_sec, uint16_t drop_cdeg_per_min) {
+  memset(window, 0, sizeof(app_window_t));
+  window->window_ms = window_sec * 1000;
+  window->threshold = -drop_cdeg_per_min / 100.0f;
+}
+
+
+
+void app_window_reset(app_window_t * window) {
+  window->head = 0;
+  window->count = 0;
+  window->slope = 0;
+}
+
+
+
+bool app_window_update(app_window_t * window, uint32_t at_ms, float temp) {
+  window->at_ms[window->head] = at_ms;
+  window->temp[window->head] = temp;
+  window->head = (window->head + 1) % APP_WINDOW_SAMPLES;
+  if (window->count < APP_WINDOW_SAMPLES) {
+    window->count += 1;
+  }
+
+  // least squares over the samples within the window, newest first,
+  // in minutes before the newest so the sums stay small
+  float n = 0, sum_t = 0, sum_y = 0, sum_tt = 0, sum_ty = 0;
+  for (int k = 0; k < window->count; k++) {
+    const int i = (window->head + APP_WINDOW_SAMPLES - 1 - k) % APP_WINDOW_SAMPLES;
+    const uint32_t age_ms = at_ms - window->at_ms[i];
+    if (age_ms > window->window_ms) {
+      break;
+    }
+    const float t = -(float) age_ms / 60000;
+    const float y = window->temp[i] - temp;
+    n += 1;
+    sum_t += t;
+    sum_y += y;
+    sum_tt += t * t;
+    sum_ty += t * y;
+  }
+
+  const float denom = n * sum_tt - sum_t * sum_t;
+  if (n < MIN_SAMPLES || denom <= 0) {
+    window->slope = 0;
+    return false;
+  }
+
+  window->slope = (n * sum_ty - sum_t * sum_y) / denom;
+  return window->slope <= window->threshold;
+}
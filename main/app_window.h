@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// Open window detection.
+// The slope of the recent temperatures is fitted over a ring of samples,
+// a fall faster than any heating loss flags an open window. The ring is
+// fixed, an update costs a pass over it and never allocates.
+
+#define APP_WINDOW_SAMPLES 16
+
+
+typedef struct {
+  uint32_t window_ms;
+  // °C per minute, negative
+  float threshold;
+
+  uint32_t at_ms[APP_WINDOW_SAMPLES];
+  float temp[APP_WINDOW_SAMPLES];
+  // next slot to write
+  uint8_t head;
+  uint8_t count;
+
+  // of the last update, °C per minute
+  float slope;
+} app_window_t;
+
+
+// Flags falls of more than `drop_cdeg_per_min` (1/100 °C per minute),
+// fitted over the samples of the last `window_sec`.
+void app_window_init(app_window_t * window, uint32_t window_sec, uint16_t drop_cdeg_per_min);
+
+// Forgets the samples, e.g. after a sensor error or once a window was
+// flagged.
+void app_window_reset(app_window_t * window);
+
+// Adds a sample taken at `at_ms`, returns true if the temperature is
+// falling faster than the threshold.
+bool app_window_update(app_window_t * window, uint32_t at_ms, float temp);
+
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,13 @@
+#include <stdio.h>
+
+#include "./app_zones.h"
+
+
+
+void app_zone_nvs_namespace(char * name, const char * base, uint8_t zone) {
+  if (zone == 0) {
+    snprintf(name, APP_ZONE_NVS_NAME_SIZE, "%s", base);
+  } else {
+    snprintf(name, APP_ZONE_NVS_NAME_SIZE, "%s%u", base, zone);
+  }
+}
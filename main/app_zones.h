@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sdkconfig.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// Heating zones, each with its own sensor, valve and thermostat.
+// Zone 0 keeps the NVS namespaces, MQTT topics and HomeKit service of a
+// single zone device.
+
+#define APP_ZONES CONFIG_APP_ZONE_COUNT
+
+// NVS namespace names are limited to 15 characters
+#define APP_ZONE_NVS_NAME_SIZE 16
+
+
+// payload of per zone float readings
+typedef struct {
+  float value;
+  uint8_t zone;
+} app_zone_value_t;
+
+
+// payload of per zone flags
+typedef struct {
+  bool value;
+  uint8_t zone;
+} app_zone_flag_t;
+
+
+// The NVS namespace of a zone's settings, `base` for zone 0 and `base`
+// with the zone number appended for the others.
+void app_zone_nvs_namespace(char * name, const char * base, uint8_t zone);
+
+
+#ifdef __cplusplus
+}
+#endif
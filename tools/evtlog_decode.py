@@ -0,0 +1,154 @@
+#!/usr/bin/env python3
+"""
+Decodes a dump of the evtlog partition into a timeline of app events.
+
+Dump the partition from a device:
+
+    esptool.py read_flash 0x347000 0xB9000 evtlog.bin
+
+and decode it:
+
+    tools/evtlog_decode.py evtlog.bin
+
+Event names and payload types are read from the APP_EVENTS table in
+main/app_events.h, the record layout matches main/app_recorder.c.
+"""
+
+import argparse
+import datetime
+import os
+import re
+import struct
+import sys
+
+
+SECTOR_SIZE = 4096
+HEADER_SIZE = 32
+RECORD_SIZE = 16
+SECTOR_MAGIC = 0x474c5645
+
+HEADER = struct.Struct('<IIIII12x')
+RECORD = struct.Struct('<BBHI8s')
+
+DEFAULT_EVENTS_HEADER = os.path.join(
+  os.path.dirname(os.path.abspath(__file__)), '..', 'main', 'app_events.h'
+)
+
+
+PAYLOAD_FORMATS = {
+  'float': ('<f', lambda v: '%.3f' % v),
+  'uint8_t': ('<B', str),
+  'uint32_t': ('<I', str),
+  'esp_err_t': ('<i', lambda v: '0x%x' % v),
+  'bool': ('<?', str),
+  # only the temperature and the zone fit into a record, the trace is cut off
+  'app_traced_temp_t': ('<fB', lambda v, zone: '%.3f zone %d' % (v, zone)),
+  'app_zone_value_t': ('<fB', lambda v, zone: '%.3f zone %d' % (v, zone)),
+  'app_zone_flag_t': ('<?B', lambda v, zone: '%s zone %d' % (v, zone)),
+  # the error in 1/100 °C, the Q16 terms are cut off
+  'app_pid_terms_t': ('<i', lambda v: '%.2f' % (v / 100.0)),
+  # the gain in °C/h per duty %
+  'app_model_fit_t': ('<f', lambda v: '%.4f' % v),
+  # the ultimate gain in duty % per °C
+  'app_autotune_result_t': ('<f', lambda v: '%.2f' % v),
+  'app_schedule_t': ('<B', lambda count: '%d entries' % count),
+  'app_smith_prediction_t': ('<ff', lambda measured, predicted: '%.3f -> %.3f' % (measured, predicted)),
+}
+
+
+def load_events(path):
+  with open(path) as f:
+    source = f.read()
+
+  table = source[source.index('#define APP_EVENTS(X)'):]
+  table = table[:table.index('\n\n')]
+
+  return [
+    (name, payload_type)
+    for (_, name, payload_type) in re.findall(r'X\((\w+),\s*(\w+),\s*(\w+),', table)
+  ]
+
+
+def format_payload(payload_type, size, data):
+  if size == 0:
+    return ''
+
+  fmt = PAYLOAD_FORMATS.get(payload_type)
+  if fmt is not None and struct.calcsize(fmt[0]) <= min(size, len(data)):
+    return fmt[1](*struct.unpack_from(fmt[0], data))
+
+  shown = data[:min(size, len(data))].hex()
+  return shown + ('...' if size > len(data) else '')
+
+
+def read_sectors(dump):
+  sectors = []
+
+  for offset in range(0, len(dump) - SECTOR_SIZE + 1, SECTOR_SIZE):
+    magic, seq, boot, epoch, uptime_ms = HEADER.unpack_from(dump, offset)
+    if magic != SECTOR_MAGIC:
+      continue
+
+    records = []
+    for slot in range(offset + HEADER_SIZE, offset + SECTOR_SIZE, RECORD_SIZE):
+      record = RECORD.unpack_from(dump, slot)
+      if record[0] == 0xff:
+        break
+      records.append(record)
+
+    sectors.append({
+      'seq': seq,
+      'boot': boot,
+      'epoch': epoch,
+      'uptime_ms': uptime_ms,
+      'records': records,
+    })
+
+  return sorted(sectors, key=lambda s: s['seq'])
+
+
+def format_time(sector, uptime_ms):
+  if sector['epoch'] == 0:
+    return '+%12.3fs' % (uptime_ms / 1000.0)
+
+  wall = sector['epoch'] + (uptime_ms - sector['uptime_ms']) / 1000.0
+  return datetime.datetime.utcfromtimestamp(wall).strftime('%Y-%m-%d %H:%M:%S.%f')[:-3]
+
+
+def main():
+  parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+  parser.add_argument('dump', help='binary dump of the evtlog partition')
+  parser.add_argument('--events', default=DEFAULT_EVENTS_HEADER, help='path to app_events.h')
+  parser.add_argument('--boot', type=int, help='only show this boot')
+  args = parser.parse_args()
+
+  events = load_events(args.events)
+
+  with open(args.dump, 'rb') as f:
+    dump = f.read()
+
+  last_boot = None
+  for sector in read_sectors(dump):
+    if args.boot is not None and sector['boot'] != args.boot:
+      continue
+
+    if sector['boot'] != last_boot:
+      print('--- boot %d' % sector['boot'])
+      last_boot = sector['boot']
+
+    for evt_id, size, dropped, uptime_ms, data in sector['records']:
+      if dropped:
+        print('%s  ... %d events lost' % (format_time(sector, uptime_ms), dropped))
+
+      if evt_id < len(events):
+        name, payload_type = events[evt_id]
+      else:
+        name, payload_type = ('EVENT_%d' % evt_id, None)
+
+      print('%s  %-22s %s' % (format_time(sector, uptime_ms), name, format_payload(payload_type, size, data)))
+
+  return 0
+
+
+if __name__ == '__main__':
+  sys.exit(main())
@@ -0,0 +1,181 @@
+#!/usr/bin/env python3
+"""
+Captures the thermostat inputs of a device into a replay trace.
+
+From a dump of the evtlog partition, every recorded input:
+
+    tools/trace_capture.py evtlog evtlog.bin > incident.trace
+
+From a UART log, the BLE readings and the changes app-stats logs:
+
+    idf.py monitor | tee uart.log
+    tools/trace_capture.py log uart.log > incident.trace
+
+From the MQTT stats reports, with a timestamp in seconds in front:
+
+    mosquitto_sub -v -F '%U %t %p' -t '<prefix>/#' | tee stats.log
+    tools/trace_capture.py mqtt stats.log > incident.trace
+
+Replay the trace with host/replay/replay_thermostat, the format is
+described there. Times start at 0 with the first captured input.
+"""
+
+import argparse
+import json
+import os
+import re
+import struct
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import evtlog_decode  # noqa: E402
+
+
+MODES = ['levels', 'pid', 'predictive']
+
+ANSI = re.compile(r'\x1b\[[0-9;]*m')
+LOG_BLE_TEMP = re.compile(r'\((\d+)\) app-thermometer: BLE temp of zone (\d+): (-?[\d.]+)')
+LOG_STATS = re.compile(
+  r'\((\d+)\) app-stats: zone: (\d+) curr: (-?[\d.]+) C, target: (-?[\d.]+) C heat: \d+ ERR: (\d)'
+)
+MQTT_LINE = re.compile(r'^(\d+(?:\.\d+)?)\s+(?:(\S+)\s+)?(\{.*\})\s*$')
+MQTT_ZONE = re.compile(r'/zones/(\d+)/')
+
+
+class Trace:
+  def __init__(self):
+    self.inputs = []
+    self.last = {}
+
+  def add(self, at_ms, kind, value, zone=None):
+    self.inputs.append((int(at_ms), kind, value, zone))
+
+  def add_change(self, at_ms, kind, value, zone=0):
+    # snapshots repeat values, only their changes are inputs
+    if self.last.get((kind, zone)) != value:
+      self.last[(kind, zone)] = value
+      self.add(at_ms, kind, value, zone)
+
+  def write(self, out, source):
+    out.write('# captured by trace_capture.py from %s\n' % source)
+    if not self.inputs:
+      return
+
+    inputs = sorted(self.inputs, key=lambda i: i[0])
+    start = inputs[0][0]
+    for at_ms, kind, value, zone in inputs:
+      line = '%d %s %s' % (at_ms - start, kind, value)
+      out.write(line + (' %d\n' % zone if zone else '\n'))
+    out.write('%d end\n' % (inputs[-1][0] - start))
+
+
+def temp(value):
+  return '%.3f' % value
+
+
+def capture_evtlog(path, boot, trace):
+  events = evtlog_decode.load_events(evtlog_decode.DEFAULT_EVENTS_HEADER)
+  with open(path, 'rb') as f:
+    sectors = evtlog_decode.read_sectors(f.read())
+  if not sectors:
+    return
+
+  # the last boot unless asked otherwise, uptimes restart with every boot
+  boot = sectors[-1]['boot'] if boot is None else boot
+  for sector in sectors:
+    if sector['boot'] != boot:
+      continue
+
+    for evt_id, size, dropped, uptime_ms, data in sector['records']:
+      if dropped:
+        sys.stderr.write('%d events lost before %d ms\n' % (dropped, uptime_ms))
+      if evt_id >= len(events):
+        continue
+
+      name = events[evt_id][0]
+      if name == 'current_temp_changed':
+        value, zone = struct.unpack_from('<fB', data)
+        trace.add(uptime_ms, 'temp', temp(value), zone)
+      elif name == 'target_temp_changed':
+        value, zone = struct.unpack_from('<fB', data)
+        trace.add(uptime_ms, 'target', temp(value), zone)
+      elif name == 'current_humid_changed':
+        value, zone = struct.unpack_from('<fB', data)
+        trace.add(uptime_ms, 'humid', '%.1f' % value, zone)
+      elif name == 'temp_read_state':
+        error, zone = struct.unpack_from('<?B', data)
+        trace.add(uptime_ms, 'sensor', 'error' if error else 'ok', zone)
+      elif name == 'outdoor_temp_changed':
+        trace.add(uptime_ms, 'outdoor', temp(struct.unpack_from('<f', data)[0]))
+      elif name == 'controller_mode_set' and data[0] < len(MODES):
+        trace.add(uptime_ms, 'mode', MODES[data[0]])
+
+
+def capture_log(path, trace):
+  with open(path, errors='replace') as f:
+    for line in f:
+      line = ANSI.sub('', line)
+
+      match = LOG_BLE_TEMP.search(line)
+      if match:
+        at_ms, zone, value = match.groups()
+        trace.add(at_ms, 'temp', temp(float(value)), int(zone))
+        continue
+
+      match = LOG_STATS.search(line)
+      if match:
+        at_ms, zone, _, target, error = match.groups()
+        trace.add_change(at_ms, 'target', temp(float(target)), int(zone))
+        trace.add_change(at_ms, 'sensor', 'error' if error == '1' else 'ok', int(zone))
+
+
+def capture_mqtt(path, trace):
+  with open(path, errors='replace') as f:
+    for line in f:
+      match = MQTT_LINE.match(line)
+      if not match:
+        continue
+
+      at_sec, topic, payload = match.groups()
+      if topic is not None and not topic.endswith('/stats/report'):
+        continue
+      zone_match = MQTT_ZONE.search(topic or '')
+      zone = int(zone_match.group(1)) if zone_match else 0
+
+      try:
+        stats = json.loads(payload)
+      except ValueError:
+        continue
+
+      at_ms = float(at_sec) * 1000
+      if 'error' in stats:
+        trace.add_change(at_ms, 'sensor', 'error' if stats['error'] else 'ok', zone)
+      if 'target_temp' in stats:
+        trace.add_change(at_ms, 'target', temp(stats['target_temp']), zone)
+      if 'current_humid' in stats:
+        trace.add_change(at_ms, 'humid', '%.1f' % stats['current_humid'], zone)
+      if 'current_temp' in stats and not stats.get('error'):
+        trace.add_change(at_ms, 'temp', temp(stats['current_temp']), zone)
+
+
+def main():
+  parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+  parser.add_argument('source', choices=['evtlog', 'log', 'mqtt'], help='kind of capture')
+  parser.add_argument('path', help='evtlog dump, UART log or MQTT log')
+  parser.add_argument('--boot', type=int, help='evtlog only, the boot to capture, the last by default')
+  args = parser.parse_args()
+
+  trace = Trace()
+  if args.source == 'evtlog':
+    capture_evtlog(args.path, args.boot, trace)
+  elif args.source == 'log':
+    capture_log(args.path, trace)
+  else:
+    capture_mqtt(args.path, trace)
+
+  trace.write(sys.stdout, os.path.basename(args.path))
+  return 0
+
+
+if __name__ == '__main__':
+  sys.exit(main())